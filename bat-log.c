@@ -0,0 +1,289 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "sysfs-attr.h"
+#include "settings.h"
+#include "bat-log.h"
+
+#define BAT_LOG_SIZE	(sizeof(bat_log_hdr_t) + BAT_LOG_RECORDS * sizeof(bat_log_rec_t))
+
+// seq is never 0 for a written record
+#define BAT_LOG_SEQ(n)	((uint16_t)((n) % 65535 + 1))
+
+static const char *bat_log_status_names[] = {
+	[BAT_LOG_STATUS_UNKNOWN] = "Unknown",
+	[BAT_LOG_STATUS_CHARGING] = "Charging",
+	[BAT_LOG_STATUS_DISCHARGING] = "Discharging",
+	[BAT_LOG_STATUS_NOT_CHARGING] = "Not charging",
+	[BAT_LOG_STATUS_FULL] = "Full",
+};
+
+enum {
+	BAT_LOG_ATTR_CAPACITY = 0,
+	BAT_LOG_ATTR_STATUS,
+	BAT_LOG_ATTR_ENERGY,
+	BAT_LOG_ATTR_POWER,
+	BAT_LOG_ATTR_VOLTAGE,
+	BAT_LOG_ATTR_START,
+	BAT_LOG_ATTR_END,
+	BAT_LOG_ATTR_NUM
+};
+
+static sysfs_attr_t bat_log_attrs[BAT_LOG_ATTR_NUM] = {
+	[BAT_LOG_ATTR_CAPACITY] = SYSFS_ATTR_INIT(BAT_SOC, O_RDONLY),
+	[BAT_LOG_ATTR_STATUS] = SYSFS_ATTR_INIT(BAT_STATUS, O_RDONLY),
+	[BAT_LOG_ATTR_ENERGY] = SYSFS_ATTR_INIT(BAT_ENERGY_NOW, O_RDONLY),
+	[BAT_LOG_ATTR_POWER] = SYSFS_ATTR_INIT(BAT_POWER_NOW, O_RDONLY),
+	[BAT_LOG_ATTR_VOLTAGE] = SYSFS_ATTR_INIT(BAT_VOLTAGE_NOW, O_RDONLY),
+	[BAT_LOG_ATTR_START] = SYSFS_ATTR_INIT(BAT_START_THRESHOLD_PATH, O_RDONLY),
+	[BAT_LOG_ATTR_END] = SYSFS_ATTR_INIT(BAT_END_THRESHOLD_PATH, O_RDONLY),
+};
+
+
+const char *bat_log_status_name(int status)
+{
+	if (status < 0 || status > BAT_LOG_STATUS_FULL)
+		status = BAT_LOG_STATUS_UNKNOWN;
+
+	return bat_log_status_names[status];
+}
+
+int bat_log_status_parse(const char *status)
+{
+	int i;
+
+	for (i = BAT_LOG_STATUS_FULL; i > BAT_LOG_STATUS_UNKNOWN; i--) {
+		if (strncmp(status, bat_log_status_names[i], strlen(bat_log_status_names[i])) == 0)
+			return i;
+	}
+
+	return BAT_LOG_STATUS_UNKNOWN;
+}
+
+static int bat_log_hdr_valid(const bat_log_hdr_t *hdr)
+{
+	return memcmp(hdr->magic, BAT_LOG_MAGIC, sizeof(hdr->magic)) == 0 &&
+		hdr->version == BAT_LOG_VERSION &&
+		hdr->rec_size == sizeof(bat_log_rec_t) &&
+		hdr->records == BAT_LOG_RECORDS;
+}
+
+// the header goes in last, a crash before that leaves a file we reinit again
+static int bat_log_init(bat_log_t *log)
+{
+	bat_log_hdr_t hdr;
+
+	if (ftruncate(log->fd, 0) < 0 || ftruncate(log->fd, BAT_LOG_SIZE) < 0)
+		return -errno;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BAT_LOG_MAGIC, sizeof(hdr.magic));
+	hdr.version = BAT_LOG_VERSION;
+	hdr.rec_size = sizeof(bat_log_rec_t);
+	hdr.records = BAT_LOG_RECORDS;
+	if (pwrite(log->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return -EIO;
+
+	return 0;
+}
+
+// writer creates or repairs the file and takes an exclusive lock,
+// readers only map what is there
+int bat_log_open(bat_log_t *log, const char *path, int writer)
+{
+	bat_log_hdr_t hdr;
+	struct stat st;
+	int res;
+
+	memset(log, 0, sizeof(*log));
+	log->writer = writer;
+	log->fd = open(path, writer ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+	if (log->fd < 0)
+		return -errno;
+
+	if (writer && flock(log->fd, LOCK_EX | LOCK_NB) < 0) {
+		res = (errno == EWOULDBLOCK) ? -EBUSY : -errno;
+		goto err;
+	}
+
+	if (fstat(log->fd, &st) < 0) {
+		res = -errno;
+		goto err;
+	}
+	if (st.st_size != (off_t)BAT_LOG_SIZE || pread(log->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    !bat_log_hdr_valid(&hdr)) {
+		if (!writer) {
+			res = -EINVAL;
+			goto err;
+		}
+		res = bat_log_init(log);
+		if (res < 0)
+			goto err;
+	}
+
+	log->hdr = mmap(NULL, BAT_LOG_SIZE, writer ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, log->fd, 0);
+	if (log->hdr == MAP_FAILED) {
+		log->hdr = NULL;
+		res = -errno;
+		goto err;
+	}
+	log->rec = (bat_log_rec_t *)(log->hdr + 1);
+
+	// pick up where we left, so the first sample after a restart is not a duplicate
+	if (writer && bat_log_head(log) > 0)
+		bat_log_get(log, bat_log_head(log) - 1, &log->last);
+
+	return 0;
+
+err:
+	close(log->fd);
+	log->fd = -1;
+	return res;
+}
+
+void bat_log_close(bat_log_t *log)
+{
+	if (log->hdr != NULL)
+		munmap(log->hdr, BAT_LOG_SIZE);
+	log->hdr = NULL;
+	log->rec = NULL;
+	if (log->fd >= 0)
+		close(log->fd);
+	log->fd = -1;
+}
+
+uint64_t bat_log_head(const bat_log_t *log)
+{
+	return __atomic_load_n(&log->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+// oldest record that may still be in the ring
+uint64_t bat_log_tail(const bat_log_t *log)
+{
+	uint64_t head = bat_log_head(log);
+
+	return (head > BAT_LOG_RECORDS) ? head - BAT_LOG_RECORDS : 0;
+}
+
+// single writer, so no lock: invalidate the slot, fill it, stamp it, publish
+int bat_log_append(bat_log_t *log, const bat_log_rec_t *rec)
+{
+	bat_log_rec_t *slot;
+	uint64_t head;
+
+	if (log->hdr == NULL || !log->writer)
+		return -EBADF;
+
+	head = log->hdr->head;
+	slot = &log->rec[head % BAT_LOG_RECORDS];
+	log->last = *rec;
+	log->last.seq = 0;
+
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(slot, &log->last, sizeof(*slot));
+	__atomic_store_n(&slot->seq, BAT_LOG_SEQ(head), __ATOMIC_RELEASE);
+	__atomic_store_n(&log->hdr->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+// -ENOENT if record n was overwritten, never completed or torn by a crash
+int bat_log_get(const bat_log_t *log, uint64_t n, bat_log_rec_t *rec)
+{
+	const bat_log_rec_t *slot;
+	uint16_t seq;
+
+	if (n >= bat_log_head(log) || n < bat_log_tail(log))
+		return -ENOENT;
+
+	slot = &log->rec[n % BAT_LOG_RECORDS];
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	memcpy(rec, slot, sizeof(*rec));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (seq != BAT_LOG_SEQ(n) || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+		return -ENOENT;
+	rec->seq = seq;
+
+	return 0;
+}
+
+static unsigned int bat_log_clamp(int val, int div, unsigned int max)
+{
+	if (val < 0)
+		return 0;
+	val /= div;
+
+	return ((unsigned int)val > max) ? max : (unsigned int)val;
+}
+
+// one batched read of BAT0, appended only if it tells something new;
+// returns 1 if a record was written
+int bat_log_sample(bat_log_t *log)
+{
+	sysfs_attr_t *set[BAT_LOG_ATTR_NUM];
+	bat_log_rec_t rec;
+	int i, dp;
+
+	for (i = 0; i < BAT_LOG_ATTR_NUM; i++)
+		set[i] = &bat_log_attrs[i];
+	sysfs_attr_refresh(set, BAT_LOG_ATTR_NUM);
+	if (bat_log_attrs[BAT_LOG_ATTR_CAPACITY].len <= 0)
+		return -ENODEV;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time = (uint32_t)time(NULL);
+	rec.capacity = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_CAPACITY]), 1, 100);
+	if (bat_log_attrs[BAT_LOG_ATTR_STATUS].len > 0)
+		rec.status = bat_log_status_parse(bat_log_attrs[BAT_LOG_ATTR_STATUS].buf);
+	// sysfs reports uWh, uW and uV
+	rec.energy = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_ENERGY]), 10000, UINT16_MAX);
+	rec.power = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_POWER]), 10000, UINT16_MAX);
+	rec.voltage = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_VOLTAGE]), 1000, UINT16_MAX);
+	rec.start_thres = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_START]), 1, 100);
+	rec.end_thres = bat_log_clamp(sysfs_attr_int(&bat_log_attrs[BAT_LOG_ATTR_END]), 1, 100);
+
+	dp = (int)rec.power - (int)log->last.power;
+	if (log->last.time != 0 &&
+	    rec.time - log->last.time < BAT_LOG_HEARTBEAT &&
+	    rec.capacity == log->last.capacity &&
+	    rec.status == log->last.status &&
+	    rec.energy == log->last.energy &&
+	    rec.start_thres == log->last.start_thres &&
+	    rec.end_thres == log->last.end_thres &&
+	    abs(dp) < BAT_LOG_POWER_DEADBAND)
+		return 0;
+
+	if (bat_log_append(log, &rec) < 0)
+		return -EBADF;
+
+	return 1;
+}
@@ -0,0 +1,97 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _BAT_LOG_H
+#define _BAT_LOG_H
+
+#include <stdint.h>
+
+// battery history, a fixed size ring of fixed width records in a shared
+// mapping; one writer appends, any number of readers map it read-only
+
+#define BAT_LOG_MAGIC			"LCBATLOG"
+#define BAT_LOG_VERSION			1
+// 16 byte records, 4 MiB of ring
+#define BAT_LOG_RECORDS			(1 << 18)
+// append even if nothing changed, so gaps mean "not recording"
+#define BAT_LOG_HEARTBEAT		300
+// a power_now change smaller than this (10 mW units) is not worth a record
+#define BAT_LOG_POWER_DEADBAND	50
+
+#define BAT_LOG_SYSTEM_PATH		"/var/lib/librem-control/battery.log"
+#define BAT_LOG_USER_FILE		"librem-control/battery.log"
+
+enum {
+	BAT_LOG_STATUS_UNKNOWN = 0,
+	BAT_LOG_STATUS_CHARGING,
+	BAT_LOG_STATUS_DISCHARGING,
+	BAT_LOG_STATUS_NOT_CHARGING,
+	BAT_LOG_STATUS_FULL,
+};
+
+typedef struct {
+	uint32_t time;			// seconds since the epoch
+	uint16_t seq;			// low bits of the record number, 0 = never written
+	uint8_t capacity;		// %
+	uint8_t status;			// BAT_LOG_STATUS_*
+	uint16_t energy;		// energy_now, 10 mWh
+	uint16_t power;			// power_now, 10 mW
+	uint16_t voltage;		// voltage_now, mV
+	uint8_t start_thres;	// %
+	uint8_t end_thres;		// %
+} bat_log_rec_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+	uint32_t records;		// ring size
+	uint32_t pad;
+	uint64_t head;			// records ever appended, only ever grows
+	uint8_t reserved[32];
+} bat_log_hdr_t;
+
+typedef struct {
+	int fd;
+	int writer;
+	bat_log_hdr_t *hdr;
+	bat_log_rec_t *rec;
+	bat_log_rec_t last;		// last appended, for skipping duplicates
+} bat_log_t;
+
+const char *bat_log_status_name(int status);
+
+int bat_log_status_parse(const char *status);
+
+int bat_log_open(bat_log_t *log, const char *path, int writer);
+
+void bat_log_close(bat_log_t *log);
+
+int bat_log_append(bat_log_t *log, const bat_log_rec_t *rec);
+
+int bat_log_sample(bat_log_t *log);
+
+int bat_log_get(const bat_log_t *log, uint64_t n, bat_log_rec_t *rec);
+
+uint64_t bat_log_head(const bat_log_t *log);
+
+uint64_t bat_log_tail(const bat_log_t *log);
+
+#endif
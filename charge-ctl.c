@@ -0,0 +1,271 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Start/stop charging now, by moving one charge threshold temporarily.
+ *
+ * The temporary threshold is written, then BAT0/status is watched
+ * (uevents fed in through charge_ctl_status() plus a short poll) until
+ * the charger switched, and the old threshold is restored right away.
+ * If the charger does not react within CHARGE_CTL_TIMEOUT_MS the old
+ * threshold is restored as well. Writes are queued on the write-behind,
+ * which runs them one at a time and in order with all other writes.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "settings.h"
+#include "charge-ctl.h"
+
+typedef enum {
+	CC_IDLE = 0,
+	CC_ARMING,			// temporary threshold being written
+	CC_WAITING,			// watching for the status change
+	CC_RESTORING,		// old threshold being written
+} cc_state_t;
+
+struct _charge_ctl {
+	write_behind_t *wb;
+	cc_state_t state;
+	charge_ctl_op_t op;
+	int id;
+	int temp_value;
+	int restore_value;
+	charge_ctl_result_t result;
+	gboolean cancel;
+	gboolean dead;				// freed while a write was in flight
+	gint64 start;
+	guint timeout;
+	guint poll;
+	charge_ctl_done_func done;
+	gpointer user_data;
+};
+
+static void charge_ctl_restore(charge_ctl_t *cc, charge_ctl_result_t result);
+
+
+static gboolean charge_ctl_reached(charge_ctl_t *cc, const char *status)
+{
+	if (cc->op == CHARGE_CTL_START)
+		return strcmp(status, "Charging") == 0;
+
+	return strcmp(status, "Charging") != 0;
+}
+
+static void charge_ctl_stop_watch(charge_ctl_t *cc)
+{
+	if (cc->timeout != 0) {
+		g_source_remove(cc->timeout);
+		cc->timeout = 0;
+	}
+	if (cc->poll != 0) {
+		g_source_remove(cc->poll);
+		cc->poll = 0;
+	}
+}
+
+static void charge_ctl_finish(charge_ctl_t *cc)
+{
+	guint elapsed = (g_get_monotonic_time() - cc->start) / 1000;
+
+	cc->state = CC_IDLE;
+	g_debug("charge %s: result %d after %u ms", (cc->op == CHARGE_CTL_START) ? "start" : "stop",
+		cc->result, elapsed);
+	if (cc->done)
+		cc->done(cc->result, elapsed, cc->user_data);
+}
+
+static void charge_ctl_write(charge_ctl_t *cc, int value, write_behind_done_func done)
+{
+	write_behind_write(cc->wb, cc->id, value, done, cc);
+}
+
+static void charge_ctl_restored(int res, gpointer user_data)
+{
+	charge_ctl_t *cc = (charge_ctl_t *)user_data;
+
+	if (res < 0)
+		cc->result = CHARGE_CTL_FAILED;
+	if (cc->dead) {
+		g_free(cc);
+		return;
+	}
+	charge_ctl_finish(cc);
+}
+
+static void charge_ctl_restore(charge_ctl_t *cc, charge_ctl_result_t result)
+{
+	charge_ctl_stop_watch(cc);
+	cc->result = result;
+	cc->state = CC_RESTORING;
+	charge_ctl_write(cc, cc->restore_value, charge_ctl_restored);
+}
+
+static gboolean charge_ctl_timeout(gpointer user_data)
+{
+	charge_ctl_t *cc = (charge_ctl_t *)user_data;
+
+	cc->timeout = 0;
+	charge_ctl_restore(cc, CHARGE_CTL_TIMEOUT);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean charge_ctl_poll(gpointer user_data)
+{
+	charge_ctl_t *cc = (charge_ctl_t *)user_data;
+	char status[32];
+
+	if (settings_read_string(SETTING_BAT_STATUS, status, sizeof(status)) == 0)
+		charge_ctl_status(cc, status);
+
+	return (cc->poll != 0) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void charge_ctl_armed(int res, gpointer user_data)
+{
+	charge_ctl_t *cc = (charge_ctl_t *)user_data;
+
+	if (res < 0) {
+		// nothing changed, nothing to restore
+		if (cc->dead) {
+			g_free(cc);
+			return;
+		}
+		cc->result = CHARGE_CTL_FAILED;
+		charge_ctl_finish(cc);
+		return;
+	}
+	if (cc->dead) {
+		// charge_ctl_free() queued the old threshold behind us
+		g_free(cc);
+		return;
+	}
+	if (cc->cancel) {
+		charge_ctl_restore(cc, CHARGE_CTL_CANCELLED);
+		return;
+	}
+
+	cc->state = CC_WAITING;
+	cc->timeout = g_timeout_add(CHARGE_CTL_TIMEOUT_MS, charge_ctl_timeout, cc);
+	cc->poll = g_timeout_add(CHARGE_CTL_POLL_MS, charge_ctl_poll, cc);
+}
+
+// writes go through wb, it has to outlive cc
+charge_ctl_t *charge_ctl_new(write_behind_t *wb)
+{
+	charge_ctl_t *cc;
+
+	cc = g_new0(charge_ctl_t, 1);
+	cc->wb = wb;
+
+	return cc;
+}
+
+gboolean charge_ctl_busy(charge_ctl_t *cc)
+{
+	return cc->state != CC_IDLE;
+}
+
+// write temp_value to setting id, restore_value once the status flipped
+int charge_ctl_run(charge_ctl_t *cc, charge_ctl_op_t op, int id, int temp_value, int restore_value,
+                   charge_ctl_done_func done, gpointer user_data)
+{
+	char status[32];
+
+	if (cc->state != CC_IDLE)
+		return -EBUSY;
+
+	cc->op = op;
+	cc->id = id;
+	cc->temp_value = temp_value;
+	cc->restore_value = restore_value;
+	cc->done = done;
+	cc->user_data = user_data;
+	cc->cancel = FALSE;
+	cc->start = g_get_monotonic_time();
+
+	if (settings_read_string(SETTING_BAT_STATUS, status, sizeof(status)) == 0 &&
+	    charge_ctl_reached(cc, status)) {
+		cc->result = CHARGE_CTL_NOTHING;
+		charge_ctl_finish(cc);
+		return 0;
+	}
+
+	cc->state = CC_ARMING;
+	charge_ctl_write(cc, temp_value, charge_ctl_armed);
+
+	return 0;
+}
+
+void charge_ctl_cancel(charge_ctl_t *cc)
+{
+	switch (cc->state) {
+		case CC_ARMING:
+			cc->cancel = TRUE;
+			break;
+		case CC_WAITING:
+			charge_ctl_restore(cc, CHARGE_CTL_CANCELLED);
+			break;
+		default:
+			break;
+	}
+}
+
+// BAT0/status as reported by a uevent or the daemon
+void charge_ctl_status(charge_ctl_t *cc, const char *status)
+{
+	if (cc->state != CC_WAITING || status == NULL)
+		return;
+
+	if (charge_ctl_reached(cc, status))
+		charge_ctl_restore(cc, CHARGE_CTL_DONE);
+}
+
+void charge_ctl_free(charge_ctl_t *cc)
+{
+	charge_ctl_stop_watch(cc);
+
+	/*
+	 * Do not leave the temporary threshold behind. The restore goes
+	 * out after the write in flight, at the latest when the write-behind
+	 * is freed, which waits for that write.
+	 */
+	switch (cc->state) {
+		case CC_IDLE:
+			g_free(cc);
+			break;
+		case CC_WAITING:
+			write_behind_write(cc->wb, cc->id, cc->restore_value, NULL, NULL);
+			g_free(cc);
+			break;
+		case CC_ARMING:
+			// charge_ctl_armed() still has to run, it frees cc
+			write_behind_write(cc->wb, cc->id, cc->restore_value, NULL, NULL);
+			cc->dead = TRUE;
+			break;
+		case CC_RESTORING:
+			// already queued, charge_ctl_restored() frees cc
+			cc->dead = TRUE;
+			break;
+	}
+}
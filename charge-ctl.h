@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _CHARGE_CTL_H
+#define _CHARGE_CTL_H
+
+#include <glib.h>
+
+#include "write-behind.h"
+
+// how long the charger gets to react before we give up and restore
+#define CHARGE_CTL_TIMEOUT_MS	5000
+// BAT0/status is re-read this often in case no uevent arrives
+#define CHARGE_CTL_POLL_MS		100
+
+typedef enum {
+	CHARGE_CTL_START = 0,		// start charging now, up to the end threshold
+	CHARGE_CTL_STOP,			// stop charging now
+} charge_ctl_op_t;
+
+typedef enum {
+	CHARGE_CTL_DONE = 0,		// transition observed, threshold restored
+	CHARGE_CTL_NOTHING,			// already in the wanted state, nothing written
+	CHARGE_CTL_TIMEOUT,
+	CHARGE_CTL_CANCELLED,
+	CHARGE_CTL_FAILED,
+} charge_ctl_result_t;
+
+typedef void (*charge_ctl_done_func)(charge_ctl_result_t result, guint elapsed_ms, gpointer user_data);
+
+typedef struct _charge_ctl charge_ctl_t;
+
+charge_ctl_t *charge_ctl_new(write_behind_t *wb);
+
+gboolean charge_ctl_busy(charge_ctl_t *cc);
+
+int charge_ctl_run(charge_ctl_t *cc, charge_ctl_op_t op, int id, int temp_value, int restore_value,
+                   charge_ctl_done_func done, gpointer user_data);
+
+void charge_ctl_cancel(charge_ctl_t *cc);
+
+void charge_ctl_status(charge_ctl_t *cc, const char *status);
+
+void charge_ctl_free(charge_ctl_t *cc);
+
+#endif
@@ -0,0 +1,1181 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * librem-control-cli, command line front end without any GTK
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <limits.h>
+#include <signal.h>
+
+#include "ec-tool.h"
+#include "ec-flash.h"
+#include "settings.h"
+#include "bat-log.h"
+#include "powercap.h"
+#include "profile.h"
+#include "fan-curve.h"
+#include "key-matrix.h"
+#include "led-anim.h"
+#include "kbd-led.h"
+#include "ec-console.h"
+#include "ec-stats.h"
+
+// more than there are settings, a key may be given twice
+#define CLI_MAX_ARGS	64
+
+typedef struct {
+	const char *dump_file;
+	const char *flash_file;
+	int backup;
+	int dry_run;
+	unsigned int flash_size;
+	int get;
+	int n_keys;
+	const char *keys[CLI_MAX_ARGS];		// for --get, all if none
+	int n_set;
+	const char *set[CLI_MAX_ARGS];		// key=value
+	int bat_log;
+	const char *bat_log_file;			// default if NULL
+	const char *profile;				// apply this one
+	int profiles;						// list them
+	int powercap;
+	int n_powercap_set;
+	const char *powercap_set[CLI_MAX_ARGS];	// zone/constraint/field=value
+	int fan;
+	const char *fan_curve;				// run it until interrupted
+	int matrix;							// seconds to scan the key matrix
+	const char *led_pattern;			// play it until interrupted
+	int kbd_leds;
+	int n_kbd;
+	int kbd_opt[CLI_MAX_ARGS];			// OPT_KBD_COLOR, _VALUE or _MODE
+	const char *kbd_arg[CLI_MAX_ARGS];	// [index=]value, in command line order
+	int kbd_save;
+	int ec_console;
+	const char *ec_console_file;		// appended to, stdout if NULL
+	int ec_stats;
+	int ec_stats_probes;				// CMD_PROBE round trips, -1 for the default
+} cli_opts_t;
+
+enum {
+	OPT_DUMP_EC_FLASH = 256,
+	OPT_FLASH_EC,
+	OPT_BACKUP,
+	OPT_DRY_RUN,
+	OPT_FLASH_SIZE,
+	OPT_GET,
+	OPT_SET,
+	OPT_BAT_LOG,
+	OPT_PROFILE,
+	OPT_PROFILES,
+	OPT_POWERCAP,
+	OPT_POWERCAP_SET,
+	OPT_FAN,
+	OPT_FAN_CURVE,
+	OPT_MATRIX,
+	OPT_LED_PATTERN,
+	OPT_KBD_LEDS,
+	OPT_KBD_COLOR,
+	OPT_KBD_VALUE,
+	OPT_KBD_MODE,
+	OPT_KBD_SAVE,
+	OPT_EC_CONSOLE,
+	OPT_EC_STATS,
+};
+
+static const struct option cli_options[] = {
+	{ "dump-ec-flash",	required_argument,	NULL, OPT_DUMP_EC_FLASH },
+	{ "flash-ec",		required_argument,	NULL, OPT_FLASH_EC },
+	{ "backup",			no_argument,		NULL, OPT_BACKUP },
+	{ "dry-run",		no_argument,		NULL, OPT_DRY_RUN },
+	{ "flash-size",		required_argument,	NULL, OPT_FLASH_SIZE },
+	{ "get",			no_argument,		NULL, OPT_GET },
+	{ "set",			required_argument,	NULL, OPT_SET },
+	{ "bat-log",		optional_argument,	NULL, OPT_BAT_LOG },
+	{ "profile",		required_argument,	NULL, OPT_PROFILE },
+	{ "profiles",		no_argument,		NULL, OPT_PROFILES },
+	{ "powercap",		no_argument,		NULL, OPT_POWERCAP },
+	{ "powercap-set",	required_argument,	NULL, OPT_POWERCAP_SET },
+	{ "fan",			no_argument,		NULL, OPT_FAN },
+	{ "fan-curve",		required_argument,	NULL, OPT_FAN_CURVE },
+	{ "matrix",			optional_argument,	NULL, OPT_MATRIX },
+	{ "led-pattern",	required_argument,	NULL, OPT_LED_PATTERN },
+	{ "kbd-leds",		no_argument,		NULL, OPT_KBD_LEDS },
+	{ "kbd-color",		required_argument,	NULL, OPT_KBD_COLOR },
+	{ "kbd-value",		required_argument,	NULL, OPT_KBD_VALUE },
+	{ "kbd-mode",		required_argument,	NULL, OPT_KBD_MODE },
+	{ "kbd-save",		no_argument,		NULL, OPT_KBD_SAVE },
+	{ "ec-console",		optional_argument,	NULL, OPT_EC_CONSOLE },
+	{ "ec-stats",		optional_argument,	NULL, OPT_EC_STATS },
+	{ "help",			no_argument,		NULL, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+
+static void cli_usage(const char *prg)
+{
+	int i;
+
+	fprintf(stderr, "usage: %s [options] [key=value ...] [key ...]\n"
+		"  --get [key ...]       print settings as JSON, all if no key is given\n"
+		"  --set key=value ...   change settings as one batch, rolled back if one fails\n"
+		"  --profile NAME        apply a profile the same way\n"
+		"  --profiles            list the profiles\n"
+		"  --dump-ec-flash FILE  dump the EC SPI flash to FILE, '-' for stdout\n"
+		"  --flash-ec FILE       write FILE to the EC SPI flash, only changed sectors\n"
+		"  --backup              use the backup ROM instead of the EC flash\n"
+		"  --dry-run             with --flash-ec, only report what would change\n"
+		"  --flash-size BYTES    flash size, default %d\n"
+		"  --bat-log[=FILE]      print the recorded battery history\n"
+		"  --powercap            print all powercap zones and constraints as JSON\n"
+		"  --powercap-set ZONE/CONSTRAINT/FIELD=VALUE\n"
+		"                        FIELD is power_limit_uw or time_window_us, CONSTRAINT\n"
+		"                        a name or number; all changes to a zone or none\n"
+		"  --fan                 print fan duty, speed and package temperature as JSON\n"
+		"  --fan-curve T:D,...   drive the fan from a temperature (C) to duty (%%) curve\n"
+		"                        until interrupted, e.g. " FAN_CURVE_DEFAULT "\n"
+		"  --matrix[=SECONDS]    poll the key matrix as fast as the EC allows and print\n"
+		"                        presses and releases, default 10s or until interrupted\n"
+		"  --led-pattern PATTERN play a notification LED pattern until interrupted:\n"
+		"                        solid RRGGBB, blink RRGGBB [MS], breathe RRGGBB [MS],\n"
+		"                        fade RRGGBB RRGGBB [MS], keys MS:RRGGBB,... [loop]\n"
+		"  --kbd-leds            print the keyboard LED colors, values and modes as JSON\n"
+		"  --kbd-color [I=]RRGGBB\n"
+		"                        color of keyboard LED index I, all LEDs without I\n"
+		"  --kbd-value [I=]N     brightness of LED index I, all LEDs without I\n"
+		"  --kbd-mode [L=]MODE[:SPEED]\n"
+		"                        lighting mode of layer L, default 0; the --kbd-*\n"
+		"                        changes go out as one batch of only what changed\n"
+		"  --kbd-save            make the keyboard lighting survive a reboot\n"
+		"  --ec-console[=FILE]   follow the EC debug console until interrupted,\n"
+		"                        appending to FILE instead of stdout\n"
+		"  --ec-stats[=N]        per EC command counters and latencies of this run,\n"
+		"                        on their own after N probe commands, default 100\n"
+		"  -h, --help            this help\n",
+		prg, EC_FLASH_SIZE);
+
+	fprintf(stderr, "settings:\n");
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (settings[i].type == SETTING_INT)
+			fprintf(stderr, "  %-22s %d..%d%s\n", settings[i].key, settings[i].min, settings[i].max,
+				(settings[i].flags & SETTING_RO) ? ", read-only" : "");
+		else
+			fprintf(stderr, "  %-22s string%s\n", settings[i].key,
+				(settings[i].flags & SETTING_RO) ? ", read-only" : "");
+	}
+}
+
+static double cli_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cli_flash_progress(unsigned int done, unsigned int total, void *user)
+{
+	double start = *(double *)user;
+	double t = cli_now() - start;
+	double rate = (t > 0) ? done / t : 0;
+
+	fprintf(stderr, "\r%3u%% %7u/%u bytes %8.1f KiB/s ETA %5.1fs",
+		(unsigned int)((uint64_t)done * 100 / total), done, total, rate / 1024.,
+		(rate > 0) ? (total - done) / rate : 0.);
+	if (done == total)
+		fprintf(stderr, "\n");
+}
+
+static int cli_dump_ec_flash(cli_opts_t *opts)
+{
+	uint32_t crc = 0;
+	double start;
+	int fd, out_fd;
+	int flags;
+	int res;
+
+	if (strcmp(opts->dump_file, "-") == 0)
+		out_fd = STDOUT_FILENO;
+	else
+		out_fd = open(opts->dump_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out_fd < 0) {
+		perror(opts->dump_file);
+		return -errno;
+	}
+
+	fd = port_open();
+	if (fd < 0) {
+		if (out_fd != STDOUT_FILENO)
+			close(out_fd);
+		return fd;
+	}
+
+	flags = CMD_SPI_FLAG_SCRATCH;
+	if (opts->backup)
+		flags |= CMD_SPI_FLAG_BACKUP;
+
+	start = cli_now();
+	res = ec_flash_dump(fd, flags, opts->flash_size, out_fd, &crc, cli_flash_progress, &start);
+	if (res < 0)
+		fprintf(stderr, "\ndump failed: %s\n", strerror(-res));
+	else
+		fprintf(stderr, "%u bytes in %.2fs, crc32 %08x\n",
+			opts->flash_size, cli_now() - start, crc);
+
+	port_close(fd);
+	if (out_fd != STDOUT_FILENO && close(out_fd) < 0 && res == 0)
+		res = -errno;
+
+	return res;
+}
+
+static int cli_read_image(const char *file, unsigned char *buf, unsigned int size)
+{
+	unsigned int len = 0;
+	char extra;
+	int fd, res;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(file);
+		return -errno;
+	}
+	while (len < size) {
+		res = read(fd, buf + len, size - len);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			break;
+		len += res;
+	}
+	res = (len == size) ? read(fd, &extra, 1) : 0;
+	close(fd);
+
+	if (len != size || res != 0) {
+		fprintf(stderr, "%s: image must be exactly %u bytes\n", file, size);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int cli_flash_ec(cli_opts_t *opts)
+{
+	ec_flash_stats_t stats;
+	unsigned char *image;
+	double start;
+	int fd, flags;
+	int res;
+
+	image = malloc(opts->flash_size);
+	if (image == NULL)
+		return -ENOMEM;
+	res = cli_read_image(opts->flash_file, image, opts->flash_size);
+	if (res < 0) {
+		free(image);
+		return res;
+	}
+
+	fd = port_open();
+	if (fd < 0) {
+		free(image);
+		return fd;
+	}
+
+	flags = CMD_SPI_FLAG_SCRATCH;
+	if (opts->backup)
+		flags |= CMD_SPI_FLAG_BACKUP;
+
+	start = cli_now();
+	res = ec_flash_update(fd, flags, image, opts->flash_size, opts->dry_run, &stats,
+		cli_flash_progress, &start);
+	if (res < 0)
+		fprintf(stderr, "\nflash failed: %s\n", strerror(-res));
+	fprintf(stderr, "%u/%u sectors of %d bytes changed%s, %.2fs\n",
+		stats.changed, stats.sectors, ec_flash_sector_size(flags),
+		opts->dry_run ? " (dry run)" : "", cli_now() - start);
+	if (stats.retried)
+		fprintf(stderr, "%u sector writes retried, %u read backs did not match\n",
+			stats.retried, stats.verify_failed);
+	if (stats.failed_addr >= 0)
+		fprintf(stderr, "sector at 0x%05x failed, do not power off, retry flashing\n",
+			stats.failed_addr);
+	else if (res == 0 && stats.changed && !opts->dry_run && !opts->backup)
+		fprintf(stderr, "power off the machine to start the new EC firmware\n");
+
+	port_close(fd);
+	free(image);
+
+	return res;
+}
+
+static void cli_json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+static int cli_get(cli_opts_t *opts)
+{
+	char buf[128];
+	int i, id, val;
+
+	for (i = 0; i < opts->n_keys; i++) {
+		if (settings_find(opts->keys[i]) < 0) {
+			fprintf(stderr, "%s: unknown setting\n", opts->keys[i]);
+			return -ENOENT;
+		}
+	}
+
+	// one batch for everything
+	settings_refresh();
+
+	printf("{");
+	for (i = 0; i < ((opts->n_keys > 0) ? opts->n_keys : SETTING_NUM); i++) {
+		id = (opts->n_keys > 0) ? settings_find(opts->keys[i]) : i;
+		printf("%s\n  ", i ? "," : "");
+		cli_json_string(settings[id].key);
+		printf(": ");
+		if (settings[id].type == SETTING_INT) {
+			val = settings_int(id);
+			if (val < 0)
+				printf("null");
+			else
+				printf("%d", val);
+		} else {
+			if (settings_read_string(id, buf, sizeof(buf)) < 0)
+				printf("null");
+			else
+				cli_json_string(buf);
+		}
+	}
+	printf("\n}\n");
+
+	return 0;
+}
+
+// check everything first so a typo does not leave a half applied set
+static int cli_set(cli_opts_t *opts)
+{
+	char key[64];
+	const char *value;
+	const char *values[CLI_MAX_ARGS];
+	int ids[CLI_MAX_ARGS];
+	int i, len, res, failed;
+
+	for (i = 0; i < opts->n_set; i++) {
+		value = strchr(opts->set[i], '=');
+		len = (value != NULL) ? value - opts->set[i] : 0;
+		if (len == 0 || len >= (int)sizeof(key)) {
+			fprintf(stderr, "%s: expected key=value\n", opts->set[i]);
+			return -EINVAL;
+		}
+		memcpy(key, opts->set[i], len);
+		key[len] = 0;
+		value++;
+
+		ids[i] = settings_find(key);
+		if (ids[i] < 0) {
+			fprintf(stderr, "%s: unknown setting\n", key);
+			return -ENOENT;
+		}
+		res = settings_check(ids[i], value);
+		if (res < 0) {
+			fprintf(stderr, "%s=%s: %s\n", key, value, strerror(-res));
+			return res;
+		}
+		values[i] = value;
+	}
+
+	res = settings_apply(opts->n_set, ids, values, &failed);
+	if (res < 0)
+		fprintf(stderr, "%s: %s, nothing changed\n", (failed >= 0) ? opts->set[failed] : "set",
+			strerror(-res));
+
+	return res;
+}
+
+static int cli_profile(cli_opts_t *opts)
+{
+	static profile_list_t list;
+	profile_t *p;
+	int res, failed;
+
+	profile_load_default(&list);
+	p = profile_find(&list, opts->profile);
+	if (p == NULL) {
+		fprintf(stderr, "%s: no such profile\n", opts->profile);
+		return -ENOENT;
+	}
+
+	res = profile_apply(p, &failed);
+	if (res < 0)
+		fprintf(stderr, "%s: %s=%s: %s, nothing changed\n", p->name,
+			(failed >= 0) ? settings[p->ids[failed]].key : "?",
+			(failed >= 0) ? p->values[failed] : "?", strerror(-res));
+
+	return res;
+}
+
+static int cli_profiles(cli_opts_t *opts)
+{
+	static profile_list_t list;
+	int i, j;
+
+	profile_load_default(&list);
+	for (i = 0; i < list.n; i++) {
+		printf("%s:", list.p[i].name);
+		for (j = 0; j < list.p[i].n; j++)
+			printf(" %s=%s", settings[list.p[i].ids[j]].key, list.p[i].values[j]);
+		printf("\n");
+	}
+
+	return 0;
+}
+
+static void cli_json_ll(const char *key, long long val)
+{
+	printf(", \"%s\": ", key);
+	if (val < 0)
+		printf("null");
+	else
+		printf("%lld", val);
+}
+
+static int cli_powercap(cli_opts_t *opts)
+{
+	static powercap_t pc;
+	powercap_zone_t *zone;
+	powercap_constraint_t *c;
+	int i, j, res;
+
+	res = powercap_scan(&pc);
+	if (res < 0) {
+		fprintf(stderr, "%s: %s\n", POWERCAP_CLASS_PATH, strerror(-res));
+		return res;
+	}
+
+	printf("[");
+	for (i = 0; i < pc.n_zones; i++) {
+		zone = &pc.zones[i];
+		powercap_zone_refresh(zone);
+		printf("%s\n  { \"zone\": ", i ? "," : "");
+		cli_json_string(zone->id);
+		printf(", \"name\": ");
+		cli_json_string(zone->name);
+		printf(", \"constraints\": [");
+		for (j = 0; j < zone->n_constraints; j++) {
+			c = &zone->c[j];
+			printf("%s\n    { \"name\": ", j ? "," : "");
+			cli_json_string(c->name);
+			cli_json_ll("power_limit_uw", powercap_value(c, POWERCAP_LIMIT));
+			cli_json_ll("time_window_us", powercap_value(c, POWERCAP_WINDOW));
+			cli_json_ll("min_power_uw", c->min_power);
+			cli_json_ll("max_power_uw", c->max_power);
+			cli_json_ll("min_time_window_us", c->min_window);
+			cli_json_ll("max_time_window_us", c->max_window);
+			printf(" }");
+		}
+		printf(" ] }");
+	}
+	printf("\n]\n");
+	powercap_close(&pc);
+
+	return 0;
+}
+
+static volatile sig_atomic_t cli_stop;
+
+static void cli_signal(int sig)
+{
+	cli_stop = 1;
+}
+
+// without a curve one readout, otherwise the same loop librem-controld runs
+static int cli_fan(cli_opts_t *opts)
+{
+	static fan_curve_t fc;
+	fan_curve_point_t p[FAN_CURVE_POINTS];
+	int fd, n = 0, res = 0;
+
+	if (opts->fan_curve != NULL) {
+		n = fan_curve_parse(opts->fan_curve, p, FAN_CURVE_POINTS);
+		if (n < 0) {
+			fprintf(stderr, "%s: %s\n", opts->fan_curve, strerror(-n));
+			return n;
+		}
+	}
+
+	fd = port_open();
+	if (fd < 0)
+		return fd;
+	fan_curve_init(&fc);
+	fan_curve_set(&fc, p, n);
+
+	if (n == 0) {
+		res = fan_curve_step(&fc, fd);
+		if (res == 0) {
+			printf("{ \"fan\": %d", FAN_CURVE_FAN);
+			cli_json_ll("duty", fc.duty);
+			cli_json_ll("rpm", fc.fan_rpm);
+			cli_json_ll("temp", fc.have_temp ? (long long)(fc.temp_c + 0.5) : -1);
+			printf(" }\n");
+		}
+	} else {
+		signal(SIGINT, cli_signal);
+		signal(SIGTERM, cli_signal);
+		while (!cli_stop) {
+			res = fan_curve_step(&fc, fd);
+			if (res < 0)
+				break;
+			if (res > 0) {
+				printf("%.1f C -> %d %%\n", fc.temp_c, fc.target);
+				fflush(stdout);
+			}
+			usleep(FAN_CURVE_INTERVAL_MS * 1000);
+		}
+		if (res >= 0)
+			fprintf(stderr, "%lu steps, %lu writes, %lu overridden by the EC\n",
+				fc.steps, fc.writes, fc.overridden);
+	}
+	if (res < 0)
+		fprintf(stderr, "fan: %s\n", strerror(-res));
+
+	fan_curve_close(&fc);
+	port_close(fd);
+
+	return (res < 0) ? res : 0;
+}
+
+// for scripts without librem-controld, which plays patterns via LedPattern
+static int cli_led_pattern(cli_opts_t *opts)
+{
+	static led_anim_t la;
+	led_pattern_t p;
+	sigset_t set;
+	int sig, res;
+
+	res = led_pattern_parse(opts->led_pattern, &p);
+	if (res < 0) {
+		fprintf(stderr, "%s: %s\n", opts->led_pattern, strerror(-res));
+		return res;
+	}
+
+	// block before the thread starts, so it inherits the mask
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	res = led_anim_start(&la, settings[SETTING_LED_RED].attr.path,
+		settings[SETTING_LED_GREEN].attr.path, settings[SETTING_LED_BLUE].attr.path);
+	if (res < 0) {
+		fprintf(stderr, "notification LED: %s\n", strerror(-res));
+		return res;
+	}
+	led_anim_set(&la, &p);
+	sigwait(&set, &sig);
+	fprintf(stderr, "%lu wakeups, %lu writes\n", la.wakeups, la.writes);
+	led_anim_stop(&la);
+
+	return 0;
+}
+
+// "[index=]value", *index is EC_LED_ALL without one
+static int cli_kbd_parse(const char *arg, int *index, const char **value)
+{
+	const char *eq;
+	char *end;
+
+	eq = strchr(arg, '=');
+	*index = EC_LED_ALL;
+	*value = arg;
+	if (eq == NULL)
+		return 0;
+	*index = strtol(arg, &end, 10);
+	if (end != eq || end == arg || *index < 0 || *index >= KBD_LED_MAX)
+		return -EINVAL;
+	*value = eq + 1;
+
+	return 0;
+}
+
+static int cli_kbd_apply(const kbd_led_t *kl, kbd_led_state_t *want, int opt, const char *arg)
+{
+	unsigned char rgb[3];
+	const char *value;
+	char *end;
+	long v, speed = 0;
+	int index, res;
+
+	res = cli_kbd_parse(arg, &index, &value);
+	if (res < 0)
+		return res;
+	// a one zone keyboard only has index 0
+	if (index != EC_LED_ALL && index >= ((opt == OPT_KBD_MODE) ? kl->layers : kl->n))
+		return -ERANGE;
+
+	if (opt == OPT_KBD_COLOR) {
+		res = kbd_led_parse_color(value, rgb);
+		if (res < 0)
+			return res;
+		kbd_led_set_color(kl, want, index, rgb);
+		return 0;
+	}
+
+	v = strtol(value, &end, 10);
+	if (end == value || v < 0 || v > 255)
+		return -EINVAL;
+	if (opt == OPT_KBD_MODE && *end == ':') {
+		value = end + 1;
+		speed = strtol(value, &end, 10);
+		if (end == value || speed < 0 || speed > 255)
+			return -EINVAL;
+	}
+	if (*end != 0)
+		return -EINVAL;
+
+	if (opt == OPT_KBD_VALUE)
+		kbd_led_set_value(kl, want, index, v);
+	else
+		kbd_led_set_mode(kl, want, (index == EC_LED_ALL) ? 0 : index, v, speed);
+
+	return 0;
+}
+
+static void cli_kbd_print(const kbd_led_t *kl)
+{
+	int i;
+
+	printf("{ \"leds\": %d", kl->n);
+	cli_json_ll("zone", kl->zone);
+	cli_json_ll("layers", kl->layers);
+	cli_json_ll("value_max", kl->value_max);
+	printf(",\n  \"colors\": [");
+	for (i = 0; i < kl->n; i++)
+		printf("%s\"%02x%02x%02x\"", i ? (i % 8 ? ", " : ",\n    ") : "",
+			kl->have.color[i][0], kl->have.color[i][1], kl->have.color[i][2]);
+	printf(" ],\n  \"values\": [");
+	for (i = 0; i < kl->n; i++)
+		printf("%s%d", i ? (i % 16 ? ", " : ",\n    ") : "", kl->have.value[i]);
+	printf(" ],\n  \"modes\": [");
+	for (i = 0; i < kl->layers; i++)
+		printf("%s{ \"mode\": %d, \"speed\": %d }", i ? ", " : "",
+			kl->have.mode[i][0], kl->have.mode[i][1]);
+	printf(" ] }\n");
+}
+
+// every change given on the command line goes out in one flush
+static int cli_kbd(cli_opts_t *opts)
+{
+	static kbd_led_t kl;
+	static kbd_led_state_t want;
+	int fd, i, res;
+
+	fd = port_open();
+	if (fd < 0)
+		return fd;
+
+	res = kbd_led_load(&kl, fd);
+	if (res < 0) {
+		fprintf(stderr, "keyboard LEDs: %s\n", strerror(-res));
+		goto out;
+	}
+
+	want = kl.have;
+	for (i = 0; i < opts->n_kbd; i++) {
+		res = cli_kbd_apply(&kl, &want, opts->kbd_opt[i], opts->kbd_arg[i]);
+		if (res < 0) {
+			fprintf(stderr, "%s: %s\n", opts->kbd_arg[i], strerror(-res));
+			goto out;
+		}
+	}
+	if (opts->n_kbd > 0) {
+		i = kbd_led_changes(&kl, &want);
+		res = kbd_led_flush(&kl, fd, &want);
+		if (res < 0) {
+			fprintf(stderr, "keyboard LEDs: %s\n", strerror(-res));
+			goto out;
+		}
+		fprintf(stderr, "%d changes in %d commands (%d to all LEDs), %lld us\n",
+			i, kl.cmds, kl.broadcast, (long long)kl.flush_us);
+	}
+	if (opts->kbd_save) {
+		res = ec_led_save(fd);
+		if (res < 0) {
+			fprintf(stderr, "keyboard LEDs: saving failed: %s\n", strerror(-res));
+			goto out;
+		}
+	}
+	if (opts->kbd_leds)
+		cli_kbd_print(&kl);
+
+out:
+	port_close(fd);
+
+	return res;
+}
+
+// reads only the debug window, so it does not get in librem-controld's way
+static int cli_ec_console(cli_opts_t *opts)
+{
+	static ec_console_t ec;
+	char buf[EC_CONSOLE_RING];
+	FILE *out = stdout;
+	int fd, n = 0;
+
+	if (opts->ec_console_file != NULL) {
+		out = fopen(opts->ec_console_file, "a");
+		if (out == NULL) {
+			fprintf(stderr, "%s: %s\n", opts->ec_console_file, strerror(errno));
+			return -errno;
+		}
+	}
+	fd = port_open();
+	if (fd < 0) {
+		if (out != stdout)
+			fclose(out);
+		return fd;
+	}
+	signal(SIGINT, cli_signal);
+	signal(SIGTERM, cli_signal);
+
+	ec_console_init(&ec);
+	while (!cli_stop) {
+		n = ec_console_poll(&ec, fd, buf, sizeof(buf));
+		if (n < 0)
+			break;
+		if (n > 0) {
+			fwrite(buf, 1, n, out);
+			fflush(out);
+		}
+		usleep(ec.interval_ms * 1000);
+	}
+	port_close(fd);
+	if (out != stdout)
+		fclose(out);
+	if (n < 0) {
+		fprintf(stderr, "EC console: %s\n", strerror(-n));
+		return n;
+	}
+
+	fprintf(stderr, "%lu polls, %lu bytes, %lu polls may have lost output\n",
+		ec.polls, ec.bytes, ec.overruns);
+
+	return 0;
+}
+
+// with other options on stderr once they are done, even if they failed
+static int cli_ec_stats(cli_opts_t *opts, int alone)
+{
+	char buf[EC_STATS_TEXT_LEN];
+	unsigned char data[3];
+	int fd, i, n, res = 0;
+
+	n = opts->ec_stats_probes;
+	if (n < 0)
+		n = alone ? 100 : 0;
+	if (n > 0) {
+		fd = port_open();
+		if (fd < 0)
+			return fd;
+		for (i = 0; i < n && res == 0; i++) {
+			res = cmd_write(fd, CMD_PROBE);
+			if (res == 0 && cmd_result(fd) == RES_OK)
+				cmd_data_read(fd, sizeof(data), data);
+		}
+		port_close(fd);
+	}
+
+	ec_stats_format(buf, sizeof(buf));
+	fputs(buf, alone ? stdout : stderr);
+
+	return res;
+}
+
+// TSV on stdout, statistics on stderr so they do not mix with the events
+static int cli_matrix(cli_opts_t *opts)
+{
+	static key_matrix_t km;
+	key_event_t ev[64];
+	int64_t start, end;
+	int fd, i, r, c, n = 0;
+
+	fd = port_open();
+	if (fd < 0)
+		return fd;
+	key_matrix_init(&km);
+	signal(SIGINT, cli_signal);
+	signal(SIGTERM, cli_signal);
+
+	start = key_matrix_now_us();
+	end = start + (int64_t)opts->matrix * 1000000;
+	printf("# ms\trow\tcol\tevent\twindow_us\tflags\n");
+	while (!cli_stop && key_matrix_now_us() < end) {
+		n = key_matrix_scan(&km, fd, ev, 64, key_matrix_now_us() + KEY_MATRIX_BATCH_MS * 1000);
+		if (n < 0)
+			break;
+		for (i = 0; i < n; i++)
+			printf("%.3f\t%d\t%d\t%s\t%u\t%s%s\n", (ev[i].time_us - start) / 1000., ev[i].row, ev[i].col,
+				(ev[i].flags & KEY_EV_PRESS) ? "press" : "release", ev[i].window_us,
+				(ev[i].flags & KEY_EV_CHATTER) ? "chatter " : "",
+				(ev[i].flags & KEY_EV_GHOST) ? "ghost" : "");
+		fflush(stdout);
+	}
+	port_close(fd);
+	if (n < 0) {
+		fprintf(stderr, "matrix: %s\n", strerror(-n));
+		return n;
+	}
+
+	fprintf(stderr, "%dx%d matrix, %lu polls, %.0f polls/s, %lu errors\n"
+		"poll cost min %lld avg %.1f max %lld us, worst gap %lld us\n"
+		"%lu events, %lu dropped, %lu chatter, %lu with ghosting\n",
+		km.rows, km.cols, km.stats.polls, key_matrix_rate(&km), km.stats.errors,
+		(long long)km.stats.cost_min_us, km.stats.polls ? (double)km.stats.cost_sum_us / km.stats.polls : 0.,
+		(long long)km.stats.cost_max_us, (long long)km.stats.window_max_us,
+		km.stats.events, km.stats.dropped, km.stats.chatter, km.stats.ghosts);
+	for (r = 0; r < km.rows; r++) {
+		for (c = 0; c < km.cols; c++) {
+			if (km.chatter[r][c] > 0)
+				fprintf(stderr, "key %d/%d chattered %u times\n", r, c, km.chatter[r][c]);
+		}
+	}
+
+	return 0;
+}
+
+static int cli_powercap_parse(powercap_t *pc, const char *arg, powercap_zone_t **zone, powercap_change_t *ch)
+{
+	char buf[128];
+	char *constraint, *field, *value;
+
+	if (strlen(arg) >= sizeof(buf))
+		return -EINVAL;
+	strcpy(buf, arg);
+	constraint = strchr(buf, '/');
+	field = (constraint != NULL) ? strchr(constraint + 1, '/') : NULL;
+	value = (field != NULL) ? strchr(field + 1, '=') : NULL;
+	if (value == NULL)
+		return -EINVAL;
+	*constraint++ = 0;
+	*field++ = 0;
+	*value++ = 0;
+
+	*zone = powercap_zone_find(pc, buf);
+	if (*zone == NULL)
+		return -ENOENT;
+	ch->constraint = powercap_constraint_find(*zone, constraint);
+	if (ch->constraint < 0)
+		return -ENOENT;
+	if (strcmp(field, "power_limit_uw") == 0)
+		ch->field = POWERCAP_LIMIT;
+	else if (strcmp(field, "time_window_us") == 0)
+		ch->field = POWERCAP_WINDOW;
+	else
+		return -EINVAL;
+	ch->value = strtoll(value, &field, 0);
+	if (*value == 0 || *field != 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+// grouped by zone, each zone is applied as one all or nothing batch
+static int cli_powercap_set(cli_opts_t *opts)
+{
+	static powercap_t pc;
+	powercap_zone_t *zones[CLI_MAX_ARGS];
+	powercap_change_t changes[CLI_MAX_ARGS];
+	powercap_change_t batch[CLI_MAX_ARGS];
+	int i, j, n, res;
+
+	res = powercap_scan(&pc);
+	if (res < 0) {
+		fprintf(stderr, "%s: %s\n", POWERCAP_CLASS_PATH, strerror(-res));
+		return res;
+	}
+
+	for (i = 0; i < opts->n_powercap_set; i++) {
+		res = cli_powercap_parse(&pc, opts->powercap_set[i], &zones[i], &changes[i]);
+		if (res < 0) {
+			fprintf(stderr, "%s: %s\n", opts->powercap_set[i],
+				(res == -EINVAL) ? "expected zone/constraint/field=value" : strerror(-res));
+			goto out;
+		}
+	}
+
+	for (i = 0; i < opts->n_powercap_set; i++) {
+		if (zones[i] == NULL)
+			continue;
+		n = 0;
+		for (j = i; j < opts->n_powercap_set; j++) {
+			if (zones[j] != zones[i])
+				continue;
+			batch[n++] = changes[j];
+			if (j > i)
+				zones[j] = NULL;
+		}
+		res = powercap_zone_apply(zones[i], n, batch);
+		if (res < 0) {
+			fprintf(stderr, "%s: %s, zone left unchanged\n", zones[i]->id, strerror(-res));
+			goto out;
+		}
+	}
+
+out:
+	powercap_close(&pc);
+	return res;
+}
+
+// the daemon's log if there is one, else what the GUI recorded for this user
+static int cli_bat_log_open(cli_opts_t *opts, bat_log_t *log)
+{
+	const char *dir;
+	char path[PATH_MAX];
+	int res;
+
+	if (opts->bat_log_file != NULL)
+		return bat_log_open(log, opts->bat_log_file, 0);
+
+	res = bat_log_open(log, BAT_LOG_SYSTEM_PATH, 0);
+	if (res == 0)
+		return 0;
+
+	dir = getenv("XDG_STATE_HOME");
+	if (dir != NULL && dir[0] == '/')
+		snprintf(path, sizeof(path), "%s/%s", dir, BAT_LOG_USER_FILE);
+	else if (getenv("HOME") != NULL)
+		snprintf(path, sizeof(path), "%s/.local/state/%s", getenv("HOME"), BAT_LOG_USER_FILE);
+	else
+		return res;
+
+	return bat_log_open(log, path, 0);
+}
+
+static int cli_bat_log(cli_opts_t *opts)
+{
+	bat_log_t log;
+	bat_log_rec_t rec;
+	uint64_t n, head;
+	int res;
+
+	res = cli_bat_log_open(opts, &log);
+	if (res < 0) {
+		fprintf(stderr, "battery log: %s\n", strerror(-res));
+		return res;
+	}
+
+	printf("# time\tcapacity\tstatus\tenergy_wh\tpower_w\tvoltage_v\tstart\tend\n");
+	head = bat_log_head(&log);
+	for (n = bat_log_tail(&log); n < head; n++) {
+		// skips what the writer overwrote meanwhile or never finished
+		if (bat_log_get(&log, n, &rec) < 0)
+			continue;
+		printf("%u\t%u\t%s\t%.2f\t%.2f\t%.3f\t%u\t%u\n",
+			rec.time, rec.capacity, bat_log_status_name(rec.status),
+			rec.energy / 100., rec.power / 100., rec.voltage / 1000.,
+			rec.start_thres, rec.end_thres);
+	}
+	bat_log_close(&log);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	cli_opts_t opts;
+	int opt;
+	int res = 0;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.flash_size = EC_FLASH_SIZE;
+
+	while ((opt = getopt_long(argc, argv, "h", cli_options, NULL)) != -1) {
+		switch (opt) {
+			case OPT_DUMP_EC_FLASH:
+				opts.dump_file = optarg;
+				break;
+			case OPT_FLASH_EC:
+				opts.flash_file = optarg;
+				break;
+			case OPT_BACKUP:
+				opts.backup = 1;
+				break;
+			case OPT_DRY_RUN:
+				opts.dry_run = 1;
+				break;
+			case OPT_FLASH_SIZE:
+				opts.flash_size = strtoul(optarg, NULL, 0);
+				break;
+			case OPT_GET:
+				opts.get = 1;
+				break;
+			case OPT_BAT_LOG:
+				opts.bat_log = 1;
+				opts.bat_log_file = optarg;
+				break;
+			case OPT_PROFILE:
+				opts.profile = optarg;
+				break;
+			case OPT_PROFILES:
+				opts.profiles = 1;
+				break;
+			case OPT_POWERCAP:
+				opts.powercap = 1;
+				break;
+			case OPT_POWERCAP_SET:
+				if (opts.n_powercap_set >= CLI_MAX_ARGS) {
+					fprintf(stderr, "too many powercap changes\n");
+					return 1;
+				}
+				opts.powercap_set[opts.n_powercap_set++] = optarg;
+				break;
+			case OPT_FAN:
+				opts.fan = 1;
+				break;
+			case OPT_FAN_CURVE:
+				opts.fan_curve = optarg;
+				break;
+			case OPT_MATRIX:
+				opts.matrix = (optarg != NULL) ? atoi(optarg) : 10;
+				if (opts.matrix <= 0) {
+					fprintf(stderr, "--matrix needs a positive number of seconds\n");
+					return 1;
+				}
+				break;
+			case OPT_LED_PATTERN:
+				opts.led_pattern = optarg;
+				break;
+			case OPT_KBD_LEDS:
+				opts.kbd_leds = 1;
+				break;
+			case OPT_KBD_COLOR:
+			case OPT_KBD_VALUE:
+			case OPT_KBD_MODE:
+				if (opts.n_kbd >= CLI_MAX_ARGS) {
+					fprintf(stderr, "too many keyboard LED changes\n");
+					return 1;
+				}
+				opts.kbd_opt[opts.n_kbd] = opt;
+				opts.kbd_arg[opts.n_kbd++] = optarg;
+				break;
+			case OPT_KBD_SAVE:
+				opts.kbd_save = 1;
+				break;
+			case OPT_EC_STATS:
+				opts.ec_stats = 1;
+				opts.ec_stats_probes = (optarg != NULL) ? atoi(optarg) : -1;
+				break;
+			case OPT_EC_CONSOLE:
+				opts.ec_console = 1;
+				opts.ec_console_file = optarg;
+				break;
+			case OPT_SET:
+				if (opts.n_set >= CLI_MAX_ARGS) {
+					fprintf(stderr, "too many settings\n");
+					return 1;
+				}
+				opts.set[opts.n_set++] = optarg;
+				break;
+			case 'h':
+			default:
+				cli_usage(argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	// "--set a=1 b=2" and "--get a b"
+	for (; optind < argc; optind++) {
+		if (opts.n_set >= CLI_MAX_ARGS || opts.n_keys >= CLI_MAX_ARGS) {
+			fprintf(stderr, "too many settings\n");
+			return 1;
+		}
+		if (strchr(argv[optind], '=') != NULL)
+			opts.set[opts.n_set++] = argv[optind];
+		else if (opts.get)
+			opts.keys[opts.n_keys++] = argv[optind];
+		else {
+			cli_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (opts.dump_file == NULL && opts.flash_file == NULL && !opts.get && opts.n_set == 0 &&
+	    !opts.bat_log && !opts.powercap && opts.n_powercap_set == 0 && opts.profile == NULL &&
+	    !opts.profiles && !opts.fan && opts.fan_curve == NULL &&
+	    !opts.matrix && opts.led_pattern == NULL &&
+	    !opts.kbd_leds && opts.n_kbd == 0 && !opts.kbd_save && !opts.ec_console) {
+		if (opts.ec_stats)
+			return (cli_ec_stats(&opts, 1) < 0) ? 1 : 0;
+		cli_usage(argv[0]);
+		return 1;
+	}
+
+	if (opts.profiles)
+		res = cli_profiles(&opts);
+	if (opts.profile != NULL && res == 0)
+		res = cli_profile(&opts);
+	if (opts.n_set > 0 && res == 0)
+		res = cli_set(&opts);
+	if (opts.get && res == 0)
+		res = cli_get(&opts);
+	if (opts.n_powercap_set > 0 && res == 0)
+		res = cli_powercap_set(&opts);
+	if (opts.powercap && res == 0)
+		res = cli_powercap(&opts);
+	if (opts.bat_log && res == 0)
+		res = cli_bat_log(&opts);
+	if ((opts.fan || opts.fan_curve != NULL) && res == 0)
+		res = cli_fan(&opts);
+	if (opts.matrix && res == 0)
+		res = cli_matrix(&opts);
+	if (opts.led_pattern != NULL && res == 0)
+		res = cli_led_pattern(&opts);
+	if ((opts.kbd_leds || opts.n_kbd > 0 || opts.kbd_save) && res == 0)
+		res = cli_kbd(&opts);
+	if (opts.ec_console && res == 0)
+		res = cli_ec_console(&opts);
+	if (opts.dump_file && res == 0)
+		res = cli_dump_ec_flash(&opts);
+	if (opts.flash_file && res == 0)
+		res = cli_flash_ec(&opts);
+	if (opts.ec_stats)
+		cli_ec_stats(&opts, 0);
+
+	return (res < 0) ? 1 : 0;
+}
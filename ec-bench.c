@@ -0,0 +1,129 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Compare EC port backends on the same command sequence:
+ *   window  - plain reads of the full SMFI data window
+ *   version - CMD_VERSION plus reading back the data window
+ *   matrix  - CMD_MATRIX_GET polls as the key matrix scanner does them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "ec-tool.h"
+#include "key-matrix.h"
+
+#define EC_BENCH_DATA_LEN	(SMFI_CMD_SIZE - SMFI_CMD_DATA)
+
+static const char *ec_bench_backends[] = { "devport", "ioport", "sim", NULL };
+
+
+static double ec_bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ec_bench_report(const char *backend, const char *test, int n, double bytes, double t)
+{
+	printf("%-8s %-8s %8d %12.0f %10.4f %12.0f %10.0f\n",
+		backend, test, n, bytes, t, bytes / t, n / t);
+}
+
+static void ec_bench_backend(const char *backend, int n)
+{
+	unsigned char buf[EC_BENCH_DATA_LEN];
+	key_matrix_t km;
+	double start, t;
+	int fd, i;
+
+	port_set_backend(backend);
+	fd = port_open();
+	if (fd < 0) {
+		printf("%-8s not available, skipped\n", backend);
+		return;
+	}
+
+	start = ec_bench_now();
+	for (i = 0; i < n; i++) {
+		if (cmd_data_read(fd, EC_BENCH_DATA_LEN, buf) != EC_BENCH_DATA_LEN)
+			break;
+	}
+	t = ec_bench_now() - start;
+	ec_bench_report(backend, "window", i, (double)i * EC_BENCH_DATA_LEN, t);
+
+	start = ec_bench_now();
+	for (i = 0; i < n; i++) {
+		if (cmd_write(fd, CMD_VERSION) < 0)
+			break;
+		if (cmd_data_read(fd, EC_BENCH_DATA_LEN, buf) != EC_BENCH_DATA_LEN)
+			break;
+	}
+	t = ec_bench_now() - start;
+	ec_bench_report(backend, "version", i, (double)i * (1 + EC_BENCH_DATA_LEN), t);
+
+	key_matrix_init(&km);
+	start = ec_bench_now();
+	for (i = 0; i < n; i++) {
+		if (key_matrix_poll(&km, fd, NULL, 0) < 0)
+			break;
+	}
+	t = ec_bench_now() - start;
+	ec_bench_report(backend, "matrix", i, (double)i * (2 + km.rows * km.row_bytes), t);
+
+	port_close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	int n = 1000;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:b:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				n = atoi(optarg);
+				break;
+			case 'b':
+				only = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-b devport|ioport|sim]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	printf("%-8s %-8s %8s %12s %10s %12s %10s\n",
+		"backend", "test", "iter", "bytes", "seconds", "bytes/s", "iter/s");
+	for (i = 0; ec_bench_backends[i] != NULL; i++) {
+		if (only != NULL && strcmp(only, ec_bench_backends[i]) != 0)
+			continue;
+		ec_bench_backend(ec_bench_backends[i], n);
+	}
+
+	return 0;
+}
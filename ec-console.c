@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Tail of the EC's debug console. The firmware appends its output to a
+ * ring in the SMFI debug window and keeps the position of the last byte
+ * in the window's first byte. A poll reads that one byte and, only if it
+ * moved, the bytes written since the last poll, at most two reads when
+ * the ring wrapped. There is no read pointer the EC could wait on, so a
+ * burst of more than a ring's worth between two polls is lost; polling
+ * speeds up as soon as there is output and slows down while there is
+ * none.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ec-console.h"
+
+// a poll that found more than this much new output probably missed some
+#define EC_CONSOLE_LAPPED		(EC_CONSOLE_RING * 3 / 4)
+
+
+void ec_console_init(ec_console_t *ec)
+{
+	memset(ec, 0, sizeof(*ec));
+	ec->head = -1;
+	ec->interval_ms = EC_CONSOLE_POLL_MIN_MS;
+}
+
+// ring bytes from, to inclusive, 1 <= from <= to <= EC_CONSOLE_RING
+static int ec_console_read(int fd, int from, int to, char *buf)
+{
+	int n = to - from + 1;
+
+	if (port_read(fd, SMFI_DBG_BASE + from, n, buf) != n)
+		return -EIO;
+
+	return n;
+}
+
+/*
+ * Copies new output to buf, which must hold EC_CONSOLE_RING bytes, and
+ * returns its length. The first poll returns what is still in the ring,
+ * oldest first.
+ */
+int ec_console_poll(ec_console_t *ec, int fd, char *buf, int len)
+{
+	unsigned char tail;
+	char ring[EC_CONSOLE_RING];
+	int i, n = 0, res;
+
+	if (len < EC_CONSOLE_RING)
+		return -ENOBUFS;
+	// every byte value is a valid position, 0 before the first output
+	if (port_read(fd, SMFI_DBG_BASE, 1, &tail) != 1)
+		return -EIO;
+	ec->polls++;
+
+	if (ec->head < 0) {
+		// the part of the ring that was never written is zeroed
+		res = ec_console_read(fd, 1, EC_CONSOLE_RING, ring);
+		if (res < 0)
+			return res;
+		for (i = tail; i < EC_CONSOLE_RING; i++) {
+			if (ring[i] != 0)
+				buf[n++] = ring[i];
+		}
+		for (i = 0; i < tail; i++) {
+			if (ring[i] != 0)
+				buf[n++] = ring[i];
+		}
+	} else if (tail > ec->head) {
+		n = ec_console_read(fd, ec->head + 1, tail, buf);
+	} else if (tail < ec->head) {
+		n = 0;
+		if (ec->head < EC_CONSOLE_RING)
+			n = ec_console_read(fd, ec->head + 1, EC_CONSOLE_RING, buf);
+		if (n >= 0 && tail > 0) {
+			res = ec_console_read(fd, 1, tail, buf + n);
+			n = (res < 0) ? res : n + res;
+		}
+	}
+	if (n < 0)
+		return n;
+
+	if (ec->head >= 0 && n > EC_CONSOLE_LAPPED)
+		ec->overruns++;
+	ec->head = tail;
+	ec->bytes += n;
+	if (n > 0)
+		ec->interval_ms = EC_CONSOLE_POLL_MIN_MS;
+	else if (ec->interval_ms * 2 < EC_CONSOLE_POLL_MAX_MS)
+		ec->interval_ms *= 2;
+	else
+		ec->interval_ms = EC_CONSOLE_POLL_MAX_MS;
+
+	return n;
+}
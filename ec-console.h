@@ -0,0 +1,43 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_CONSOLE_H
+#define _EC_CONSOLE_H
+
+#include "ec-tool.h"
+
+// bytes 1..0xff of the debug window, byte 0 is where the EC wrote last
+#define EC_CONSOLE_RING			(SMFI_DBG_SIZE - 1)
+// poll interval right after output, doubled on every quiet poll up to the max
+#define EC_CONSOLE_POLL_MIN_MS	10
+#define EC_CONSOLE_POLL_MAX_MS	1000
+
+typedef struct {
+	int head;				// last ring byte copied, -1 before the first poll
+	int interval_ms;		// until the next poll
+	unsigned long polls;
+	unsigned long bytes;
+	unsigned long overruns;	// polls that found the ring (nearly) lapped
+} ec_console_t;
+
+void ec_console_init(ec_console_t *ec);
+
+int ec_console_poll(ec_console_t *ec, int fd, char *buf, int len);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * EC SPI flash access on top of CMD_SPI.
+ *
+ * A dump is one single fast read (0x0B) transaction streamed through
+ * the SMFI window in EC_SPI_CHUNK sized transfers. Reading from the EC
+ * and writing to the output file overlap: the EC side fills a small
+ * ring of blocks while a writer thread checksums and writes them out.
+ *
+ * An update reads the current image, compares it sector by sector with
+ * the new one and only touches sectors that differ. Every changed sector
+ * is erased before it is programmed, a second program of an already
+ * programmed word is not specified for the IT5570 e-flash. Changed
+ * sectors are verified by a streamed CRC32 of their read back contents.
+ * A sector that fails is written again, up to EC_FLASH_RETRIES times,
+ * before the update stops at it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "ec-tool.h"
+#include "ec-flash.h"
+
+#define SPI_FAST_READ		0x0B
+#define SPI_READ_STATUS		0x05
+#define SPI_WRITE_ENABLE	0x06
+#define SPI_WRITE_DISABLE	0x04
+#define SPI_PAGE_PROGRAM	0x02
+#define SPI_AAI_PROGRAM		0xAD	// word auto address increment
+#define SPI_ERASE_1K		0xD7	// IT5570 e-flash sector erase
+#define SPI_ERASE_4K		0x20
+
+#define SPI_STATUS_BUSY		(1 << 0)
+#define SPI_STATUS_WEL		(1 << 1)
+
+#define SPI_PAGE_SIZE		256
+#define SPI_STATUS_TIMEOUT	5000	// status polls before giving up
+
+// blocks in flight between EC reader and file writer
+#define EC_FLASH_NBUF		4
+// pipeline unit, whole SPI chunks so every transfer fills the window
+#define EC_FLASH_PIPE_BLOCK	(16 * EC_SPI_CHUNK)
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char buf[EC_FLASH_NBUF][EC_FLASH_PIPE_BLOCK];
+	unsigned int len[EC_FLASH_NBUF];
+	unsigned int head;		// blocks filled from the EC
+	unsigned int tail;		// blocks written out
+	int eof;
+	int err;
+	int out_fd;
+	uint32_t crc;
+} ec_flash_pipe_t;
+
+static uint32_t crc32_table[256];
+
+
+uint32_t ec_flash_crc32(uint32_t crc, const void *data, unsigned int len)
+{
+	const unsigned char *p = data;
+	uint32_t c;
+	int i, j;
+
+	if (crc32_table[1] == 0) {
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			crc32_table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (len--)
+		crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static int ec_flash_read_start(int fd, int flags, unsigned int addr)
+{
+	unsigned char cmd[5] = { SPI_FAST_READ, addr >> 16, addr >> 8, addr, 0 };
+	int res;
+
+	res = spi_reset(fd, flags);
+	if (res < 0)
+		return res;
+
+	return spi_write(fd, flags, cmd, sizeof(cmd));
+}
+
+int ec_flash_read(int fd, int flags, unsigned int addr, void *buf, unsigned int len)
+{
+	int res;
+
+	res = ec_flash_read_start(fd, flags, addr);
+	if (res == 0)
+		res = spi_read(fd, flags, buf, len);
+	spi_reset(fd, flags);
+
+	return res;
+}
+
+static void *ec_flash_writer(void *data)
+{
+	ec_flash_pipe_t *pipe = (ec_flash_pipe_t *)data;
+	unsigned char *p;
+	unsigned int slot;
+	int len, res;
+
+	pthread_mutex_lock(&pipe->lock);
+	while (1) {
+		while (pipe->tail == pipe->head && !pipe->eof)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		if (pipe->tail == pipe->head)
+			break;
+		slot = pipe->tail % EC_FLASH_NBUF;
+		pthread_mutex_unlock(&pipe->lock);
+
+		p = pipe->buf[slot];
+		len = pipe->len[slot];
+		pipe->crc = ec_flash_crc32(pipe->crc, p, len);
+		while (len > 0 && !pipe->err) {
+			res = write(pipe->out_fd, p, len);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				pipe->err = errno;
+				break;
+			}
+			p += res;
+			len -= res;
+		}
+
+		pthread_mutex_lock(&pipe->lock);
+		pipe->tail++;
+		pthread_cond_signal(&pipe->cond);
+		if (pipe->err)
+			break;
+	}
+	pthread_mutex_unlock(&pipe->lock);
+
+	return NULL;
+}
+
+int ec_flash_sector_size(int flags)
+{
+	return (flags & CMD_SPI_FLAG_BACKUP) ? EC_FLASH_SECTOR_BACKUP : EC_FLASH_SECTOR_MAIN;
+}
+
+// wait until (status & mask) == value
+static int ec_flash_status_wait(int fd, int flags, unsigned char mask, unsigned char value)
+{
+	unsigned char cmd = SPI_READ_STATUS;
+	unsigned char status;
+	int res, i;
+
+	for (i = 0; i < SPI_STATUS_TIMEOUT; i++) {
+		res = spi_reset(fd, flags);
+		if (res == 0)
+			res = spi_write(fd, flags, &cmd, 1);
+		if (res == 0)
+			res = spi_read(fd, flags, &status, 1);
+		if (res < 0)
+			return res;
+		if ((status & mask) == value)
+			return 0;
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int ec_flash_simple_cmd(int fd, int flags, unsigned char *cmd, int len)
+{
+	int res;
+
+	res = spi_reset(fd, flags);
+	if (res == 0)
+		res = spi_write(fd, flags, cmd, len);
+	if (res == 0)
+		res = spi_reset(fd, flags);
+
+	return res;
+}
+
+static int ec_flash_write_enable(int fd, int flags)
+{
+	unsigned char cmd = SPI_WRITE_ENABLE;
+	int res;
+
+	res = ec_flash_simple_cmd(fd, flags, &cmd, 1);
+	if (res < 0)
+		return res;
+
+	return ec_flash_status_wait(fd, flags, SPI_STATUS_BUSY | SPI_STATUS_WEL, SPI_STATUS_WEL);
+}
+
+static int ec_flash_write_disable(int fd, int flags)
+{
+	unsigned char cmd = SPI_WRITE_DISABLE;
+	int res;
+
+	res = ec_flash_simple_cmd(fd, flags, &cmd, 1);
+	if (res < 0)
+		return res;
+
+	return ec_flash_status_wait(fd, flags, SPI_STATUS_BUSY | SPI_STATUS_WEL, 0);
+}
+
+static int ec_flash_erase_sector(int fd, int flags, unsigned int addr)
+{
+	unsigned char cmd[4] = { (flags & CMD_SPI_FLAG_BACKUP) ? SPI_ERASE_4K : SPI_ERASE_1K,
+		addr >> 16, addr >> 8, addr };
+	int res;
+
+	res = ec_flash_write_enable(fd, flags);
+	if (res == 0)
+		res = ec_flash_simple_cmd(fd, flags, cmd, sizeof(cmd));
+	if (res == 0)
+		res = ec_flash_status_wait(fd, flags, SPI_STATUS_BUSY, 0);
+
+	return res;
+}
+
+// the e-flash is programmed with AAI word writes, the address is only sent once
+static int ec_flash_program_aai(int fd, int flags, unsigned int addr, const unsigned char *data, unsigned int len)
+{
+	unsigned char cmd[6];
+	unsigned int i;
+	int res;
+
+	res = ec_flash_write_enable(fd, flags);
+	for (i = 0; res == 0 && i < len; i += 2) {
+		if (i == 0) {
+			cmd[0] = SPI_AAI_PROGRAM;
+			cmd[1] = addr >> 16;
+			cmd[2] = addr >> 8;
+			cmd[3] = addr;
+			cmd[4] = data[i];
+			cmd[5] = (i + 1 < len) ? data[i + 1] : 0xff;
+			res = ec_flash_simple_cmd(fd, flags, cmd, 6);
+		} else {
+			cmd[0] = SPI_AAI_PROGRAM;
+			cmd[1] = data[i];
+			cmd[2] = (i + 1 < len) ? data[i + 1] : 0xff;
+			res = ec_flash_simple_cmd(fd, flags, cmd, 3);
+		}
+		if (res == 0)
+			res = ec_flash_status_wait(fd, flags, SPI_STATUS_BUSY, 0);
+	}
+	if (ec_flash_write_disable(fd, flags) < 0 && res == 0)
+		res = -EIO;
+
+	return res;
+}
+
+static int ec_flash_program_pages(int fd, int flags, unsigned int addr, const unsigned char *data, unsigned int len)
+{
+	unsigned char cmd[4 + SPI_PAGE_SIZE];
+	unsigned int i, n;
+	int res = 0;
+
+	for (i = 0; res == 0 && i < len; i += n) {
+		n = SPI_PAGE_SIZE - ((addr + i) % SPI_PAGE_SIZE);
+		if (n > len - i)
+			n = len - i;
+		res = ec_flash_write_enable(fd, flags);
+		if (res < 0)
+			break;
+		cmd[0] = SPI_PAGE_PROGRAM;
+		cmd[1] = (addr + i) >> 16;
+		cmd[2] = (addr + i) >> 8;
+		cmd[3] = (addr + i);
+		memcpy(&cmd[4], &data[i], n);
+		res = ec_flash_simple_cmd(fd, flags, cmd, 4 + n);
+		if (res == 0)
+			res = ec_flash_status_wait(fd, flags, SPI_STATUS_BUSY, 0);
+	}
+
+	return res;
+}
+
+// skip erased (0xff) head and tail, they need no programming
+static int ec_flash_program(int fd, int flags, unsigned int addr, const unsigned char *data, unsigned int len)
+{
+	while (len > 0 && data[0] == 0xff && data[1] == 0xff) {
+		addr += 2;
+		data += 2;
+		len -= 2;
+	}
+	while (len > 0 && data[len - 1] == 0xff && data[len - 2] == 0xff)
+		len -= 2;
+	if (len == 0)
+		return 0;
+
+	if (flags & CMD_SPI_FLAG_BACKUP)
+		return ec_flash_program_pages(fd, flags, addr, data, len);
+
+	return ec_flash_program_aai(fd, flags, addr, data, len);
+}
+
+// read back a sector and compare checksums, no second copy needed
+static int ec_flash_verify(int fd, int flags, unsigned int addr, const unsigned char *data, unsigned int len)
+{
+	unsigned char buf[EC_SPI_CHUNK];
+	uint32_t want, crc = 0;
+	unsigned int i, n;
+	int res;
+
+	want = ec_flash_crc32(0, data, len);
+
+	res = ec_flash_read_start(fd, flags, addr);
+	for (i = 0; res == 0 && i < len; i += n) {
+		n = (len - i > EC_SPI_CHUNK) ? EC_SPI_CHUNK : len - i;
+		res = spi_read(fd, flags, buf, n);
+		if (res == 0)
+			crc = ec_flash_crc32(crc, buf, n);
+	}
+	spi_reset(fd, flags);
+	if (res < 0)
+		return res;
+
+	return (crc == want) ? 0 : -EIO;
+}
+
+// erase, program and verify one sector
+static int ec_flash_write_sector(int fd, int flags, unsigned int addr, const unsigned char *data,
+                                 unsigned int len, ec_flash_stats_t *stats)
+{
+	int try;
+	int res = 0;
+
+	for (try = 0; try < EC_FLASH_RETRIES; try++) {
+		if (try > 0) {
+			stats->retried++;
+			spi_reset(fd, flags);
+		}
+
+		res = ec_flash_erase_sector(fd, flags, addr);
+		if (res == 0)
+			res = ec_flash_program(fd, flags, addr, data, len);
+		if (res < 0)
+			continue;
+
+		res = ec_flash_verify(fd, flags, addr, data, len);
+		if (res == -EIO)
+			stats->verify_failed++;
+		if (res == 0)
+			break;
+	}
+
+	return res;
+}
+
+int ec_flash_update(int fd, int flags, const unsigned char *image, unsigned int size,
+                    int dry_run, ec_flash_stats_t *stats,
+                    ec_flash_progress_func progress, void *user)
+{
+	unsigned char *cur;
+	unsigned int sector = ec_flash_sector_size(flags);
+	unsigned int addr;
+	int res;
+
+	memset(stats, 0, sizeof(ec_flash_stats_t));
+	stats->failed_addr = -1;
+	if (size % sector)
+		return -EINVAL;
+
+	cur = malloc(size);
+	if (cur == NULL)
+		return -ENOMEM;
+
+	res = ec_flash_read(fd, flags, 0, cur, size);
+	for (addr = 0; res == 0 && addr < size; addr += sector) {
+		stats->sectors++;
+		if (memcmp(&cur[addr], &image[addr], sector) == 0)
+			continue;
+		stats->changed++;
+
+		if (!dry_run) {
+			res = ec_flash_write_sector(fd, flags, addr, &image[addr], sector, stats);
+			if (res < 0)
+				stats->failed_addr = addr;
+		}
+
+		if (progress)
+			progress(addr + sector, size, user);
+	}
+	if (progress && res == 0)
+		progress(size, size, user);
+	spi_reset(fd, flags);
+
+	free(cur);
+
+	return res;
+}
+
+int ec_flash_dump(int fd, int flags, unsigned int size, int out_fd, uint32_t *crc,
+                  ec_flash_progress_func progress, void *user)
+{
+	ec_flash_pipe_t *pipe;
+	pthread_t writer;
+	unsigned int done = 0;
+	unsigned int slot, n;
+	int res;
+
+	pipe = calloc(1, sizeof(ec_flash_pipe_t));
+	if (pipe == NULL)
+		return -ENOMEM;
+	pthread_mutex_init(&pipe->lock, NULL);
+	pthread_cond_init(&pipe->cond, NULL);
+	pipe->out_fd = out_fd;
+
+	if (pthread_create(&writer, NULL, ec_flash_writer, pipe) != 0) {
+		free(pipe);
+		return -EAGAIN;
+	}
+
+	res = ec_flash_read_start(fd, flags, 0);
+	while (res == 0 && done < size) {
+		pthread_mutex_lock(&pipe->lock);
+		while (pipe->head - pipe->tail == EC_FLASH_NBUF && !pipe->err)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		slot = pipe->head % EC_FLASH_NBUF;
+		res = pipe->err ? -pipe->err : 0;
+		pthread_mutex_unlock(&pipe->lock);
+		if (res < 0)
+			break;
+
+		// the writer works on the previous blocks meanwhile
+		n = (size - done > EC_FLASH_PIPE_BLOCK) ? EC_FLASH_PIPE_BLOCK : size - done;
+		res = spi_read(fd, flags, pipe->buf[slot], n);
+		if (res < 0)
+			break;
+
+		pthread_mutex_lock(&pipe->lock);
+		pipe->len[slot] = n;
+		pipe->head++;
+		pthread_cond_signal(&pipe->cond);
+		pthread_mutex_unlock(&pipe->lock);
+
+		done += n;
+		if (progress)
+			progress(done, size, user);
+	}
+	spi_reset(fd, flags);
+
+	pthread_mutex_lock(&pipe->lock);
+	pipe->eof = 1;
+	pthread_cond_signal(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+	pthread_join(writer, NULL);
+
+	if (res == 0 && pipe->err)
+		res = -pipe->err;
+	if (crc)
+		*crc = pipe->crc;
+
+	pthread_mutex_destroy(&pipe->lock);
+	pthread_cond_destroy(&pipe->cond);
+	free(pipe);
+
+	return res;
+}
@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_FLASH_H
+#define _EC_FLASH_H
+
+#include <stdint.h>
+
+// IT5570 internal flash and the backup ROM
+#define EC_FLASH_SIZE		(128 * 1024)
+
+// erase granularity
+#define EC_FLASH_SECTOR_MAIN	1024
+#define EC_FLASH_SECTOR_BACKUP	4096
+
+// attempts to write one sector before the update gives up
+#define EC_FLASH_RETRIES	3
+
+typedef struct {
+	unsigned int sectors;		// sectors compared
+	unsigned int changed;		// sectors that differed, erased and programmed
+	unsigned int verify_failed;	// read backs that did not match
+	unsigned int retried;		// sector writes repeated after a failure
+	int failed_addr;		// sector given up on, -1 if none
+} ec_flash_stats_t;
+
+typedef void (*ec_flash_progress_func)(unsigned int done, unsigned int total, void *user);
+
+uint32_t ec_flash_crc32(uint32_t crc, const void *data, unsigned int len);
+
+int ec_flash_read(int fd, int flags, unsigned int addr, void *buf, unsigned int len);
+
+int ec_flash_sector_size(int flags);
+
+int ec_flash_update(int fd, int flags, const unsigned char *image, unsigned int size,
+                    int dry_run, ec_flash_stats_t *stats,
+                    ec_flash_progress_func progress, void *user);
+
+int ec_flash_dump(int fd, int flags, unsigned int size, int out_fd, uint32_t *crc,
+                  ec_flash_progress_func progress, void *user);
+
+#endif
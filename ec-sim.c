@@ -0,0 +1,472 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * In-memory simulated EC, selected with LIBREM_EC_BACKEND=sim.
+ *
+ * Models the SMFI command window (command, result and data registers)
+ * and the debug window, and answers the System76 protocol commands the
+ * way the firmware does. A written command stays "busy" in the command
+ * register for its configured latency (LIBREM_EC_SIM_LATENCY in us as
+ * default for all commands), so the host side completion wait is
+ * exercised as well. The SPI commands drive a model of the main and
+ * backup flash chips (read, status, write enable, sector/chip erase,
+ * AAI word and page program).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "ec-tool.h"
+#include "ec-transport.h"
+#include "ec-sim.h"
+
+#define EC_SIM_BOARD		"purism/librem_14"
+#define EC_SIM_VERSION		"sim-0.1"
+#define EC_SIM_LED_MAX		255
+
+#define SIM_DATA_SIZE		(SMFI_CMD_SIZE - SMFI_CMD_DATA)
+#define SIM_SPI_MAX		(SIM_DATA_SIZE - 2)
+
+#define SPI_STATUS_BUSY		(1 << 0)
+#define SPI_STATUS_WEL		(1 << 1)
+
+typedef struct {
+    unsigned char data[EC_SIM_FLASH_SIZE];
+    int cs;			// chip selected, a transaction is running
+    int nbytes;			// bytes transferred in this transaction
+    unsigned char op;
+    unsigned int addr;
+    unsigned char status;
+    int aai;			// in AAI word program mode
+} ec_sim_spi_t;
+
+static unsigned char sim_ram[SMFI_CMD_SIZE + SMFI_DBG_SIZE];
+static unsigned int sim_latency[CMD_LED_SAVE + 1];
+static unsigned long sim_busy_until;
+static int sim_initialized;
+static int sim_per_key;		// keyboard firmware answers for single LEDs
+
+static ec_sim_spi_t sim_spi[2];
+static unsigned char sim_fan[EC_SIM_FANS];
+static unsigned char sim_led_value[EC_SIM_LEDS];
+static unsigned char sim_led_color[EC_SIM_LEDS][3];
+static unsigned char sim_led_mode[EC_SIM_LAYERS][2];
+static unsigned short sim_keymap[EC_SIM_LAYERS][EC_SIM_MATRIX_ROWS][EC_SIM_MATRIX_COLS];
+static unsigned char sim_matrix[EC_SIM_MATRIX_ROWS];
+
+
+static unsigned long sim_now_us(void)
+{
+struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000UL) + (ts.tv_nsec / 1000);
+}
+
+// deterministic flash contents, so dumps and diffs are reproducible
+static void sim_flash_fill(unsigned char *flash, unsigned int seed)
+{
+unsigned int x = seed;
+int i;
+
+    for (i=0; i<EC_SIM_FLASH_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        flash[i] = x;
+    }
+    memcpy(flash, EC_SIM_BOARD, sizeof(EC_SIM_BOARD));
+}
+
+void ec_sim_reset(void)
+{
+const char *env;
+int i;
+
+    memset(sim_ram, 0, sizeof(sim_ram));
+    memset(sim_spi, 0, sizeof(sim_spi));
+    memset(sim_fan, 0, sizeof(sim_fan));
+    memset(sim_led_value, 0, sizeof(sim_led_value));
+    memset(sim_led_color, 0xff, sizeof(sim_led_color));
+    memset(sim_led_mode, 0, sizeof(sim_led_mode));
+    memset(sim_keymap, 0, sizeof(sim_keymap));
+    memset(sim_matrix, 0, sizeof(sim_matrix));
+    sim_flash_fill(sim_spi[0].data, 0x4c696272);
+    sim_flash_fill(sim_spi[1].data, 0x656d4543);
+
+    env = getenv("LIBREM_EC_SIM_LATENCY");
+    for (i=0; i<=CMD_LED_SAVE; i++)
+        sim_latency[i] = env ? atoi(env) : 0;
+    // like the real EC only EC_LED_ALL unless asked for per key LEDs
+    sim_per_key = (getenv("LIBREM_EC_SIM_PER_KEY") != NULL);
+    sim_busy_until = 0;
+    sim_initialized = 1;
+
+    ec_sim_print("librem ec simulator\n");
+}
+
+void ec_sim_set_latency(int cmd, unsigned int latency_us)
+{
+int i;
+
+    if (cmd < 0) {
+        for (i=0; i<=CMD_LED_SAVE; i++)
+            sim_latency[i] = latency_us;
+    } else if (cmd <= CMD_LED_SAVE)
+        sim_latency[cmd] = latency_us;
+}
+
+unsigned char *ec_sim_flash(int backup)
+{
+    return sim_spi[backup ? 1 : 0].data;
+}
+
+void ec_sim_set_key(int row, int col, int pressed)
+{
+    if (row < 0 || row >= EC_SIM_MATRIX_ROWS || col < 0 || col >= EC_SIM_MATRIX_COLS)
+        return;
+
+    if (pressed)
+        sim_matrix[row] |= (1 << col);
+    else
+        sim_matrix[row] &= ~(1 << col);
+}
+
+// append to the debug ring: byte 0 is the tail, bytes 1..0xff the ring
+void ec_sim_print(const char *str)
+{
+unsigned char *dbg = &sim_ram[SMFI_CMD_SIZE];
+int tail = dbg[0];
+
+    for (; *str; str++) {
+        tail++;
+        if (tail >= SMFI_DBG_SIZE)
+            tail = 1;
+        dbg[tail] = *str;
+    }
+    dbg[0] = tail;
+}
+
+//
+// SPI flash model
+//
+static int spi_has_addr(unsigned char op)
+{
+    return (op == 0x03 || op == 0x0B || op == 0x02 || op == 0xF2 ||
+            op == 0x20 || op == 0xD7);
+}
+
+static void spi_program(ec_sim_spi_t *spi, unsigned int addr, unsigned char val)
+{
+    // NOR flash, programming only clears bits
+    if (spi->status & SPI_STATUS_WEL)
+        spi->data[addr % EC_SIM_FLASH_SIZE] &= val;
+}
+
+static void spi_write_byte(ec_sim_spi_t *spi, unsigned char b)
+{
+int n = spi->nbytes++;
+
+    if (n == 0) {
+        spi->op = b;
+        // AAI continues at the address where the last word ended
+        if (spi_has_addr(b) || (b == 0xAD && !spi->aai))
+            spi->addr = 0;
+        if (b == 0x06)
+            spi->status |= SPI_STATUS_WEL;
+        if (b == 0x04) {
+            spi->status &= ~SPI_STATUS_WEL;
+            spi->aai = 0;
+        }
+        return;
+    }
+
+    if (spi->op == 0xAD) {
+        // first AAI transaction carries the address, the rest only data
+        if (!spi->aai && n <= 3) {
+            spi->addr = (spi->addr << 8) | b;
+            return;
+        }
+        spi_program(spi, spi->addr++, b);
+        return;
+    }
+
+    if (spi_has_addr(spi->op) && n <= 3) {
+        spi->addr = (spi->addr << 8) | b;
+        return;
+    }
+
+    if (spi->op == 0x02 || spi->op == 0xF2) {
+        // page program wraps within the 256 byte page
+        spi_program(spi, (spi->addr & ~0xffU) | ((spi->addr + n - 4) & 0xff), b);
+    }
+}
+
+static unsigned char spi_read_byte(ec_sim_spi_t *spi)
+{
+int n = spi->nbytes++;
+
+    switch (spi->op) {
+        case 0x05:
+            return spi->status;
+        case 0x9F:
+            return (unsigned char[]){ 0xff, 0xff, 0xff }[n % 3];
+        case 0x03:
+            if (n >= 4)
+                return spi->data[spi->addr++ % EC_SIM_FLASH_SIZE];
+            break;
+        case 0x0B:
+            // one dummy byte after the address
+            if (n >= 5)
+                return spi->data[spi->addr++ % EC_SIM_FLASH_SIZE];
+            break;
+    }
+
+    return 0xff;
+}
+
+// chip select goes high, erase operations take effect
+static void spi_end(ec_sim_spi_t *spi)
+{
+unsigned int size = 0;
+
+    if (!spi->cs)
+        return;
+    spi->cs = 0;
+
+    if (spi->op == 0xD7)
+        size = 1024;
+    else if (spi->op == 0x20)
+        size = 4096;
+
+    if (size && spi->nbytes >= 4 && (spi->status & SPI_STATUS_WEL))
+        memset(&spi->data[(spi->addr & ~(size - 1)) % EC_SIM_FLASH_SIZE], 0xff, size);
+    if ((spi->op == 0x60 || spi->op == 0xC7) && (spi->status & SPI_STATUS_WEL))
+        memset(spi->data, 0xff, EC_SIM_FLASH_SIZE);
+
+    if (spi->op == 0xAD)
+        spi->aai = 1;
+    else if (spi->op != 0x06 && spi->op != 0x05 && spi->op != 0x03 &&
+             spi->op != 0x0B && spi->op != 0x9F)
+        spi->status &= ~SPI_STATUS_WEL;
+    spi->nbytes = 0;
+}
+
+static int sim_cmd_spi(unsigned char *data)
+{
+ec_sim_spi_t *spi;
+unsigned char flags = data[0];
+int len, i;
+
+    spi = &sim_spi[(flags & CMD_SPI_FLAG_BACKUP) ? 1 : 0];
+
+    if (flags & CMD_SPI_FLAG_DISABLE) {
+        spi_end(spi);
+        data[1] = 0;
+        return RES_OK;
+    }
+
+    if (!spi->cs) {
+        spi->cs = 1;
+        spi->nbytes = 0;
+    }
+
+    len = data[1];
+    if (len > SIM_SPI_MAX)
+        len = SIM_SPI_MAX;
+    for (i=0; i<len; i++) {
+        if (flags & CMD_SPI_FLAG_READ)
+            data[2 + i] = spi_read_byte(spi);
+        else
+            spi_write_byte(spi, data[2 + i]);
+    }
+    data[1] = len;
+
+    return RES_OK;
+}
+
+static int sim_cmd(unsigned char cmd, unsigned char *data)
+{
+int i;
+
+    switch (cmd) {
+        case CMD_PROBE:
+            data[0] = 0x76;
+            data[1] = 0xEC;
+            data[2] = 1;
+            return RES_OK;
+        case CMD_BOARD:
+            memset(data, 0, SIM_DATA_SIZE);
+            strcpy((char *)data, EC_SIM_BOARD);
+            return RES_OK;
+        case CMD_VERSION:
+            memset(data, 0, SIM_DATA_SIZE);
+            strcpy((char *)data, EC_SIM_VERSION);
+            return RES_OK;
+        case CMD_PRINT: {
+            char str[SIM_DATA_SIZE];
+            int len = data[1] < SIM_DATA_SIZE - 2 ? data[1] : SIM_DATA_SIZE - 2;
+
+            memcpy(str, &data[2], len);
+            str[len] = 0;
+            ec_sim_print(str);
+            data[1] = len;
+            return RES_OK;
+        }
+        case CMD_SPI:
+            return sim_cmd_spi(data);
+        case CMD_RESET:
+            for (i=0; i<2; i++)
+                spi_end(&sim_spi[i]);
+            return RES_OK;
+        case CMD_FAN_GET:
+            if (data[0] >= EC_SIM_FANS)
+                return RES_ERR;
+            data[1] = sim_fan[data[0]];
+            return RES_OK;
+        case CMD_FAN_SET:
+            if (data[0] >= EC_SIM_FANS)
+                return RES_ERR;
+            sim_fan[data[0]] = data[1];
+            return RES_OK;
+        case CMD_KEYMAP_GET:
+            if (data[0] >= EC_SIM_LAYERS || data[1] >= EC_SIM_MATRIX_ROWS || data[2] >= EC_SIM_MATRIX_COLS)
+                return RES_ERR;
+            data[3] = sim_keymap[data[0]][data[1]][data[2]] & 0xff;
+            data[4] = sim_keymap[data[0]][data[1]][data[2]] >> 8;
+            return RES_OK;
+        case CMD_KEYMAP_SET:
+            if (data[0] >= EC_SIM_LAYERS || data[1] >= EC_SIM_MATRIX_ROWS || data[2] >= EC_SIM_MATRIX_COLS)
+                return RES_ERR;
+            sim_keymap[data[0]][data[1]][data[2]] = data[3] | (data[4] << 8);
+            return RES_OK;
+        case CMD_LED_GET_VALUE:
+            if (data[0] != 0xff && (!sim_per_key || data[0] >= EC_SIM_LEDS))
+                return RES_ERR;
+            data[1] = sim_led_value[data[0] == 0xff ? 0 : data[0]];
+            data[2] = EC_SIM_LED_MAX;
+            return RES_OK;
+        case CMD_LED_SET_VALUE:
+            if (data[0] == 0xff)
+                memset(sim_led_value, data[1], sizeof(sim_led_value));
+            else if (sim_per_key && data[0] < EC_SIM_LEDS)
+                sim_led_value[data[0]] = data[1];
+            else
+                return RES_ERR;
+            return RES_OK;
+        case CMD_LED_GET_COLOR:
+            if (data[0] != 0xff && (!sim_per_key || data[0] >= EC_SIM_LEDS))
+                return RES_ERR;
+            memcpy(&data[1], sim_led_color[data[0] == 0xff ? 0 : data[0]], 3);
+            return RES_OK;
+        case CMD_LED_SET_COLOR:
+            if (data[0] == 0xff) {
+                for (i=0; i<EC_SIM_LEDS; i++)
+                    memcpy(sim_led_color[i], &data[1], 3);
+            } else if (sim_per_key && data[0] < EC_SIM_LEDS)
+                memcpy(sim_led_color[data[0]], &data[1], 3);
+            else
+                return RES_ERR;
+            return RES_OK;
+        case CMD_LED_GET_MODE:
+            if (data[0] >= EC_SIM_LAYERS)
+                return RES_ERR;
+            data[1] = sim_led_mode[data[0]][0];
+            data[2] = sim_led_mode[data[0]][1];
+            return RES_OK;
+        case CMD_LED_SET_MODE:
+            if (data[0] >= EC_SIM_LAYERS)
+                return RES_ERR;
+            sim_led_mode[data[0]][0] = data[1];
+            sim_led_mode[data[0]][1] = data[2];
+            return RES_OK;
+        case CMD_MATRIX_GET:
+            data[0] = EC_SIM_MATRIX_ROWS;
+            data[1] = EC_SIM_MATRIX_COLS;
+            memcpy(&data[2], sim_matrix, EC_SIM_MATRIX_ROWS);
+            return RES_OK;
+        case CMD_LED_SAVE:
+            return RES_OK;
+    }
+
+    return RES_ERR;
+}
+
+//
+// transport
+//
+static int sim_open(void)
+{
+    if (!sim_initialized)
+        ec_sim_reset();
+
+    return 0;
+}
+
+static void sim_close(int fd)
+{
+}
+
+static int sim_read(int fd, off_t offset, size_t len, void *buf)
+{
+off_t base = offset - SMFI_CMD_BASE;
+
+    if (base < 0 || base + len > sizeof(sim_ram))
+        return -EINVAL;
+
+    // the command register clears once the command "finished"
+    if (base == SMFI_CMD_CMD && sim_ram[SMFI_CMD_CMD] != 0 && sim_now_us() >= sim_busy_until)
+        sim_ram[SMFI_CMD_CMD] = 0;
+
+    memcpy(buf, &sim_ram[base], len);
+
+    return len;
+}
+
+static int sim_write(int fd, off_t offset, size_t len, void *buf)
+{
+off_t base = offset - SMFI_CMD_BASE;
+unsigned char cmd;
+
+    if (base < 0 || base + len > sizeof(sim_ram))
+        return -EINVAL;
+
+    memcpy(&sim_ram[base], buf, len);
+
+    if (base == SMFI_CMD_CMD && sim_ram[SMFI_CMD_CMD] != 0) {
+        cmd = sim_ram[SMFI_CMD_CMD];
+        sim_ram[SMFI_CMD_RES] = sim_cmd(cmd, &sim_ram[SMFI_CMD_DATA]);
+        sim_busy_until = sim_now_us() + (cmd <= CMD_LED_SAVE ? sim_latency[cmd] : 0);
+    }
+
+    return len;
+}
+
+const ec_transport_t ec_transport_sim = {
+    .name = "sim",
+    .open = sim_open,
+    .close = sim_close,
+    .read = sim_read,
+    .write = sim_write,
+};
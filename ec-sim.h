@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_SIM_H
+#define _EC_SIM_H
+
+#define EC_SIM_FLASH_SIZE	(128 * 1024)
+#define EC_SIM_FANS		2
+#define EC_SIM_LEDS		128
+#define EC_SIM_LAYERS		4
+#define EC_SIM_MATRIX_ROWS	16
+#define EC_SIM_MATRIX_COLS	8
+
+void ec_sim_reset(void);
+
+void ec_sim_set_latency(int cmd, unsigned int latency_us);
+
+unsigned char *ec_sim_flash(int backup);
+
+void ec_sim_set_key(int row, int col, int pressed);
+
+void ec_sim_print(const char *str);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Per command counters and latency histograms of the EC protocol, filled
+ * in by cmd_write(), cmd_result() and the data window accessors. The
+ * histograms are HDR style: a value lands in a bucket by its highest set
+ * bit and the next three bits, so recording is a few instructions, the
+ * relative error is bounded at every scale and percentiles come from a
+ * walk over 200 counters.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ec-tool.h"
+#include "ec-stats.h"
+
+static ec_cmd_stats_t ec_stats[EC_STATS_CMDS];
+// uncontended unless somebody reads while a command runs
+static pthread_mutex_t ec_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *ec_cmd_names[EC_STATS_CMDS] = {
+	[CMD_NONE]			= "none",
+	[CMD_PROBE]			= "probe",
+	[CMD_BOARD]			= "board",
+	[CMD_VERSION]		= "version",
+	[CMD_PRINT]			= "print",
+	[CMD_SPI]			= "spi",
+	[CMD_RESET]			= "reset",
+	[CMD_FAN_GET]		= "fan_get",
+	[CMD_FAN_SET]		= "fan_set",
+	[CMD_KEYMAP_GET]	= "keymap_get",
+	[CMD_KEYMAP_SET]	= "keymap_set",
+	[CMD_LED_GET_VALUE]	= "led_get_value",
+	[CMD_LED_SET_VALUE]	= "led_set_value",
+	[CMD_LED_GET_COLOR]	= "led_get_color",
+	[CMD_LED_SET_COLOR]	= "led_set_color",
+	[CMD_LED_GET_MODE]	= "led_get_mode",
+	[CMD_LED_SET_MODE]	= "led_set_mode",
+	[CMD_MATRIX_GET]	= "matrix_get",
+	[CMD_LED_SAVE]		= "led_save",
+	[EC_STATS_CMDS - 1]	= "other",
+};
+
+
+static int ec_stats_slot(int cmd)
+{
+	if (cmd < 0 || cmd >= EC_STATS_CMDS)
+		return EC_STATS_CMDS - 1;
+
+	return cmd;
+}
+
+const char *ec_cmd_name(int cmd)
+{
+	return ec_cmd_names[ec_stats_slot(cmd)];
+}
+
+static int ec_hist_index(uint32_t us)
+{
+	int e;
+
+	if (us >= (1u << EC_HIST_MAX_BITS))
+		us = (1u << EC_HIST_MAX_BITS) - 1;
+	if (us < (1u << EC_HIST_SUB_BITS))
+		return us;
+
+	e = 31 - __builtin_clz(us);
+	return ((e - EC_HIST_SUB_BITS + 1) << EC_HIST_SUB_BITS) +
+		((us >> (e - EC_HIST_SUB_BITS)) & ((1 << EC_HIST_SUB_BITS) - 1));
+}
+
+// highest value that lands in bucket i
+static uint32_t ec_hist_upper(int i)
+{
+	int g = i >> EC_HIST_SUB_BITS;
+	int s = i & ((1 << EC_HIST_SUB_BITS) - 1);
+	int shift;
+
+	if (g == 0)
+		return s;
+	shift = g - 1;
+
+	return (((uint32_t)(1 << EC_HIST_SUB_BITS) + s + 1) << shift) - 1;
+}
+
+void ec_hist_add(ec_hist_t *h, uint32_t us)
+{
+	h->count[ec_hist_index(us)]++;
+	if (h->n == 0 || us < h->min_us)
+		h->min_us = us;
+	if (us > h->max_us)
+		h->max_us = us;
+	h->n++;
+	h->sum_us += us;
+}
+
+// pct in 0..100, the result is within one bucket of the true value
+uint32_t ec_hist_percentile(const ec_hist_t *h, double pct)
+{
+	uint64_t want, seen = 0;
+	uint32_t v;
+	int i;
+
+	if (h->n == 0)
+		return 0;
+	want = (uint64_t)(pct / 100. * h->n + 0.5);
+	if (want < 1)
+		want = 1;
+
+	for (i = 0; i < EC_HIST_BUCKETS; i++) {
+		seen += h->count[i];
+		if (seen >= want)
+			break;
+	}
+	v = ec_hist_upper(i);
+	if (v > h->max_us)
+		v = h->max_us;
+	if (v < h->min_us)
+		v = h->min_us;
+
+	return v;
+}
+
+// res as returned by cmd_wait(), or -EIO if the command never got out
+void ec_stats_cmd(int cmd, int res, uint32_t wait_us)
+{
+	ec_cmd_stats_t *s = &ec_stats[ec_stats_slot(cmd)];
+
+	pthread_mutex_lock(&ec_stats_lock);
+	s->issued++;
+	if (res == 0)
+		s->completed++;
+	else if (res == -ETIMEDOUT)
+		s->timeouts++;
+	else
+		s->io_errors++;
+	if (res == 0 || res == -ETIMEDOUT)
+		ec_hist_add(&s->wait, wait_us);
+	pthread_mutex_unlock(&ec_stats_lock);
+}
+
+void ec_stats_xfer(int cmd, uint32_t us)
+{
+	pthread_mutex_lock(&ec_stats_lock);
+	ec_hist_add(&ec_stats[ec_stats_slot(cmd)].xfer, us);
+	pthread_mutex_unlock(&ec_stats_lock);
+}
+
+void ec_stats_result(int cmd, int res)
+{
+	ec_cmd_stats_t *s = &ec_stats[ec_stats_slot(cmd)];
+
+	pthread_mutex_lock(&ec_stats_lock);
+	if (res == RES_ERR)
+		s->errors++;
+	else if (res < 0)
+		s->io_errors++;
+	pthread_mutex_unlock(&ec_stats_lock);
+}
+
+// consistent copy of one command's counters
+void ec_stats_get(int cmd, ec_cmd_stats_t *s)
+{
+	pthread_mutex_lock(&ec_stats_lock);
+	*s = ec_stats[ec_stats_slot(cmd)];
+	pthread_mutex_unlock(&ec_stats_lock);
+}
+
+void ec_stats_reset(void)
+{
+	pthread_mutex_lock(&ec_stats_lock);
+	memset(ec_stats, 0, sizeof(ec_stats));
+	pthread_mutex_unlock(&ec_stats_lock);
+}
+
+static int ec_stats_hist_format(char *buf, int len, const ec_hist_t *h)
+{
+	if (h->n == 0)
+		return snprintf(buf, len, " %6s %6s %6s %7s", "-", "-", "-", "-");
+
+	return snprintf(buf, len, " %6u %6u %6u %7u", ec_hist_percentile(h, 50.),
+		ec_hist_percentile(h, 99.), h->max_us, (unsigned int)(h->sum_us / h->n));
+}
+
+// one line per command that was used, latencies in us
+int ec_stats_format(char *buf, int len)
+{
+	ec_cmd_stats_t snap;
+	const ec_cmd_stats_t *s = &snap;
+	int i, n;
+
+	n = snprintf(buf, len, "%-14s %8s %8s %7s %7s %5s %28s %28s\n"
+		"%-14s %8s %8s %7s %7s %5s %6s %6s %6s %7s %6s %6s %6s %7s\n",
+		"", "", "", "", "", "", "wait us", "transfer us",
+		"command", "issued", "ok", "timeout", "RES_ERR", "io",
+		"p50", "p99", "max", "mean", "p50", "p99", "max", "mean");
+	for (i = 0; i < EC_STATS_CMDS && n < len; i++) {
+		ec_stats_get(i, &snap);
+		if (s->issued == 0 && s->xfer.n == 0)
+			continue;
+		n += snprintf(buf + n, len - n, "%-14s %8lu %8lu %7lu %7lu %5lu", ec_cmd_names[i],
+			s->issued, s->completed, s->timeouts, s->errors, s->io_errors);
+		if (n < len)
+			n += ec_stats_hist_format(buf + n, len - n, &s->wait);
+		if (n < len)
+			n += ec_stats_hist_format(buf + n, len - n, &s->xfer);
+		if (n < len)
+			n += snprintf(buf + n, len - n, "\n");
+	}
+
+	return (n < len) ? n : len - 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_STATS_H
+#define _EC_STATS_H
+
+#include <stdint.h>
+
+// log-linear latency buckets: exact below 8 us, then 8 per power of two
+// (12.5% resolution) up to 2^27 us
+#define EC_HIST_SUB_BITS	3
+#define EC_HIST_MAX_BITS	27
+#define EC_HIST_BUCKETS		((EC_HIST_MAX_BITS - EC_HIST_SUB_BITS + 1) << EC_HIST_SUB_BITS)
+
+// one slot per enum Command, the last one for anything newer
+#define EC_STATS_CMDS		20
+// enough for ec_stats_format() with every command in use
+#define EC_STATS_TEXT_LEN	4096
+
+typedef struct {
+	uint32_t count[EC_HIST_BUCKETS];
+	uint64_t n;
+	uint64_t sum_us;
+	uint32_t min_us;
+	uint32_t max_us;
+} ec_hist_t;
+
+typedef struct {
+	unsigned long issued;
+	unsigned long completed;
+	unsigned long timeouts;
+	unsigned long errors;		// RES_ERR read back
+	unsigned long io_errors;	// the port itself failed
+	ec_hist_t wait;				// command written until the EC cleared it
+	ec_hist_t xfer;				// data window writes before and reads after it
+} ec_cmd_stats_t;
+
+/*
+ * Updated by the thread that talks to the EC, read from any thread. A
+ * mutex keeps every read a consistent copy.
+ */
+void ec_stats_cmd(int cmd, int res, uint32_t wait_us);
+
+void ec_stats_xfer(int cmd, uint32_t us);
+
+void ec_stats_result(int cmd, int res);
+
+void ec_stats_get(int cmd, ec_cmd_stats_t *s);
+
+void ec_stats_reset(void);
+
+const char *ec_cmd_name(int cmd);
+
+void ec_hist_add(ec_hist_t *h, uint32_t us);
+
+uint32_t ec_hist_percentile(const ec_hist_t *h, double pct);
+
+int ec_stats_format(char *buf, int len);
+
+#endif
@@ -25,77 +25,24 @@
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "ec-tool.h"
+#include "ec-transport.h"
+#include "ec-stats.h"
 
-#define ACPI_PATH_1 "/sys/bus/acpi/devices/316D4C14:00"
-#define ACPI_PATH_2 "/sys/bus/acpi/devices/PURI4543:00"
-
-#define SMFI_CMD_BASE 0xE00
-#define SMFI_CMD_SIZE 0x100
-
-#define SMFI_DBG_BASE 0xF00
-#define SMFI_DBG_SIZE 0x100
-
-#define SMFI_CMD_CMD 0x00
-#define SMFI_CMD_RES 0x01
-#define SMFI_CMD_DATA 0x02
-
-#define CMD_SPI_FLAG_READ	(1 << 0)
-#define CMD_SPI_FLAG_DISABLE	(1 << 1)
-#define CMD_SPI_FLAG_SCRATCH	(1 << 2)
-#define CMD_SPI_FLAG_BACKUP	(1 << 3)
 
 // reset = flags, read false, disable true
 
-enum Command {
-    // Indicates that EC is ready to accept commands
-    CMD_NONE = 0,
-    // Probe for System76 EC protocol
-    CMD_PROBE = 1,
-    // Read board string
-    CMD_BOARD = 2,
-    // Read version string
-    CMD_VERSION = 3,
-    // Write bytes to console
-    CMD_PRINT = 4,
-    // Access SPI chip
-    CMD_SPI = 5,
-    // Reset EC
-    CMD_RESET = 6,
-    // Get fan speeds
-    CMD_FAN_GET = 7,
-    // Set fan speeds
-    CMD_FAN_SET = 8,
-    // Get keyboard map index
-    CMD_KEYMAP_GET = 9,
-    // Set keyboard map index
-    CMD_KEYMAP_SET = 10,
-    // Get LED value by index
-    CMD_LED_GET_VALUE = 11,
-    // Set LED value by index
-    CMD_LED_SET_VALUE = 12,
-    // Get LED color by index
-    CMD_LED_GET_COLOR = 13,
-    // Set LED color by index
-    CMD_LED_SET_COLOR = 14,
-    // Get LED matrix mode and speed
-    CMD_LED_GET_MODE = 15,
-    // Set LED matrix mode and speed
-    CMD_LED_SET_MODE = 16,
-    // Get key matrix state
-    CMD_MATRIX_GET = 17,
-    // Save LED settings to ROM
-    CMD_LED_SAVE = 18,
-    //TODO
-};
-
-enum Result {
-    // Command executed successfully
-    RES_OK = 0,
-    // Command failed with generic error
-    RES_ERR = 1,
-    //TODO
-};
+// command completion wait: spin on the command register for a short
+// while, since most commands finish within a few port reads, then back
+// off exponentially until the deadline
+#define EC_CMD_SPIN_US		50
+#define EC_CMD_BACKOFF_MIN_US	10
+#define EC_CMD_BACKOFF_MAX_US	1000
+#define EC_CMD_TIMEOUT_US	100000
 
 #if 0
 enum CommandSpiFlag {
@@ -110,50 +57,94 @@ enum CommandSpiFlag {
 };
 #endif
 
+static const ec_transport_t *port_transport = &ec_transport_devport;
+static const char *port_backend_req;
+
+static unsigned int ec_cmd_timeout_us = EC_CMD_TIMEOUT_US;
+static unsigned int ec_cmd_last_us;
+// the command results and data window reads are accounted to
+static int ec_cmd_last = -1;
+
+
+static unsigned long ec_now_us(void)
+{
+struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000UL) + (ts.tv_nsec / 1000);
+}
+
+void ec_set_cmd_timeout(unsigned int timeout_us)
+{
+    ec_cmd_timeout_us = timeout_us;
+}
 
+// how long the last command took from write to completion, in us
+unsigned int ec_cmd_last_duration(void)
+{
+    return ec_cmd_last_us;
+}
+
+// request a backend for the next port_open(), NULL for automatic
+void port_set_backend(const char *name)
+{
+    port_backend_req = name;
+}
+
+const char *port_backend_name(void)
+{
+    return port_transport->name;
+}
+
+// LIBREM_EC_BACKEND=devport|ioport|sim, default is ioport with devport fallback
 int port_open(void)
 {
+const ec_transport_t *t;
+const char *req;
 int fd;
-struct stat path_stat;
 
-    if (getuid() != 0 && geteuid() != 0) {
-        fprintf(stderr, "please run as root or use sudo or similar\n");
-        return -1;
-    }
-    if (stat(ACPI_PATH_1, &path_stat) != 0 &&
-        stat(ACPI_PATH_2, &path_stat) != 0) {
-        fprintf(stderr, "no Librem EC found, giving up\n");
-        return -1;
+    req = port_backend_req ? port_backend_req : getenv("LIBREM_EC_BACKEND");
+    if (req != NULL) {
+        t = ec_transport_find(req);
+        if (t == NULL) {
+            fprintf(stderr, "unknown EC backend '%s'\n", req);
+            return -EINVAL;
+        }
+        fd = t->open();
+        if (fd >= 0)
+            port_transport = t;
+        return fd;
     }
 
-    if (S_ISDIR(path_stat.st_mode))
-        fprintf(stderr, "Librem EC detected\n");
+    fd = ec_transport_ioport.open();
+    if (fd >= 0) {
+        port_transport = &ec_transport_ioport;
+        return fd;
+    }
+    // no point in trying /dev/port without EC or privileges
+    if (fd == -ENODEV || fd == -EACCES)
+        return fd;
 
-    fd = open("/dev/port", O_RDWR);
-    if (fd<0)
-        perror("open()");
+    fd = ec_transport_devport.open();
+    if (fd >= 0)
+        port_transport = &ec_transport_devport;
 
     return fd;
 }
 
-int port_read(int fd, off_t offset, size_t len, void *buf)
+void port_close(int fd)
 {
-int rlen=0;
-
-    lseek(fd, offset, SEEK_SET);
-    rlen = read(fd, buf, len);
+    port_transport->close(fd);
+}
 
-    return rlen;
+int port_read(int fd, off_t offset, size_t len, void *buf)
+{
+    return port_transport->read(fd, offset, len, buf);
 }
 
 int port_write(int fd, off_t offset, size_t len, void *buf)
 {
-int wlen=0;
-
-    lseek(fd, offset, SEEK_SET);
-    wlen = write(fd, buf, len);
-
-    return wlen;
+    return port_transport->write(fd, offset, len, buf);
 }
 
 int cmd_read(int fd)
@@ -166,78 +157,183 @@ unsigned char buf=0;
         return buf;
 }
 
-int cmd_write(int fd, u_int8_t cmd)
+int cmd_wait(int fd)
 {
-int i;
+unsigned long start, elapsed;
+unsigned int backoff = EC_CMD_BACKOFF_MIN_US;
+int res;
+
+    start = ec_now_us();
+    while (1) {
+        res = cmd_read(fd);
+        elapsed = ec_now_us() - start;
+        if (res == 0) {
+            ec_cmd_last_us = elapsed;
+            return 0;
+        }
+        if (res < 0)
+            return -EIO;
+        if (elapsed >= ec_cmd_timeout_us) {
+            ec_cmd_last_us = elapsed;
+            return -ETIMEDOUT;
+        }
+        if (elapsed < EC_CMD_SPIN_US)
+            continue;
+        usleep(backoff);
+        if (backoff * 2 < EC_CMD_BACKOFF_MAX_US)
+            backoff *= 2;
+        else
+            backoff = EC_CMD_BACKOFF_MAX_US;
+    }
+}
 
-    i = port_write(fd, SMFI_CMD_BASE + SMFI_CMD_CMD, 1, &cmd);
-    if (i < 1)
-        return -1;
+// returns 0 once the EC has processed the command, -ETIMEDOUT or -EIO
+int cmd_write(int fd, u_int8_t cmd)
+{
+int res;
 
-    i=100;
-    while (--i > 0) {
-        if (cmd_read(fd) == 0)
-            break;
-        usleep(100);
+    ec_cmd_last = cmd;
+    if (port_write(fd, SMFI_CMD_BASE + SMFI_CMD_CMD, 1, &cmd) != 1) {
+        ec_stats_cmd(cmd, -EIO, 0);
+        return -EIO;
     }
-    return (i>0 ? 1:0);
+
+    res = cmd_wait(fd);
+    ec_stats_cmd(cmd, res, ec_cmd_last_us);
+
+    return res;
 }
 
+// result register of the last command, RES_OK or RES_ERR
 int cmd_result(int fd)
 {
-    return -1;
+unsigned char buf=0;
+int res;
+
+    if (port_read(fd, SMFI_CMD_BASE + SMFI_CMD_RES, 1, &buf) != 1)
+        res = -EIO;
+    else
+        res = buf;
+    ec_stats_result(ec_cmd_last, res);
+
+    return res;
 }
 
 int cmd_data_read(int fd, int len, void *buf)
 {
+unsigned long start;
+int res;
+
     if (buf == NULL)
         return -ENOBUFS;
 
     if (len > (SMFI_CMD_SIZE - SMFI_CMD_DATA))
         len = (SMFI_CMD_SIZE - SMFI_CMD_DATA);
 
-    return port_read(fd, SMFI_CMD_BASE + SMFI_CMD_DATA, len, buf);
+    start = ec_now_us();
+    res = port_read(fd, SMFI_CMD_BASE + SMFI_CMD_DATA, len, buf);
+    if (ec_cmd_last >= 0)
+        ec_stats_xfer(ec_cmd_last, ec_now_us() - start);
+
+    return res;
 }
 
 int cmd_data_write(int fd, u_int8_t cmd, void *cmd_data, int len)
 {
-    port_write(fd, SMFI_CMD_BASE + SMFI_CMD_DATA, len, cmd_data);
+unsigned long start;
 
-    cmd_write(fd, cmd);
+    if (len > (SMFI_CMD_SIZE - SMFI_CMD_DATA))
+        return -EINVAL;
+
+    start = ec_now_us();
+    if (port_write(fd, SMFI_CMD_BASE + SMFI_CMD_DATA, len, cmd_data) != len)
+        return -EIO;
+    ec_stats_xfer(cmd, ec_now_us() - start);
 
-    return -1;
+    return cmd_write(fd, cmd);
 }
 
 
-void spi_read(int fd)
+// one SPI bus transfer through CMD_SPI, data[0] = flags, data[1] = length
+static int spi_cmd(int fd, unsigned char *buf, int len)
 {
-    unsigned char buf[0x100] = { CMD_SPI_FLAG_READ | CMD_SPI_FLAG_SCRATCH | CMD_SPI_FLAG_BACKUP, 0x00, 0x00, 0x00, 0x00 };
+int res;
 
-    cmd_data_write(fd, CMD_SPI, buf, 5);
+    res = cmd_data_write(fd, CMD_SPI, buf, len + 2);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -EIO;
 
-    cmd_data_read(fd, 0x60, buf);
+    return 0;
+}
 
-    fprintf(stderr, "SPI first 0x60:\n");
-    for (int i=0; i<0x60; i++) {
-        if ((buf[i]) >31 && buf[i]<128)
-            fprintf(stderr, "%c", buf[i]);
-        else
-            fprintf(stderr, ".");
+// deselect the chip, ends the current SPI transaction
+int spi_reset(int fd, int flags)
+{
+unsigned char buf[2] = { (flags & ~CMD_SPI_FLAG_READ) | CMD_SPI_FLAG_DISABLE, 0 };
+
+    return spi_cmd(fd, buf, 0);
+}
+
+int spi_write(int fd, int flags, const void *data, int len)
+{
+unsigned char buf[SMFI_CMD_SIZE - SMFI_CMD_DATA];
+const unsigned char *p = data;
+int n, res;
+
+    flags &= ~(CMD_SPI_FLAG_READ | CMD_SPI_FLAG_DISABLE);
+    while (len > 0) {
+        n = (len > EC_SPI_CHUNK) ? EC_SPI_CHUNK : len;
+        buf[0] = flags;
+        buf[1] = n;
+        memcpy(&buf[2], p, n);
+        res = spi_cmd(fd, buf, n);
+        if (res < 0)
+            return res;
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int spi_read(int fd, int flags, void *data, int len)
+{
+unsigned char buf[SMFI_CMD_SIZE - SMFI_CMD_DATA];
+unsigned char *p = data;
+int n, res;
+
+    flags = (flags & ~CMD_SPI_FLAG_DISABLE) | CMD_SPI_FLAG_READ;
+    while (len > 0) {
+        n = (len > EC_SPI_CHUNK) ? EC_SPI_CHUNK : len;
+        buf[0] = flags;
+        buf[1] = n;
+        // only the header goes out, the payload comes back in the window
+        res = cmd_data_write(fd, CMD_SPI, buf, 2);
+        if (res < 0)
+            return res;
+        if (cmd_result(fd) != RES_OK)
+            return -EIO;
+        if (cmd_data_read(fd, n + 2, buf) != n + 2 || buf[1] != n)
+            return -EIO;
+        memcpy(p, &buf[2], n);
+        p += n;
+        len -= n;
     }
-    fprintf(stderr, "\n");
+
+    return 0;
 }
 
 
 int get_ec_board(int fd, void *buf)
 {
-    if (cmd_write(fd, CMD_BOARD) != 1) {
+    if (cmd_write(fd, CMD_BOARD) < 0) {
         fprintf(stderr, "cmd fail\n");
-        close(fd);
         return -1;
     }
     if (cmd_data_read(fd, 0x100-2, buf) <= 0) {
         fprintf(stderr, "data fail\n");
-        close(fd);
         return -1;
     }
     return 0;
@@ -245,19 +341,162 @@ int get_ec_board(int fd, void *buf)
 
 int get_ec_version(int fd, void *buf)
 {
-    if (cmd_write(fd, CMD_VERSION) != 1) {
+    if (cmd_write(fd, CMD_VERSION) < 0) {
         fprintf(stderr, "cmd fail\n");
-        close(fd);
         return -1;
     }
     if (cmd_data_read(fd, 0x100-2, buf) <= 0) {
         fprintf(stderr, "data fail\n");
-        close(fd);
         return -1;
     }
     return 0;
 }
 
+// duty of one fan, 0 - 255
+int ec_fan_get(int fd, int index, int *duty)
+{
+unsigned char data[2] = { index, 0 };
+int res;
+
+    res = cmd_data_write(fd, CMD_FAN_GET, data, 1);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+    if (cmd_data_read(fd, 2, data) != 2)
+        return -EIO;
+    *duty = data[1];
+
+    return 0;
+}
+
+// the EC's own fan control may overwrite this on its next update
+int ec_fan_set(int fd, int index, int duty)
+{
+unsigned char data[2] = { index, duty };
+int res;
+
+    res = cmd_data_write(fd, CMD_FAN_SET, data, 2);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+
+    return 0;
+}
+
+// index is an LED or EC_LED_ALL, *max is the highest value the EC accepts
+int ec_led_get_value(int fd, int index, int *value, int *max)
+{
+unsigned char data[3] = { index, 0, 0 };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_GET_VALUE, data, 1);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+    if (cmd_data_read(fd, 3, data) != 3)
+        return -EIO;
+    *value = data[1];
+    if (max != NULL)
+        *max = data[2];
+
+    return 0;
+}
+
+int ec_led_set_value(int fd, int index, int value)
+{
+unsigned char data[2] = { index, value };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_SET_VALUE, data, 2);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+
+    return 0;
+}
+
+int ec_led_get_color(int fd, int index, unsigned char *rgb)
+{
+unsigned char data[4] = { index, 0, 0, 0 };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_GET_COLOR, data, 1);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+    if (cmd_data_read(fd, 4, data) != 4)
+        return -EIO;
+    memcpy(rgb, &data[1], 3);
+
+    return 0;
+}
+
+// EC_LED_ALL sets every LED in the same command
+int ec_led_set_color(int fd, int index, const unsigned char *rgb)
+{
+unsigned char data[4] = { index, rgb[0], rgb[1], rgb[2] };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_SET_COLOR, data, 4);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+
+    return 0;
+}
+
+int ec_led_get_mode(int fd, int layer, int *mode, int *speed)
+{
+unsigned char data[3] = { layer, 0, 0 };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_GET_MODE, data, 1);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+    if (cmd_data_read(fd, 3, data) != 3)
+        return -EIO;
+    *mode = data[1];
+    *speed = data[2];
+
+    return 0;
+}
+
+int ec_led_set_mode(int fd, int layer, int mode, int speed)
+{
+unsigned char data[3] = { layer, mode, speed };
+int res;
+
+    res = cmd_data_write(fd, CMD_LED_SET_MODE, data, 3);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+
+    return 0;
+}
+
+// writes the current LED state to the EC's flash, so use sparingly
+int ec_led_save(int fd)
+{
+int res;
+
+    res = cmd_write(fd, CMD_LED_SAVE);
+    if (res < 0)
+        return res;
+    if (cmd_result(fd) != RES_OK)
+        return -ENODEV;
+
+    return 0;
+}
+
 #if 0
     /// Read at a specific address
     pub unsafe fn read_at(&mut self, address: u32, data: &mut [u8]) -> Result<usize, Error> {
@@ -17,14 +17,102 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifndef _EC_TOOL_H
+#define _EC_TOOL_H
+
+#include <sys/types.h>
+
+#define SMFI_CMD_BASE 0xE00
+#define SMFI_CMD_SIZE 0x100
+
+#define SMFI_DBG_BASE 0xF00
+#define SMFI_DBG_SIZE 0x100
+
+#define SMFI_CMD_CMD 0x00
+#define SMFI_CMD_RES 0x01
+#define SMFI_CMD_DATA 0x02
+
+#define CMD_SPI_FLAG_READ	(1 << 0)
+#define CMD_SPI_FLAG_DISABLE	(1 << 1)
+#define CMD_SPI_FLAG_SCRATCH	(1 << 2)
+#define CMD_SPI_FLAG_BACKUP	(1 << 3)
+
+// largest SPI transfer per CMD_SPI, fills the data window after flags and length
+#define EC_SPI_CHUNK	(SMFI_CMD_SIZE - SMFI_CMD_DATA - 2)
+
+// LED index addressing every LED of the keyboard in one command
+#define EC_LED_ALL		0xff
+
+enum Command {
+    // Indicates that EC is ready to accept commands
+    CMD_NONE = 0,
+    // Probe for System76 EC protocol
+    CMD_PROBE = 1,
+    // Read board string
+    CMD_BOARD = 2,
+    // Read version string
+    CMD_VERSION = 3,
+    // Write bytes to console
+    CMD_PRINT = 4,
+    // Access SPI chip
+    CMD_SPI = 5,
+    // Reset EC
+    CMD_RESET = 6,
+    // Get fan speeds
+    CMD_FAN_GET = 7,
+    // Set fan speeds
+    CMD_FAN_SET = 8,
+    // Get keyboard map index
+    CMD_KEYMAP_GET = 9,
+    // Set keyboard map index
+    CMD_KEYMAP_SET = 10,
+    // Get LED value by index
+    CMD_LED_GET_VALUE = 11,
+    // Set LED value by index
+    CMD_LED_SET_VALUE = 12,
+    // Get LED color by index
+    CMD_LED_GET_COLOR = 13,
+    // Set LED color by index
+    CMD_LED_SET_COLOR = 14,
+    // Get LED matrix mode and speed
+    CMD_LED_GET_MODE = 15,
+    // Set LED matrix mode and speed
+    CMD_LED_SET_MODE = 16,
+    // Get key matrix state
+    CMD_MATRIX_GET = 17,
+    // Save LED settings to ROM
+    CMD_LED_SAVE = 18,
+    //TODO
+};
+
+enum Result {
+    // Command executed successfully
+    RES_OK = 0,
+    // Command failed with generic error
+    RES_ERR = 1,
+    //TODO
+};
+
+void port_set_backend(const char *name);
+
+const char *port_backend_name(void);
+
 int port_open(void);
 
+void port_close(int fd);
+
 int port_read(int fd, off_t offset, size_t len, void *buf);
 
 int port_write(int fd, off_t offset, size_t len, void *buf);
 
 int cmd_read(int fd);
 
+void ec_set_cmd_timeout(unsigned int timeout_us);
+
+unsigned int ec_cmd_last_duration(void);
+
+int cmd_wait(int fd);
+
 int cmd_write(int fd, u_int8_t cmd);
 
 int cmd_result(int fd);
@@ -33,9 +121,32 @@ int cmd_data_read(int fd, int len, void *buf);
 
 int cmd_data_write(int fd, u_int8_t cmd, void *cmd_data, int len);
 
-void spi_read(int fd);
+int spi_reset(int fd, int flags);
+
+int spi_write(int fd, int flags, const void *data, int len);
+
+int spi_read(int fd, int flags, void *data, int len);
 
 int get_ec_board(int fd, void *buf);
 
 int get_ec_version(int fd, void *buf);
 
+int ec_fan_get(int fd, int index, int *duty);
+
+int ec_fan_set(int fd, int index, int duty);
+
+int ec_led_get_value(int fd, int index, int *value, int *max);
+
+int ec_led_set_value(int fd, int index, int value);
+
+int ec_led_get_color(int fd, int index, unsigned char *rgb);
+
+int ec_led_set_color(int fd, int index, const unsigned char *rgb);
+
+int ec_led_get_mode(int fd, int layer, int *mode, int *speed);
+
+int ec_led_set_mode(int fd, int layer, int mode, int speed);
+
+int ec_led_save(int fd);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <sys/io.h>
+#define HAVE_IOPORT
+#endif
+
+#include "ec-tool.h"
+#include "ec-transport.h"
+
+
+#define ACPI_PATH_1 "/sys/bus/acpi/devices/316D4C14:00"
+#define ACPI_PATH_2 "/sys/bus/acpi/devices/PURI4543:00"
+
+static const ec_transport_t *ec_transports[] = {
+    &ec_transport_ioport,
+    &ec_transport_devport,
+    &ec_transport_sim,
+    NULL
+};
+
+
+const ec_transport_t *ec_transport_find(const char *name)
+{
+int i;
+
+    for (i=0; ec_transports[i] != NULL; i++) {
+        if (strcmp(ec_transports[i]->name, name) == 0)
+            return ec_transports[i];
+    }
+
+    return NULL;
+}
+
+// the real thing needs root and a Librem EC
+static int ec_hw_check(void)
+{
+struct stat path_stat;
+
+    if (getuid() != 0 && geteuid() != 0) {
+        fprintf(stderr, "please run as root or use sudo or similar\n");
+        return -EACCES;
+    }
+    if (stat(ACPI_PATH_1, &path_stat) != 0 &&
+        stat(ACPI_PATH_2, &path_stat) != 0) {
+        fprintf(stderr, "no Librem EC found, giving up\n");
+        return -ENODEV;
+    }
+
+    if (S_ISDIR(path_stat.st_mode))
+        fprintf(stderr, "Librem EC detected\n");
+
+    return 0;
+}
+
+//
+// /dev/port, one pread()/pwrite() per access
+//
+static int devport_open(void)
+{
+int fd;
+int res;
+
+    res = ec_hw_check();
+    if (res < 0)
+        return res;
+
+    fd = open("/dev/port", O_RDWR | O_CLOEXEC);
+    if (fd<0) {
+        perror("open()");
+        return -errno;
+    }
+
+    return fd;
+}
+
+static void devport_close(int fd)
+{
+    close(fd);
+}
+
+static int devport_read(int fd, off_t offset, size_t len, void *buf)
+{
+    return pread(fd, buf, len, offset);
+}
+
+static int devport_write(int fd, off_t offset, size_t len, void *buf)
+{
+    return pwrite(fd, buf, len, offset);
+}
+
+const ec_transport_t ec_transport_devport = {
+    .name = "devport",
+    .open = devport_open,
+    .close = devport_close,
+    .read = devport_read,
+    .write = devport_write,
+};
+
+//
+// ioperm() on the SMFI window, inb()/outb() from user space
+//
+static int ioport_open(void)
+{
+#ifdef HAVE_IOPORT
+int res;
+
+    res = ec_hw_check();
+    if (res < 0)
+        return res;
+
+    if (ioperm(SMFI_CMD_BASE, SMFI_CMD_SIZE + SMFI_DBG_SIZE, 1) != 0)
+        return -errno;
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+static void ioport_close(int fd)
+{
+#ifdef HAVE_IOPORT
+    ioperm(SMFI_CMD_BASE, SMFI_CMD_SIZE + SMFI_DBG_SIZE, 0);
+#endif
+}
+
+static int ioport_read(int fd, off_t offset, size_t len, void *buf)
+{
+#ifdef HAVE_IOPORT
+unsigned char *p = buf;
+size_t i;
+
+    // the SMFI window is address mapped, so no rep insb here
+    for (i=0; i<len; i++)
+        p[i] = inb(offset + i);
+    return len;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+static int ioport_write(int fd, off_t offset, size_t len, void *buf)
+{
+#ifdef HAVE_IOPORT
+unsigned char *p = buf;
+size_t i;
+
+    for (i=0; i<len; i++)
+        outb(p[i], offset + i);
+    return len;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+const ec_transport_t ec_transport_ioport = {
+    .name = "ioport",
+    .open = ioport_open,
+    .close = ioport_close,
+    .read = ioport_read,
+    .write = ioport_write,
+};
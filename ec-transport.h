@@ -0,0 +1,42 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_TRANSPORT_H
+#define _EC_TRANSPORT_H
+
+#include <sys/types.h>
+
+// how the SMFI window (SMFI_CMD_BASE..SMFI_DBG_BASE+SMFI_DBG_SIZE) is reached,
+// offsets passed to read/write are absolute port addresses
+typedef struct {
+    const char *name;
+    // returns a handle >= 0 or a negative error
+    int (*open)(void);
+    void (*close)(int fd);
+    int (*read)(int fd, off_t offset, size_t len, void *buf);
+    int (*write)(int fd, off_t offset, size_t len, void *buf);
+} ec_transport_t;
+
+extern const ec_transport_t ec_transport_devport;
+extern const ec_transport_t ec_transport_ioport;
+extern const ec_transport_t ec_transport_sim;
+
+const ec_transport_t *ec_transport_find(const char *name);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * All EC port traffic is serialized through one worker thread which
+ * owns the port. Jobs are queued from the main loop and their completion
+ * callbacks are dispatched back to the context they were queued from,
+ * so neither the EC busy-wait nor the port setup ever blocks the UI.
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "ec-tool.h"
+#include "ec-worker.h"
+
+typedef struct {
+	ec_job_func func;
+	gpointer data;
+	GDestroyNotify data_free;
+	ec_job_done_func done;
+	gpointer user_data;
+	GMainContext *context;
+	int result;
+} ec_job_t;
+
+static GAsyncQueue *ec_queue;
+static GThread *ec_thread;
+// sentinel to stop the worker
+static ec_job_t ec_job_quit;
+
+
+static void ec_job_free(gpointer data)
+{
+	ec_job_t *job = (ec_job_t *)data;
+
+	if (job->data_free)
+		job->data_free(job->data);
+	g_main_context_unref(job->context);
+	g_free(job);
+}
+
+static gboolean ec_job_complete(gpointer data)
+{
+	ec_job_t *job = (ec_job_t *)data;
+
+	if (job->done)
+		job->done(job->result, job->data, job->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer ec_worker_thread(gpointer data)
+{
+	ec_job_t *job;
+	int fd = -1;
+	gboolean tried = FALSE;
+
+	while ((job = g_async_queue_pop(ec_queue)) != &ec_job_quit) {
+		// open lazily, so nothing touches the EC until it is needed
+		if (!tried) {
+			fd = port_open();
+			tried = TRUE;
+		}
+		if (fd < 0)
+			job->result = -ENODEV;
+		else
+			job->result = job->func(fd, job->data);
+
+		g_main_context_invoke_full(job->context, G_PRIORITY_DEFAULT,
+			ec_job_complete, job, ec_job_free);
+	}
+
+	if (fd >= 0)
+		port_close(fd);
+
+	return NULL;
+}
+
+void ec_worker_queue(ec_job_func func, gpointer data, GDestroyNotify data_free,
+                     ec_job_done_func done, gpointer user_data)
+{
+	ec_job_t *job;
+
+	if (ec_thread == NULL) {
+		ec_queue = g_async_queue_new();
+		ec_thread = g_thread_new("ec-worker", ec_worker_thread, NULL);
+	}
+
+	job = g_new0(ec_job_t, 1);
+	job->func = func;
+	job->data = data;
+	job->data_free = data_free;
+	job->done = done;
+	job->user_data = user_data;
+	job->context = g_main_context_ref_thread_default();
+
+	g_async_queue_push(ec_queue, job);
+}
+
+// finishes all queued jobs, then stops the worker
+void ec_worker_shutdown(void)
+{
+	if (ec_thread == NULL)
+		return;
+
+	g_async_queue_push(ec_queue, &ec_job_quit);
+	g_thread_join(ec_thread);
+	g_async_queue_unref(ec_queue);
+	ec_thread = NULL;
+	ec_queue = NULL;
+}
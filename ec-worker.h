@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EC_WORKER_H
+#define _EC_WORKER_H
+
+#include <glib.h>
+
+// runs on the EC worker thread with the open EC port
+typedef int (*ec_job_func)(int fd, gpointer data);
+
+// runs in the main loop once the job has finished
+typedef void (*ec_job_done_func)(int result, gpointer data, gpointer user_data);
+
+void ec_worker_queue(ec_job_func func, gpointer data, GDestroyNotify data_free,
+                     ec_job_done_func done, gpointer user_data);
+
+void ec_worker_shutdown(void);
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Fan curve engine. The smoothed package temperature is mapped to a duty
+ * through a piecewise linear curve; the duty follows a rising temperature
+ * right away but only drops once the temperature is FAN_CURVE_HYST below
+ * the point that raised it, so the fan does not hunt around a curve point.
+ * Each step reads the duty back from the EC and only sends CMD_FAN_SET if
+ * the target changed or the EC has overwritten it with its own curve.
+ *
+ * This is best effort: the EC protocol has no command to take the fan out
+ * of the EC's control, its own curve keeps running and overwrites the duty
+ * on its next update. Until the next step, at most FAN_CURVE_INTERVAL_MS
+ * later, the fan runs whatever the EC chose; fan_curve_t.overridden counts
+ * how often a step found that. Without a curve nothing is sent and the
+ * EC's next update takes over again.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "sysfs-attr.h"
+#include "settings.h"
+#include "ec-tool.h"
+#include "fan-curve.h"
+
+
+// "45:0,65:50,85:100", temperatures rising, duty not falling; returns the
+// number of points, 0 for an empty spec
+int fan_curve_parse(const char *spec, fan_curve_point_t *p, int max)
+{
+	const char *s = spec;
+	char *end;
+	long t, d;
+	int n = 0;
+
+	while (*s == ' ')
+		s++;
+	if (*s == 0)
+		return 0;
+
+	for (;;) {
+		if (n >= max)
+			return -E2BIG;
+		t = strtol(s, &end, 10);
+		if (end == s || *end != ':')
+			return -EINVAL;
+		s = end + 1;
+		d = strtol(s, &end, 10);
+		if (end == s)
+			return -EINVAL;
+		if (t < 0 || t > 120 || d < 0 || d > 100)
+			return -ERANGE;
+		if (n > 0 && (t <= p[n - 1].temp || d < p[n - 1].duty))
+			return -EINVAL;
+		p[n].temp = t;
+		p[n].duty = d;
+		n++;
+		s = end;
+		if (*s == 0)
+			break;
+		if (*s != ',')
+			return -EINVAL;
+		s++;
+	}
+
+	return n;
+}
+
+int fan_curve_format(const fan_curve_point_t *p, int n, char *buf, int len)
+{
+	int i, pos = 0;
+
+	buf[0] = 0;
+	for (i = 0; i < n && pos < len; i++)
+		pos += snprintf(buf + pos, len - pos, "%s%d:%d", (i > 0) ? "," : "", p[i].temp, p[i].duty);
+
+	return (pos < len) ? 0 : -ENOSPC;
+}
+
+// duty in percent, flat outside the first and last point
+int fan_curve_eval(const fan_curve_point_t *p, int n, double temp)
+{
+	int i;
+
+	if (n == 0)
+		return -1;
+	if (temp <= p[0].temp)
+		return p[0].duty;
+
+	for (i = 1; i < n; i++) {
+		if (temp < p[i].temp)
+			return p[i - 1].duty + (int)((temp - p[i - 1].temp) * (p[i].duty - p[i - 1].duty) /
+				(p[i].temp - p[i - 1].temp) + 0.5);
+	}
+
+	return p[n - 1].duty;
+}
+
+// a missing temperature is only an error once there is a curve
+int fan_curve_init(fan_curve_t *fc)
+{
+	memset(fc, 0, sizeof(*fc));
+
+	if (sysfs_class_find(THERMAL_CLASS_PATH, "type", "x86_pkg_temp", "temp",
+	    fc->temp_path, sizeof(fc->temp_path)) < 0)
+		fc->temp_path[0] = 0;
+	if (sysfs_class_find(HWMON_CLASS_PATH, "name", "librem_ec", "fan1_input",
+	    fc->rpm_path, sizeof(fc->rpm_path)) < 0)
+		fc->rpm_path[0] = 0;
+
+	fc->temp = (sysfs_attr_t)SYSFS_ATTR_INIT(fc->temp_path, O_RDONLY);
+	fc->rpm = (sysfs_attr_t)SYSFS_ATTR_INIT(fc->rpm_path, O_RDONLY);
+	fc->target = -1;
+	fc->sent = -1;
+	fc->duty = -1;
+	fc->fan_rpm = -1;
+
+	return 0;
+}
+
+void fan_curve_close(fan_curve_t *fc)
+{
+	sysfs_attr_close(&fc->temp);
+	sysfs_attr_close(&fc->rpm);
+}
+
+// the smoothed temperature is kept, so switching curves does not jump
+void fan_curve_set(fan_curve_t *fc, const fan_curve_point_t *p, int n)
+{
+	memcpy(fc->p, p, n * sizeof(*p));
+	fc->n = n;
+	fc->target = -1;
+	fc->sent = -1;
+}
+
+// new target in percent, with hysteresis on the way down
+static int fan_curve_target(fan_curve_t *fc)
+{
+	int up, down;
+
+	up = fan_curve_eval(fc->p, fc->n, fc->temp_c);
+	if (fc->target < 0 || up > fc->target)
+		return up;
+
+	down = fan_curve_eval(fc->p, fc->n, fc->temp_c + FAN_CURVE_HYST);
+	if (down < fc->target)
+		return down;
+
+	return fc->target;
+}
+
+/*
+ * One control step, on the EC worker. Without a curve it only collects
+ * telemetry. Returns 1 if a new duty was sent, 0 if not, -errno.
+ */
+int fan_curve_step(fan_curve_t *fc, int fd)
+{
+	sysfs_attr_t *set[2];
+	int n = 0, raw, want, res;
+	double t;
+
+	if (fc->temp_path[0])
+		set[n++] = &fc->temp;
+	if (fc->rpm_path[0])
+		set[n++] = &fc->rpm;
+	// fc's own handles, the batch ring and counters are safe to share
+	sysfs_attr_refresh(set, n);
+	fc->steps++;
+
+	fc->fan_rpm = fc->rpm_path[0] ? sysfs_attr_int(&fc->rpm) : -1;
+	if (fc->temp_path[0] && sysfs_attr_int(&fc->temp) >= 0) {
+		t = sysfs_attr_int(&fc->temp) / 1000.;
+		fc->temp_c = fc->have_temp ? fc->temp_c + FAN_CURVE_SMOOTH * (t - fc->temp_c) : t;
+		fc->have_temp = 1;
+	}
+
+	res = ec_fan_get(fd, FAN_CURVE_FAN, &raw);
+	if (res < 0) {
+		fc->duty = -1;
+		return res;
+	}
+	fc->duty = (raw * 100 + 127) / 255;
+
+	if (fc->n == 0)
+		return 0;
+	if (fc->sent >= 0 && raw != fc->sent)
+		fc->overridden++;
+	if (!fc->have_temp)
+		return -ENODEV;
+
+	fc->target = fan_curve_target(fc);
+	want = (fc->target * 255 + 50) / 100;
+	if (want == fc->sent && raw == want)
+		return 0;
+
+	res = ec_fan_set(fd, FAN_CURVE_FAN, want);
+	if (res < 0)
+		return res;
+	fc->sent = want;
+	fc->writes++;
+
+	return 1;
+}
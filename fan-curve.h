@@ -0,0 +1,81 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _FAN_CURVE_H
+#define _FAN_CURVE_H
+
+#include <limits.h>
+
+#include "sysfs-attr.h"
+
+// ms between control steps, one FAN_GET and at most one FAN_SET each
+#define FAN_CURVE_INTERVAL_MS	500
+#define FAN_CURVE_POINTS		8
+// degree C the temperature has to fall before the duty is lowered
+#define FAN_CURVE_HYST			3
+// weight of a new temperature sample, 1 is no smoothing
+#define FAN_CURVE_SMOOTH		0.3
+// the CPU fan, the only one on Librem 14
+#define FAN_CURVE_FAN			0
+// cooler than the EC's built-in curve, see README
+#define FAN_CURVE_DEFAULT		"45:0,55:30,65:50,75:75,85:100"
+
+typedef struct {
+	int temp;				// degree C
+	int duty;				// percent
+} fan_curve_point_t;
+
+/*
+ * Everything but the curve is only touched by fan_curve_step(), which runs
+ * on the EC worker; the curve may only be changed while no step is queued.
+ */
+typedef struct {
+	int n;					// 0: leave the fan to the EC
+	fan_curve_point_t p[FAN_CURVE_POINTS];
+	char temp_path[PATH_MAX];
+	char rpm_path[PATH_MAX];
+	sysfs_attr_t temp;		// x86_pkg_temp, m degree C
+	sysfs_attr_t rpm;		// librem_ec hwmon fan1_input
+	double temp_c;			// smoothed
+	int have_temp;
+	int target;				// percent, -1 until the first step with a curve
+	int sent;				// raw duty of the last FAN_SET, -1 if none
+	// telemetry of the last step
+	int duty;				// percent as read back from the EC, -1 unknown
+	int fan_rpm;			// -1 without the hwmon driver
+	unsigned long steps;
+	unsigned long writes;
+	unsigned long overridden;	// steps that found the EC's duty instead of ours
+} fan_curve_t;
+
+int fan_curve_parse(const char *spec, fan_curve_point_t *p, int max);
+
+int fan_curve_format(const fan_curve_point_t *p, int n, char *buf, int len);
+
+int fan_curve_eval(const fan_curve_point_t *p, int n, double temp);
+
+int fan_curve_init(fan_curve_t *fc);
+
+void fan_curve_close(fan_curve_t *fc);
+
+void fan_curve_set(fan_curve_t *fc, const fan_curve_point_t *p, int n);
+
+int fan_curve_step(fan_curve_t *fc, int fd);
+
+#endif
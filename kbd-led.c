@@ -0,0 +1,270 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Per key keyboard lighting through the CMD_LED_* commands. Every command
+ * carries one LED index, so the only batching the protocol allows is
+ * EC_LED_ALL: a flush compares the wanted state with the shadow of what the
+ * EC has, and if one broadcast of the most common color plus the keys that
+ * differ from it takes fewer commands than sending each changed key, that
+ * is what goes out. A whole keyboard in one color is a single command,
+ * unchanged keys are never sent. Nothing is persisted until
+ * ec_led_save(), CMD_LED_SAVE writes the EC's flash.
+ *
+ * The Librem EC itself only answers for EC_LED_ALL, per key indices exist
+ * only where the keyboard firmware handles them. If index 0 is refused the
+ * keyboard is one zone: a single entry, always sent to EC_LED_ALL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ec-tool.h"
+#include "kbd-led.h"
+
+
+static int64_t kbd_led_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// "RRGGBB" or "#RRGGBB"
+int kbd_led_parse_color(const char *s, unsigned char *rgb)
+{
+	unsigned long v;
+	char *end;
+
+	if (*s == '#')
+		s++;
+	if (strlen(s) != 6)
+		return -EINVAL;
+	v = strtoul(s, &end, 16);
+	if (*end != 0)
+		return -EINVAL;
+	rgb[0] = v >> 16;
+	rgb[1] = v >> 8;
+	rgb[2] = v;
+
+	return 0;
+}
+
+// index EC_LED_ALL for every LED
+void kbd_led_set_color(const kbd_led_t *kl, kbd_led_state_t *want, int index, const unsigned char *rgb)
+{
+	int i;
+
+	if (index == EC_LED_ALL) {
+		for (i = 0; i < kl->n; i++)
+			memcpy(want->color[i], rgb, 3);
+	} else if (index >= 0 && index < kl->n)
+		memcpy(want->color[index], rgb, 3);
+}
+
+void kbd_led_set_value(const kbd_led_t *kl, kbd_led_state_t *want, int index, int value)
+{
+	if (value > kl->value_max)
+		value = kl->value_max;
+	if (value < 0)
+		value = 0;
+	if (index == EC_LED_ALL)
+		memset(want->value, value, kl->n);
+	else if (index >= 0 && index < kl->n)
+		want->value[index] = value;
+}
+
+void kbd_led_set_mode(const kbd_led_t *kl, kbd_led_state_t *want, int layer, int mode, int speed)
+{
+	if (layer < 0 || layer >= kl->layers)
+		return;
+	want->mode[layer][0] = mode;
+	want->mode[layer][1] = speed;
+}
+
+static int kbd_led_diff(const unsigned char *a, const unsigned char *b, int n, int size)
+{
+	int i, k = 0;
+
+	for (i = 0; i < n; i++) {
+		if (memcmp(a + i * size, b + i * size, size) != 0)
+			k++;
+	}
+
+	return k;
+}
+
+// entries a flush would have to send if it could not broadcast
+int kbd_led_changes(const kbd_led_t *kl, const kbd_led_state_t *want)
+{
+	return kbd_led_diff(&kl->have.color[0][0], &want->color[0][0], kl->n, 3) +
+		kbd_led_diff(kl->have.value, want->value, kl->n, 1) +
+		kbd_led_diff(&kl->have.mode[0][0], &want->mode[0][0], kl->layers, 2);
+}
+
+// index of the most common entry, *others is how many differ from it
+static int kbd_led_majority(const unsigned char *v, int n, int size, int *others)
+{
+	int i, j, k, best = 0, best_k = 0;
+
+	for (i = 0; i < n && best_k <= (n - i); i++) {
+		k = 0;
+		for (j = i; j < n; j++) {
+			if (memcmp(v + i * size, v + j * size, size) == 0)
+				k++;
+		}
+		if (k > best_k) {
+			best = i;
+			best_k = k;
+		}
+	}
+	*others = n - best_k;
+
+	return best;
+}
+
+static int kbd_led_send(kbd_led_t *kl, int fd, int index, const unsigned char *v, int size)
+{
+	if (kl->zone)
+		index = EC_LED_ALL;
+	if (index == EC_LED_ALL)
+		kl->broadcast++;
+	if (size == 3)
+		return ec_led_set_color(fd, index, v);
+
+	return ec_led_set_value(fd, index, v[0]);
+}
+
+// bring have[] to want[] for colors (size 3) or values (size 1)
+static int kbd_led_sync(kbd_led_t *kl, int fd, unsigned char *have, const unsigned char *want, int size)
+{
+	int i, best, others, changed, cmds = 0, res;
+
+	changed = kbd_led_diff(have, want, kl->n, size);
+	if (changed == 0)
+		return 0;
+
+	best = kbd_led_majority(want, kl->n, size, &others);
+	if (1 + others < changed) {
+		res = kbd_led_send(kl, fd, EC_LED_ALL, want + best * size, size);
+		if (res < 0)
+			return res;
+		for (i = 0; i < kl->n; i++)
+			memcpy(have + i * size, want + best * size, size);
+		cmds++;
+	}
+
+	for (i = 0; i < kl->n; i++) {
+		if (memcmp(have + i * size, want + i * size, size) == 0)
+			continue;
+		res = kbd_led_send(kl, fd, i, want + i * size, size);
+		if (res < 0)
+			return res;
+		memcpy(have + i * size, want + i * size, size);
+		cmds++;
+	}
+
+	return cmds;
+}
+
+// fills the shadow and finds out how many LEDs and layers there are,
+// -ENODEV if the EC has no keyboard LEDs at all
+int kbd_led_load(kbd_led_t *kl, int fd)
+{
+	int i, value, max, mode, speed, res;
+
+	memset(kl, 0, sizeof(*kl));
+	for (i = 0; i < KBD_LED_MAX; i++) {
+		res = ec_led_get_color(fd, i, kl->have.color[i]);
+		if (res == -ENODEV)
+			break;
+		if (res < 0)
+			return res;
+		res = ec_led_get_value(fd, i, &value, &max);
+		if (res < 0)
+			return res;
+		kl->have.value[i] = value;
+		kl->value_max = max;
+	}
+	kl->n = i;
+	if (kl->n == 0) {
+		res = ec_led_get_color(fd, EC_LED_ALL, kl->have.color[0]);
+		if (res < 0)
+			return res;
+		res = ec_led_get_value(fd, EC_LED_ALL, &value, &max);
+		if (res < 0)
+			return res;
+		kl->have.value[0] = value;
+		kl->value_max = max;
+		kl->n = 1;
+		kl->zone = 1;
+	}
+
+	for (i = 0; i < KBD_LED_LAYERS; i++) {
+		res = ec_led_get_mode(fd, i, &mode, &speed);
+		if (res == -ENODEV)
+			break;
+		if (res < 0)
+			return res;
+		kl->have.mode[i][0] = mode;
+		kl->have.mode[i][1] = speed;
+	}
+	kl->layers = i;
+
+	return 0;
+}
+
+// returns the commands it took, on error the shadow keeps what got through
+int kbd_led_flush(kbd_led_t *kl, int fd, const kbd_led_state_t *want)
+{
+	int64_t start;
+	int i, cmds = 0, res;
+
+	start = kbd_led_now_us();
+	kl->broadcast = 0;
+
+	res = kbd_led_sync(kl, fd, &kl->have.color[0][0], &want->color[0][0], 3);
+	if (res >= 0) {
+		cmds += res;
+		res = kbd_led_sync(kl, fd, kl->have.value, want->value, 1);
+	}
+	if (res >= 0) {
+		cmds += res;
+		for (i = 0; i < kl->layers; i++) {
+			if (memcmp(kl->have.mode[i], want->mode[i], 2) == 0)
+				continue;
+			res = ec_led_set_mode(fd, i, want->mode[i][0], want->mode[i][1]);
+			if (res < 0)
+				break;
+			memcpy(kl->have.mode[i], want->mode[i], 2);
+			cmds++;
+		}
+	}
+
+	kl->cmds = cmds;
+	kl->flush_us = kbd_led_now_us() - start;
+	kl->flushes++;
+	kl->total_cmds += cmds;
+
+	return (res < 0) ? res : cmds;
+}
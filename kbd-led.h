@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _KBD_LED_H
+#define _KBD_LED_H
+
+#include <stdint.h>
+
+// highest LED index below EC_LED_ALL that is probed
+#define KBD_LED_MAX			128
+#define KBD_LED_LAYERS		4
+
+// what the keyboard shows, one entry per LED index and per layer
+typedef struct {
+	unsigned char color[KBD_LED_MAX][3];
+	unsigned char value[KBD_LED_MAX];
+	unsigned char mode[KBD_LED_LAYERS][2];	// mode, speed
+} kbd_led_state_t;
+
+/*
+ * Shadow of the keyboard LEDs as the EC was last told or reported them.
+ * Only kbd_led_load() and kbd_led_flush() touch it, callers edit their own
+ * kbd_led_state_t and hand it to kbd_led_flush().
+ */
+typedef struct {
+	int n;					// LEDs the EC answers for, 0 before kbd_led_load()
+	int zone;				// no per key LEDs, entry 0 is the whole keyboard
+	int layers;
+	int value_max;
+	kbd_led_state_t have;
+	// the last flush
+	int cmds;				// EC commands it took
+	int broadcast;			// of those sent to EC_LED_ALL
+	int64_t flush_us;
+	unsigned long flushes;
+	unsigned long total_cmds;
+} kbd_led_t;
+
+int kbd_led_parse_color(const char *s, unsigned char *rgb);
+
+void kbd_led_set_color(const kbd_led_t *kl, kbd_led_state_t *want, int index, const unsigned char *rgb);
+
+void kbd_led_set_value(const kbd_led_t *kl, kbd_led_state_t *want, int index, int value);
+
+void kbd_led_set_mode(const kbd_led_t *kl, kbd_led_state_t *want, int layer, int mode, int speed);
+
+int kbd_led_changes(const kbd_led_t *kl, const kbd_led_state_t *want);
+
+int kbd_led_load(kbd_led_t *kl, int fd);
+
+int kbd_led_flush(kbd_led_t *kl, int fd, const kbd_led_state_t *want);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Key matrix scanner on top of CMD_MATRIX_GET. Every poll is one command
+ * round trip; successive snapshots are compared byte by byte and only
+ * rows that differ are looked at bit by bit. A change is stamped with the
+ * time the poll returned and the gap to the poll before, which bounds the
+ * scan to host latency. Keys changing again within KEY_MATRIX_CHATTER_US
+ * are chattering, a snapshot in which two rows share two or more pressed
+ * columns can contain ghost keys.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ec-tool.h"
+#include "key-matrix.h"
+
+
+int64_t key_matrix_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void key_matrix_init(key_matrix_t *km)
+{
+	memset(km, 0, sizeof(*km));
+}
+
+int key_matrix_pressed(const key_matrix_t *km, int row, int col)
+{
+	if (row < 0 || row >= km->rows || col < 0 || col >= km->cols)
+		return 0;
+
+	return (km->state[row * km->row_bytes + col / 8] >> (col % 8)) & 1;
+}
+
+// polls per second since the first one
+double key_matrix_rate(const key_matrix_t *km)
+{
+	if (km->stats.polls < 2 || km->stats.last_us <= km->stats.first_us)
+		return 0.;
+
+	return (km->stats.polls - 1) * 1e6 / (km->stats.last_us - km->stats.first_us);
+}
+
+static int key_matrix_ghosting(const uint8_t *state, int rows, int row_bytes)
+{
+	int r1, r2, b, common;
+	uint8_t m;
+
+	for (r1 = 0; r1 < rows; r1++) {
+		for (r2 = r1 + 1; r2 < rows; r2++) {
+			common = 0;
+			for (b = 0; b < row_bytes; b++) {
+				m = state[r1 * row_bytes + b] & state[r2 * row_bytes + b];
+				common += __builtin_popcount(m);
+			}
+			if (common >= 2)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+// the first poll only learns the geometry and the keys already down
+static int key_matrix_read(key_matrix_t *km, int fd, uint8_t *data)
+{
+	int len, rows, cols;
+
+	if (cmd_write(fd, CMD_MATRIX_GET) < 0)
+		return -EIO;
+	if (cmd_result(fd) != RES_OK)
+		return -ENODEV;
+
+	len = (km->rows > 0) ? 2 + km->rows * km->row_bytes : SMFI_CMD_SIZE - SMFI_CMD_DATA;
+	if (cmd_data_read(fd, len, data) != len)
+		return -EIO;
+
+	rows = data[0];
+	cols = data[1];
+	if (rows == 0 || rows > KEY_MATRIX_MAX_ROWS || cols == 0 || cols > KEY_MATRIX_MAX_COLS ||
+	    rows * ((cols + 7) / 8) > KEY_MATRIX_MAX_BYTES)
+		return -EPROTO;
+	if (km->rows > 0 && (rows != km->rows || cols != km->cols))
+		return -EPROTO;
+
+	return 0;
+}
+
+/*
+ * One poll, fills in at most max events and returns how many, or -errno.
+ */
+int key_matrix_poll(key_matrix_t *km, int fd, key_event_t *ev, int max)
+{
+	uint8_t data[SMFI_CMD_SIZE];
+	uint8_t *snap = data + 2;
+	key_matrix_stats_t *st = &km->stats;
+	int64_t start, now, cost, window;
+	int first = (km->rows == 0);
+	int r, c, b, n = 0, ghost, res;
+	uint8_t diff;
+
+	start = key_matrix_now_us();
+	res = key_matrix_read(km, fd, data);
+	now = key_matrix_now_us();
+	if (res < 0) {
+		st->errors++;
+		return res;
+	}
+
+	cost = now - start;
+	if (st->polls == 0 || cost < st->cost_min_us)
+		st->cost_min_us = cost;
+	if (cost > st->cost_max_us)
+		st->cost_max_us = cost;
+	st->cost_sum_us += cost;
+	window = (st->polls > 0) ? now - st->last_us : 0;
+	if (window > st->window_max_us)
+		st->window_max_us = window;
+	if (st->polls == 0)
+		st->first_us = now;
+	st->last_us = now;
+	st->polls++;
+
+	if (first) {
+		km->rows = data[0];
+		km->cols = data[1];
+		km->row_bytes = (km->cols + 7) / 8;
+		memcpy(km->state, snap, km->rows * km->row_bytes);
+		return 0;
+	}
+	if (memcmp(km->state, snap, km->rows * km->row_bytes) == 0)
+		return 0;
+
+	ghost = key_matrix_ghosting(snap, km->rows, km->row_bytes);
+	if (ghost)
+		st->ghosts++;
+
+	for (r = 0; r < km->rows; r++) {
+		for (b = 0; b < km->row_bytes; b++) {
+			diff = km->state[r * km->row_bytes + b] ^ snap[r * km->row_bytes + b];
+			for (c = b * 8; diff != 0; c++, diff >>= 1) {
+				if (!(diff & 1) || c >= km->cols)
+					continue;
+				st->events++;
+				if (n >= max) {
+					st->dropped++;
+					continue;
+				}
+				ev[n].time_us = now;
+				ev[n].window_us = (uint32_t)window;
+				ev[n].row = r;
+				ev[n].col = c;
+				ev[n].flags = ((snap[r * km->row_bytes + b] >> (c % 8)) & 1) ? KEY_EV_PRESS : 0;
+				if (ghost)
+					ev[n].flags |= KEY_EV_GHOST;
+				if (km->changed_us[r][c] != 0 && now - km->changed_us[r][c] < KEY_MATRIX_CHATTER_US) {
+					ev[n].flags |= KEY_EV_CHATTER;
+					st->chatter++;
+					if (km->chatter[r][c] < UINT16_MAX)
+						km->chatter[r][c]++;
+				}
+				km->changed_us[r][c] = now;
+				n++;
+			}
+		}
+	}
+	memcpy(km->state, snap, km->rows * km->row_bytes);
+
+	return n;
+}
+
+/*
+ * Poll back to back until until_us or until ev is full, for running as
+ * one EC worker job. Returns the number of events or -errno.
+ */
+int key_matrix_scan(key_matrix_t *km, int fd, key_event_t *ev, int max, int64_t until_us)
+{
+	int n = 0, res;
+
+	do {
+		res = key_matrix_poll(km, fd, ev + n, max - n);
+		if (res < 0)
+			return (n > 0) ? n : res;
+		n += res;
+	} while (n < max && key_matrix_now_us() < until_us);
+
+	return n;
+}
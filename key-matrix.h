@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _KEY_MATRIX_H
+#define _KEY_MATRIX_H
+
+#include <stdint.h>
+
+#include "ec-tool.h"
+
+#define KEY_MATRIX_MAX_ROWS		32
+#define KEY_MATRIX_MAX_COLS		32
+// CMD_MATRIX_GET answers rows, cols and then the rows in the data window
+#define KEY_MATRIX_MAX_BYTES	(SMFI_CMD_SIZE - SMFI_CMD_DATA - 2)
+// us, a key that changes again sooner than this is chattering
+#define KEY_MATRIX_CHATTER_US	10000
+// ms one scan keeps the EC before other jobs get their turn
+#define KEY_MATRIX_BATCH_MS		50
+
+#define KEY_EV_PRESS			(1 << 0)
+#define KEY_EV_CHATTER			(1 << 1)
+#define KEY_EV_GHOST			(1 << 2)	// three corners of a rectangle were down
+
+typedef struct {
+	int64_t time_us;		// CLOCK_MONOTONIC when the poll that saw it returned
+	uint32_t window_us;		// since the poll before, the change happened in between
+	uint8_t row;
+	uint8_t col;
+	uint8_t flags;
+} key_event_t;
+
+typedef struct {
+	unsigned long polls;
+	unsigned long errors;
+	unsigned long events;
+	unsigned long dropped;		// did not fit into the caller's buffer
+	unsigned long chatter;
+	unsigned long ghosts;
+	int64_t cost_min_us;		// one CMD_MATRIX_GET round trip
+	int64_t cost_max_us;
+	int64_t cost_sum_us;
+	int64_t window_max_us;		// worst gap between two polls
+	int64_t first_us;
+	int64_t last_us;
+} key_matrix_stats_t;
+
+typedef struct {
+	int rows;				// 0 until the first poll
+	int cols;
+	int row_bytes;
+	uint8_t state[KEY_MATRIX_MAX_BYTES];
+	int64_t changed_us[KEY_MATRIX_MAX_ROWS][KEY_MATRIX_MAX_COLS];
+	uint16_t chatter[KEY_MATRIX_MAX_ROWS][KEY_MATRIX_MAX_COLS];
+	key_matrix_stats_t stats;
+} key_matrix_t;
+
+int64_t key_matrix_now_us(void);
+
+void key_matrix_init(key_matrix_t *km);
+
+int key_matrix_poll(key_matrix_t *km, int fd, key_event_t *ev, int max);
+
+int key_matrix_scan(key_matrix_t *km, int fd, key_event_t *ev, int max, int64_t until_us);
+
+int key_matrix_pressed(const key_matrix_t *km, int row, int col);
+
+double key_matrix_rate(const key_matrix_t *km);
+
+#endif
@@ -0,0 +1,481 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * make bench: timings of the hot paths as JSON, so that builds can be
+ * compared. Everything runs against stand-ins, a fake sysfs tree on tmpfs
+ * (LIBREM_SYSFS_ROOT) and the EC simulator, so results do not depend on
+ * the machine's battery or EC firmware:
+ *   sysfs_read       - one cached attribute re-read with pread()
+ *   sysfs_write      - settings_set_int(), the write and the read back
+ *   ec_probe         - CMD_PROBE round trip, result and data read
+ *   ec_matrix_poll   - one key matrix poll as the scanner does it
+ *   ec_kbd_fill      - whole keyboard to a new color through kbd_led_flush()
+ *   settings_refresh - re-reading every setting, as a page refresh does
+ *   first_frame      - exec of librem-control to its first painted frame
+ *   first_frame_eager - the same with every page built at start, as before
+ *                      pages were built on first show
+ * The last two need a display, e.g. xvfb-run or GDK_BACKEND=broadway, and
+ * are reported as skipped without one.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "ec-tool.h"
+#include "settings.h"
+#include "key-matrix.h"
+#include "kbd-led.h"
+
+#define BENCH_ITERATIONS	2000
+#define BENCH_FRAME_RUNS	10
+// ms a GUI start may take before it counts as hung
+#define BENCH_FRAME_TIMEOUT	20000
+#define BENCH_GUI			"./librem-control"
+
+typedef struct {
+	const char *name;
+	const char *kind;		// "micro" or "macro"
+	const char *unit;		// "us" or "ms"
+	int n;
+	double *v;
+	const char *skipped;	// reason, NULL if it ran
+} bench_result_t;
+
+static char bench_root[PATH_MAX];
+static int bench_first = 1;
+
+
+static double bench_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// nearest rank
+static double bench_pct(const double *v, int n, double pct)
+{
+	int i = (int)(pct / 100. * n + 0.5) - 1;
+
+	if (i < 0)
+		i = 0;
+	if (i >= n)
+		i = n - 1;
+
+	return v[i];
+}
+
+static void bench_report(bench_result_t *r)
+{
+	printf("%s\n    { \"name\": \"%s\", \"kind\": \"%s\", \"unit\": \"%s\", \"n\": %d",
+		bench_first ? "" : ",", r->name, r->kind, r->unit, r->n);
+	bench_first = 0;
+	if (r->skipped != NULL || r->n == 0) {
+		printf(", \"skipped\": \"%s\" }", r->skipped ? r->skipped : "no samples");
+		return;
+	}
+
+	qsort(r->v, r->n, sizeof(double), bench_cmp);
+	printf(", \"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, \"max\": %.3f }",
+		r->v[0], bench_pct(r->v, r->n, 50.), bench_pct(r->v, r->n, 99.), r->v[r->n - 1]);
+}
+
+static bench_result_t *bench_new(const char *name, const char *kind, const char *unit, int n)
+{
+	static bench_result_t r;
+
+	r.name = name;
+	r.kind = kind;
+	r.unit = unit;
+	r.n = 0;
+	r.skipped = NULL;
+	r.v = realloc(r.v, n * sizeof(double));
+
+	return &r;
+}
+
+//
+// fake sysfs tree
+//
+static int bench_mkdirs(char *path)
+{
+	char *p;
+
+	for (p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		*p = 0;
+		if (mkdir(path, 0755) < 0 && errno != EEXIST)
+			return -errno;
+		*p = '/';
+	}
+
+	return 0;
+}
+
+static int bench_tree_file(const char *path, const char *value)
+{
+	char buf[PATH_MAX];
+	FILE *f;
+
+	snprintf(buf, sizeof(buf), "%s%s", bench_root, path);
+	if (bench_mkdirs(buf) < 0)
+		return -errno;
+	f = fopen(buf, "w");
+	if (f == NULL)
+		return -errno;
+	fputs(value, f);
+	fclose(f);
+
+	return 0;
+}
+
+// three digit values throughout, pwrite() at 0 does not truncate a plain file
+static int bench_tree_create(const char *dir)
+{
+	const char *value;
+	int i, res;
+
+	snprintf(bench_root, sizeof(bench_root), "%s/lc-bench.XXXXXX", dir);
+	if (mkdtemp(bench_root) == NULL)
+		return -errno;
+
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (i == SETTING_BAT_STATUS)
+			value = "Discharging\n";
+		else if (i == SETTING_LED_AIRPLANE_TRIGGER)
+			value = "none [rfkill-none] phy0rx phy0tx\n";
+		else if (i == SETTING_CPU_PL1 || i == SETTING_CPU_PL2)
+			value = "15000000\n";
+		else
+			value = "100\n";
+		res = bench_tree_file(settings[i].attr.path, value);
+		if (res < 0)
+			return res;
+	}
+	sysfs_attr_set_root(bench_root);
+
+	return 0;
+}
+
+// the files we made and every directory that is empty after that
+static void bench_tree_remove(void)
+{
+	char buf[PATH_MAX];
+	size_t root_len = strlen(bench_root);
+	char *p;
+	int i;
+
+	if (root_len == 0)
+		return;
+	for (i = 0; i < SETTING_NUM; i++) {
+		snprintf(buf, sizeof(buf), "%s%s", bench_root, settings[i].attr.path);
+		unlink(buf);
+		while ((p = strrchr(buf, '/')) != NULL && (size_t)(p - buf) > root_len) {
+			*p = 0;
+			if (rmdir(buf) < 0)
+				break;
+		}
+	}
+	rmdir(bench_root);
+}
+
+//
+// micro benchmarks
+//
+static void bench_sysfs(int n)
+{
+	bench_result_t *r;
+	sysfs_attr_t *attr = &settings[SETTING_BAT_SOC].attr;
+	double t;
+	int i;
+
+	r = bench_new("sysfs_read", "micro", "us", n);
+	sysfs_attr_read(attr);
+	for (i = 0; i < n; i++) {
+		t = bench_now_us();
+		if (sysfs_attr_read(attr) < 0) {
+			r->skipped = strerror(attr->err);
+			break;
+		}
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+
+	r = bench_new("sysfs_write", "micro", "us", n);
+	for (i = 0; i < n; i++) {
+		t = bench_now_us();
+		if (settings_set_int(SETTING_LED_KBD, 100 + i % 100) < 0) {
+			r->skipped = "write failed";
+			break;
+		}
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+}
+
+static void bench_ec(int n)
+{
+	static kbd_led_t kl;
+	static kbd_led_state_t want;
+	static key_matrix_t km;
+	unsigned char data[3], rgb[3];
+	bench_result_t *r;
+	double t;
+	int fd, i;
+
+	fd = port_open();
+	if (fd < 0) {
+		r = bench_new("ec_probe", "micro", "us", 0);
+		r->skipped = strerror(-fd);
+		bench_report(r);
+		return;
+	}
+
+	r = bench_new("ec_probe", "micro", "us", n);
+	for (i = 0; i < n; i++) {
+		t = bench_now_us();
+		if (cmd_write(fd, CMD_PROBE) < 0 || cmd_result(fd) != RES_OK ||
+		    cmd_data_read(fd, sizeof(data), data) != sizeof(data)) {
+			r->skipped = "EC command failed";
+			break;
+		}
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+
+	r = bench_new("ec_matrix_poll", "micro", "us", n);
+	key_matrix_init(&km);
+	for (i = 0; i < n; i++) {
+		t = bench_now_us();
+		if (key_matrix_poll(&km, fd, NULL, 0) < 0) {
+			r->skipped = "EC command failed";
+			break;
+		}
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+
+	r = bench_new("ec_kbd_fill", "micro", "us", n);
+	if (kbd_led_load(&kl, fd) < 0)
+		r->skipped = "no keyboard LEDs";
+	want = kl.have;
+	for (i = 0; i < n && r->skipped == NULL; i++) {
+		rgb[0] = i;
+		rgb[1] = i >> 8;
+		rgb[2] = 0x80;
+		kbd_led_set_color(&kl, &want, EC_LED_ALL, rgb);
+		t = bench_now_us();
+		if (kbd_led_flush(&kl, fd, &want) < 0) {
+			r->skipped = "EC command failed";
+			break;
+		}
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+
+	port_close(fd);
+}
+
+//
+// macro benchmarks
+//
+static void bench_refresh(int n)
+{
+	bench_result_t *r;
+	double t;
+	int i;
+
+	r = bench_new("settings_refresh", "macro", "us", n);
+	settings_refresh();
+	for (i = 0; i < n; i++) {
+		t = bench_now_us();
+		settings_refresh();
+		r->v[r->n++] = bench_now_us() - t;
+	}
+	bench_report(r);
+}
+
+// exec to the "first frame after" debug line, -1 if it never came
+static double bench_frame_once(const char *gui, int eager)
+{
+	char buf[4096];
+	struct pollfd pfd;
+	double start, t = -1;
+	int pipefd[2], len = 0, res, status;
+	pid_t pid;
+
+	if (pipe(pipefd) < 0)
+		return -1;
+
+	start = bench_now_us();
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		dup2(pipefd[1], STDERR_FILENO);
+		close(pipefd[0]);
+		close(pipefd[1]);
+		// same fake tree, no daemon, no battery history in the user's home
+		setenv("LIBREM_SYSFS_ROOT", bench_root, 1);
+		setenv("XDG_STATE_HOME", "/dev/null", 1);
+		setenv("DBUS_SYSTEM_BUS_ADDRESS", "unix:path=/nonexistent", 1);
+		setenv("LIBREM_EC_BACKEND", "sim", 1);
+		setenv("LIBREM_CONTROL_BENCH", "1", 1);
+		setenv("G_MESSAGES_DEBUG", "all", 1);
+		if (eager)
+			setenv("LIBREM_CONTROL_EAGER_PAGES", "1", 1);
+		execl(gui, gui, NULL);
+		_exit(127);
+	}
+	close(pipefd[1]);
+
+	pfd.fd = pipefd[0];
+	pfd.events = POLLIN;
+	while (t < 0 && len < (int)sizeof(buf) - 1) {
+		if (poll(&pfd, 1, BENCH_FRAME_TIMEOUT) <= 0)
+			break;
+		res = read(pipefd[0], buf + len, sizeof(buf) - 1 - len);
+		if (res <= 0)
+			break;
+		len += res;
+		buf[len] = 0;
+		if (strstr(buf, "first frame after") != NULL)
+			t = (bench_now_us() - start) / 1000.;
+		// keep the tail, the line may still be incomplete
+		if (t < 0 && len > (int)sizeof(buf) / 2) {
+			memmove(buf, buf + len - 64, 64);
+			len = 64;
+		}
+	}
+	close(pipefd[0]);
+
+	if (t < 0)
+		kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	return t;
+}
+
+static void bench_frame(const char *name, const char *gui, int eager, int n)
+{
+	bench_result_t *r;
+	double t;
+	int i;
+
+	r = bench_new(name, "macro", "ms", n);
+	if (access(gui, X_OK) < 0)
+		r->skipped = "librem-control not built";
+	else if (getenv("DISPLAY") == NULL && getenv("WAYLAND_DISPLAY") == NULL &&
+	         getenv("GDK_BACKEND") == NULL)
+		r->skipped = "no display";
+
+	for (i = 0; i < n && r->skipped == NULL; i++) {
+		t = bench_frame_once(gui, eager);
+		if (t < 0) {
+			r->skipped = "no first frame";
+			break;
+		}
+		r->v[r->n++] = t;
+	}
+	bench_report(r);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/dev/shm";
+	const char *backend = "sim";
+	const char *gui = BENCH_GUI;
+	int n = BENCH_ITERATIONS;
+	int frames = BENCH_FRAME_RUNS;
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "n:f:d:b:g:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				n = atoi(optarg);
+				break;
+			case 'f':
+				frames = atoi(optarg);
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			case 'b':
+				backend = optarg;
+				break;
+			case 'g':
+				gui = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] [-f gui starts] [-d tmpfs dir]\n"
+					"       [-b devport|ioport|sim] [-g librem-control binary]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (n < 1 || frames < 0) {
+		fprintf(stderr, "need at least one iteration\n");
+		return 1;
+	}
+	if (access(dir, W_OK) < 0)
+		dir = (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+
+	res = bench_tree_create(dir);
+	if (res < 0) {
+		fprintf(stderr, "%s: %s\n", dir, strerror(-res));
+		bench_tree_remove();
+		return 1;
+	}
+	port_set_backend(backend);
+
+	printf("{ \"suite\": \"librem-control\", \"ec_backend\": \"%s\", \"io_uring\": %s,\n"
+		"  \"results\": [", backend,
+#ifdef HAVE_LIBURING
+		"true"
+#else
+		"false"
+#endif
+		);
+	bench_sysfs(n);
+	bench_ec(n);
+	bench_refresh(n);
+	bench_frame("first_frame", gui, 0, frames);
+	bench_frame("first_frame_eager", gui, 1, frames);
+	printf("\n  ]\n}\n");
+
+	bench_tree_remove();
+
+	return 0;
+}
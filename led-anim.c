@@ -0,0 +1,417 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * RGB notification LED animation engine. One thread sleeps on a timerfd
+ * and an eventfd for new patterns. Each wakeup computes the color for the
+ * current point of the pattern, writes only the channels whose value
+ * changed and arms the timer for the next time a value can change: the
+ * next key for blinking, the time one brightness step takes for fades,
+ * never more often than LED_ANIM_MAX_HZ. A solid color or the end of a
+ * pattern that does not loop leaves the thread asleep until the next one.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <limits.h>
+
+#include "sysfs-attr.h"
+#include "led-anim.h"
+
+
+static int64_t led_anim_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int led_parse_rgb(const char *s, uint8_t *rgb)
+{
+	unsigned long v;
+	char *end;
+
+	if (*s == '#')
+		s++;
+	v = strtoul(s, &end, 16);
+	if (end - s != 6 || (*end != 0 && *end != ' ' && *end != ','))
+		return -EINVAL;
+	rgb[0] = v >> 16;
+	rgb[1] = v >> 8;
+	rgb[2] = v;
+
+	return 0;
+}
+
+/*
+ * "off", "solid RRGGBB", "blink RRGGBB [MS]", "breathe RRGGBB [MS]",
+ * "fade RRGGBB RRGGBB [MS]" or "keys MS:RRGGBB,MS:RRGGBB,... [loop]";
+ * MS is the period, for fade the duration.
+ */
+int led_pattern_parse(const char *spec, led_pattern_t *p)
+{
+	char name[16], c1[16], c2[16], extra[16];
+	uint8_t a[3] = { 0, 0, 0 }, b[3] = { 0, 0, 0 };
+	const char *s;
+	char *end;
+	long ms = LED_ANIM_DEF_PERIOD;
+	int n;
+
+	memset(p, 0, sizeof(*p));
+	n = sscanf(spec, "%15s %15s %15s %15s", name, c1, c2, extra);
+	if (n < 1)
+		return -EINVAL;
+
+	if (strcmp(name, "keys") == 0) {
+		if (n < 2)
+			return -EINVAL;
+		s = spec + strspn(spec, " ") + 4;
+		s += strspn(s, " ");
+		while (*s != 0 && *s != ' ') {
+			if (p->n >= LED_ANIM_MAX_KEYS)
+				return -E2BIG;
+			ms = strtol(s, &end, 10);
+			if (end == s || *end != ':' || ms < 0 || (p->n > 0 && ms <= p->k[p->n - 1].t_ms))
+				return -EINVAL;
+			if (led_parse_rgb(end + 1, p->k[p->n].rgb) < 0)
+				return -EINVAL;
+			p->k[p->n++].t_ms = ms;
+			s = end + 1 + strcspn(end + 1, ", ");
+			if (*s == ',')
+				s++;
+		}
+		s += strspn(s, " ");
+		p->loop = (strcmp(s, "loop") == 0);
+		if (*s != 0 && !p->loop)
+			return -EINVAL;
+		p->interp = LED_INTERP_LINEAR;
+		return (p->n > 0) ? 0 : -EINVAL;
+	}
+
+	if (strcmp(name, "off") == 0) {
+		p->n = 1;
+		return (n == 1) ? 0 : -EINVAL;
+	}
+	if (n < 2 || led_parse_rgb(c1, a) < 0)
+		return -EINVAL;
+
+	if (strcmp(name, "solid") == 0) {
+		if (n != 2)
+			return -EINVAL;
+		p->n = 1;
+		memcpy(p->k[0].rgb, a, 3);
+		return 0;
+	}
+
+	if (strcmp(name, "fade") == 0) {
+		if (n < 3 || led_parse_rgb(c2, b) < 0)
+			return -EINVAL;
+		if (n == 4)
+			ms = strtol(extra, &end, 10);
+	} else if (n == 3)
+		ms = strtol(c2, &end, 10);
+	if (n > ((strcmp(name, "fade") == 0) ? 4 : 3) || ms < 2 || ms > 3600000)
+		return -EINVAL;
+
+	if (strcmp(name, "blink") == 0) {
+		p->interp = LED_INTERP_STEP;
+		p->loop = 1;
+		p->n = 3;
+		memcpy(p->k[0].rgb, a, 3);
+		p->k[1].t_ms = ms / 2;
+		p->k[2].t_ms = ms;
+		memcpy(p->k[2].rgb, a, 3);
+	} else if (strcmp(name, "breathe") == 0) {
+		p->interp = LED_INTERP_EASE;
+		p->loop = 1;
+		p->n = 3;
+		memcpy(p->k[1].rgb, a, 3);
+		p->k[1].t_ms = ms / 2;
+		p->k[2].t_ms = ms;
+	} else if (strcmp(name, "fade") == 0) {
+		p->interp = LED_INTERP_LINEAR;
+		p->n = 2;
+		memcpy(p->k[0].rgb, a, 3);
+		memcpy(p->k[1].rgb, b, 3);
+		p->k[1].t_ms = ms;
+	} else
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Color at t us into the pattern; returns the us from the start of the
+ * pattern at which it can change next, -1 if it never does.
+ */
+static int64_t led_anim_eval(const led_pattern_t *p, int64_t t, int *rgb)
+{
+	const led_key_t *a, *b;
+	int64_t period, base = 0, ta, tb, seg, frame;
+	int i, c, f, delta = 0;
+
+	period = (int64_t)p->k[p->n - 1].t_ms * 1000;
+	if (p->n == 1 || (!p->loop && t >= period) || period == 0) {
+		a = (p->n == 1 || t >= period) ? &p->k[p->n - 1] : &p->k[0];
+		for (c = 0; c < 3; c++)
+			rgb[c] = a->rgb[c];
+		return -1;
+	}
+	if (p->loop) {
+		base = t - t % period;
+		t %= period;
+	}
+
+	for (i = 0; i < p->n - 1 && t >= (int64_t)p->k[i + 1].t_ms * 1000; i++)
+		;
+	a = &p->k[i];
+	b = &p->k[i + 1];
+	ta = (int64_t)a->t_ms * 1000;
+	tb = (int64_t)b->t_ms * 1000;
+	seg = tb - ta;
+
+	if (t < ta || p->interp == LED_INTERP_STEP) {
+		for (c = 0; c < 3; c++)
+			rgb[c] = a->rgb[c];
+		return base + ((t < ta) ? ta : tb);
+	}
+
+	// f in 1/65536 of the segment
+	f = (int)((t - ta) * 65536 / seg);
+	// smoothstep, 3f^2 - 2f^3
+	if (p->interp == LED_INTERP_EASE)
+		f = (int)((((int64_t)f * f) >> 16) * (3 * 65536 - 2 * (int64_t)f) >> 16);
+	for (c = 0; c < 3; c++) {
+		rgb[c] = a->rgb[c] + (((b->rgb[c] - a->rgb[c]) * f + 32768) >> 16);
+		if (abs(b->rgb[c] - a->rgb[c]) > delta)
+			delta = abs(b->rgb[c] - a->rgb[c]);
+	}
+
+	// one brightness step at the average slope, bounded by the frame rate
+	frame = (delta > 0) ? seg / delta : seg;
+	if (frame < 1000000 / LED_ANIM_MAX_HZ)
+		frame = 1000000 / LED_ANIM_MAX_HZ;
+	if (t + frame > tb)
+		return base + tb;
+
+	return base + t + frame;
+}
+
+static void led_anim_write(led_anim_t *la, const int *rgb)
+{
+	char buf[16];
+	int c, v;
+
+	for (c = 0; c < 3; c++) {
+		v = rgb[c] * la->max[c] / 255;
+		if (v == la->cur[c])
+			continue;
+		snprintf(buf, sizeof(buf), "%d", v);
+		if (sysfs_attr_write(&la->led[c], buf) == 0) {
+			la->cur[c] = v;
+			la->writes++;
+		} else
+			la->cur[c] = -1;
+	}
+}
+
+static void led_anim_arm(led_anim_t *la, int64_t at_us)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (at_us >= 0) {
+		its.it_value.tv_sec = at_us / 1000000;
+		its.it_value.tv_nsec = (at_us % 1000000) * 1000;
+		// zero would disarm
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+			its.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(la->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void *led_anim_thread(void *data)
+{
+	led_anim_t *la = (led_anim_t *)data;
+	struct pollfd pfd[2];
+	uint64_t val;
+	int64_t now, next;
+	int rgb[3];
+
+	prctl(PR_SET_TIMERSLACK, LED_ANIM_SLACK_NS, 0, 0, 0);
+
+	pfd[0].fd = la->event_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = la->timer_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfd[1].revents & POLLIN) {
+			if (read(la->timer_fd, &val, sizeof(val)) < 0)
+				continue;
+		}
+		now = led_anim_now_us();
+		if (pfd[0].revents & POLLIN) {
+			if (read(la->event_fd, &val, sizeof(val)) < 0)
+				continue;
+			pthread_mutex_lock(&la->lock);
+			if (la->quit) {
+				pthread_mutex_unlock(&la->lock);
+				break;
+			}
+			if (la->pending) {
+				la->pat = la->next;
+				la->pending = 0;
+				la->start_us = now;
+			}
+			pthread_mutex_unlock(&la->lock);
+		}
+		if (la->pat.n == 0)
+			continue;
+
+		la->wakeups++;
+		next = led_anim_eval(&la->pat, now - la->start_us, rgb);
+		led_anim_write(la, rgb);
+		led_anim_arm(la, (next < 0) ? -1 : la->start_us + next);
+	}
+
+	return NULL;
+}
+
+static int led_anim_max(const char *brightness)
+{
+	char path[PATH_MAX];
+	sysfs_attr_t a;
+	int val;
+
+	// ".../brightness" -> ".../max_brightness"
+	snprintf(path, sizeof(path), "%.*smax_%s", (int)(strrchr(brightness, '/') + 1 - brightness),
+		brightness, strrchr(brightness, '/') + 1);
+	a = (sysfs_attr_t)SYSFS_ATTR_INIT(path, O_RDONLY);
+	val = sysfs_attr_read_int(&a);
+	sysfs_attr_close(&a);
+
+	return (val > 0) ? val : 255;
+}
+
+// paths of the three brightness attributes, the current color is kept
+int led_anim_start(led_anim_t *la, const char *red, const char *green, const char *blue)
+{
+	const char *paths[3] = { red, green, blue };
+	int c, res;
+
+	memset(la, 0, sizeof(*la));
+	la->timer_fd = -1;
+	la->event_fd = -1;
+	for (c = 0; c < 3; c++) {
+		la->led[c] = (sysfs_attr_t)SYSFS_ATTR_INIT(paths[c], O_RDWR);
+		if (sysfs_attr_open(&la->led[c]) < 0) {
+			res = -la->led[c].err;
+			goto fail;
+		}
+		la->max[c] = led_anim_max(paths[c]);
+		la->cur[c] = -1;
+	}
+
+	la->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	la->event_fd = eventfd(0, EFD_CLOEXEC);
+	if (la->timer_fd < 0 || la->event_fd < 0) {
+		res = -errno;
+		goto fail;
+	}
+	pthread_mutex_init(&la->lock, NULL);
+	res = -pthread_create(&la->thread, NULL, led_anim_thread, la);
+	if (res < 0) {
+		pthread_mutex_destroy(&la->lock);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	if (la->timer_fd >= 0)
+		close(la->timer_fd);
+	if (la->event_fd >= 0)
+		close(la->event_fd);
+	for (c = 0; c < 3; c++)
+		sysfs_attr_close(&la->led[c]);
+	memset(la, 0, sizeof(*la));
+	la->timer_fd = -1;
+	la->event_fd = -1;
+
+	return res;
+}
+
+static void led_anim_kick(led_anim_t *la)
+{
+	uint64_t one = 1;
+
+	if (write(la->event_fd, &one, sizeof(one)) < 0)
+		return;
+}
+
+// takes effect on the next wakeup of the thread, which this causes
+void led_anim_set(led_anim_t *la, const led_pattern_t *p)
+{
+	pthread_mutex_lock(&la->lock);
+	la->next = *p;
+	la->pending = 1;
+	pthread_mutex_unlock(&la->lock);
+	led_anim_kick(la);
+}
+
+// the LED keeps the color it has, la must have been started
+void led_anim_stop(led_anim_t *la)
+{
+	int c;
+
+	if (la->event_fd < 0)
+		return;
+
+	pthread_mutex_lock(&la->lock);
+	la->quit = 1;
+	pthread_mutex_unlock(&la->lock);
+	led_anim_kick(la);
+	pthread_join(la->thread, NULL);
+	pthread_mutex_destroy(&la->lock);
+
+	close(la->timer_fd);
+	close(la->event_fd);
+	for (c = 0; c < 3; c++)
+		sysfs_attr_close(&la->led[c]);
+	memset(la, 0, sizeof(*la));
+	la->timer_fd = -1;
+	la->event_fd = -1;
+}
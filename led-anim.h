@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _LED_ANIM_H
+#define _LED_ANIM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sysfs-attr.h"
+
+#define LED_ANIM_MAX_KEYS		16
+// frames per second at most, fades slower than this need fewer wakeups
+#define LED_ANIM_MAX_HZ			30
+// ns the kernel may delay a wakeup to batch it with others
+#define LED_ANIM_SLACK_NS		(2 * 1000 * 1000)
+#define LED_ANIM_DEF_PERIOD		2000
+
+enum {
+	LED_INTERP_STEP = 0,	// jump at each key, blink
+	LED_INTERP_LINEAR,		// fade
+	LED_INTERP_EASE,		// smoothstep, breathe
+};
+
+typedef struct {
+	uint32_t t_ms;			// since the start of the pattern
+	uint8_t rgb[3];
+} led_key_t;
+
+// every pattern is a list of keys; looping ones repeat after the last key
+typedef struct {
+	int n;
+	led_key_t k[LED_ANIM_MAX_KEYS];
+	int interp;
+	int loop;
+} led_pattern_t;
+
+typedef struct {
+	sysfs_attr_t led[3];	// red, green, blue brightness, kept open
+	int max[3];				// max_brightness
+	int cur[3];				// last written, -1 unknown
+	int timer_fd;
+	int event_fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	led_pattern_t next;		// handed over by led_anim_set()
+	int pending;
+	int quit;
+	// worker only
+	led_pattern_t pat;
+	int64_t start_us;
+	unsigned long wakeups;
+	unsigned long writes;
+} led_anim_t;
+
+int led_pattern_parse(const char *spec, led_pattern_t *p);
+
+int led_anim_start(led_anim_t *la, const char *red, const char *green, const char *blue);
+
+void led_anim_set(led_anim_t *la, const led_pattern_t *p);
+
+void led_anim_stop(led_anim_t *la);
+
+#endif
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <stdbool.h>
 
 //#include <adwaita.h>
@@ -32,19 +33,44 @@
 #include <glib.h>
 
 #include "ec-tool.h"
-
-#define LED_RED_PATH			"/sys/class/leds/red:status"
-#define LED_GREEN_PATH			"/sys/class/leds/green:status"
-#define LED_BLUE_PATH			"/sys/class/leds/blue:status"
-#define LED_AIRPLANE_PATH		"/sys/class/leds/librem_ec:airplane"
-#define LED_KBD_BACKLIGHT		"/sys/class/leds/librem_ec:kbd_backlight"
-
-#define BAT_SOC					"/sys/class/power_supply/BAT0/capacity"
-#define BAT_START_THRESHOLD_PATH	"/sys/class/power_supply/BAT0/charge_control_start_threshold"
-#define BAT_END_THRESHOLD_PATH		"/sys/class/power_supply/BAT0/charge_control_end_threshold"
-
-#define CPU_PL1_PATH			"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/constraint_0_power_limit_uw"
-#define CPU_PL2_PATH			"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/constraint_1_power_limit_uw"
+#include "sysfs-attr.h"
+#include "settings.h"
+#include "psu-monitor.h"
+#include "ec-worker.h"
+#include "write-behind.h"
+#include "charge-ctl.h"
+#include "bat-log.h"
+#include "rapl-sampler.h"
+#include "pl-governor.h"
+#include "fan-curve.h"
+#include "key-matrix.h"
+#include "led-anim.h"
+#include "kbd-led.h"
+#include "ec-console.h"
+#include "ec-stats.h"
+#include "powercap.h"
+#include "profile.h"
+#include "librem-controld.h"
+
+// seconds, fallback if there are no power_supply uevents
+#define BAT_POLL_INTERVAL		5
+// seconds, battery history sampling while nobody else records it
+#define BAT_LOG_INTERVAL		1
+
+#define LC_CLI_NAME				"librem-control-cli"
+
+// Hz, package power sampling while the CPU page is shown
+#define CPU_POWER_RATE			10
+// ms, the readout is not redrawn more often than this
+#define CPU_POWER_DISPLAY_MS	250
+// ms between fan readouts while the EC runs its own curve
+#define FAN_POLL_MS				2000
+// events one key matrix scan job can bring back
+#define KBD_SCAN_EVENTS			128
+// characters of EC console output kept in the log view
+#define EC_CONSOLE_VIEW_MAX		65536
+// ms between EC statistics updates while the Info page is shown
+#define EC_STATS_POLL_MS		1000
 
 #define BIOS_DMI_PATH			"/sys/class/dmi/id/"
 #define BIOS_DMI_PRODUCT_NAME	"product_name"
@@ -66,21 +92,79 @@ typedef struct {
 	GtkWidget *window;
 	GtkApplication *gapp;
 	gboolean is_root;
+	GDBusProxy *proxy;		// librem-controld, NULL if we access sysfs directly
+	gboolean can_write;
+	write_behind_t *wb;		// slider driven writes
+	sysfs_attr_t wb_attr[SETTING_NUM];	// the write-behind thread's own handles
+	charge_ctl_t *cc;		// start/stop charge now
+	gint64 start_time;
+	gboolean bench;				// LIBREM_CONTROL_BENCH, see lc-bench.c
 	double bat_soc;
 	GtkWidget *bat_soc_pbar;
+	bat_log_t bat_log;
 	GtkWidget *bat_start_slider;
 	double bat_start_thres;
 	GtkWidget *bat_end_slider;
 	double bat_end_thres;
 	GtkWidget *bat_apply_btn;
 	GtkWidget *bat_undo_btn;
+	GtkWidget *start_charge_btn;
+	GtkWidget *stop_charge_btn;
 	double cpu_pl1;
 	GtkWidget *cpu_pl1_slider;
 	double cpu_pl2;
 	GtkWidget *cpu_pl2_slider;
 	GtkWidget *cpu_apply_btn;
 	GtkWidget *cpu_undo_btn;
+	GtkWidget *cpu_power_label;
+	rapl_sampler_t cpu_power;
+	int cpu_power_state;		// 0 not tried, 1 sampling, -errno unavailable
+	guint cpu_power_timer;
+	gint64 cpu_power_shown;
+	GtkWidget *cpu_gov_dropdown;
+	GtkWidget *cpu_gov_target;
+	GtkWidget *cpu_gov_unit;
+	int cpu_gov_mode;
+	int cpu_gov_target_val;
+	powercap_t *powercap;		// all zones, scanned with the CPU page
+	profile_list_t *profiles;
+	pl_gov_t gov;				// runs here only without librem-controld
+	gboolean gov_inited;
+	guint gov_timer;
+	GtkWidget *cpu_fan_label;
+	GtkWidget *cpu_fan_entry;
+	int cpu_fan_duty;
+	int cpu_fan_rpm;
+	fan_curve_t fan;			// runs here only without librem-controld
+	gboolean fan_inited;
+	gboolean fan_busy;			// a step is on the EC worker
+	gboolean fan_visible;
+	fan_curve_point_t fan_next[FAN_CURVE_POINTS];
+	int fan_next_n;				// -1 if no new curve is waiting
+	guint fan_timer;
+	guint fan_interval;
+	key_matrix_t *kbd_matrix;	// only the worker touches it while kbd_busy
+	gboolean kbd_busy;
+	gboolean kbd_scanning;
+	gboolean kbd_visible;
+	GtkWidget *kbd_grid;
+	GtkWidget *kbd_cells[KEY_MATRIX_MAX_ROWS][KEY_MATRIX_MAX_COLS];
+	GtkWidget *kbd_stats_label;
+	GtkWidget *kbd_event_label;
+	kbd_led_t *kbd_leds;		// only the worker touches it while kbd_led_busy
+	kbd_led_state_t kbd_led_want;
+	gboolean kbd_led_busy;
+	gboolean kbd_led_dirty;		// kbd_led_want changed while a flush was queued
+	gboolean kbd_led_save;		// CMD_LED_SAVE after the next flush
+	GtkWidget *kbd_led_box;
+	GtkWidget *kbd_led_all_cbtn;
+	GtkWidget *kbd_led_key_spin;
+	GtkWidget *kbd_led_key_cbtn;
+	GtkWidget *kbd_led_mode_spin;
+	GtkWidget *kbd_led_speed_spin;
+	GtkWidget *kbd_led_label;
 	int kbd_backl;
+	GtkWidget *kbd_backl_slider;
 	GtkWidget *rfkill_tbtn1;
 	GtkWidget *rfkill_tbtn2;
 	GtkWidget *rfkill_tbtn3;
@@ -92,9 +176,25 @@ typedef struct {
 	int blue_val;
 	GtkWidget *notif_blue_slider;
 	GtkWidget *notif_cbtn;
+	GtkWidget *notif_pattern_entry;
+	led_anim_t anim;			// runs here only without librem-controld
+	gboolean anim_running;
+	GtkWidget *ec_version_label;
+	GtkWidget *ec_board_label;
+	ec_console_t *ec_console;	// only the worker touches it while ec_console_busy
+	gboolean ec_console_busy;
+	gboolean ec_console_on;
+	gboolean info_visible;
+	guint ec_console_timer;
+	GtkWidget *ec_console_view;
+	GtkWidget *ec_console_label;
+	GtkWidget *ec_stats_label;
+	gboolean ec_stats_busy;
+	guint ec_stats_timer;
 } lcontrol_app_t ;
 
 
+
 static int get_string_from_text_file(char *fname, char *string, int len)
 {
 	FILE *fp;
@@ -125,85 +225,116 @@ static int get_string_from_text_file(char *fname, char *string, int len)
 	return res;
 }
 
-static int get_value_from_text_file(char *fname)
+// cached value, from librem-controld's snapshot or our own sysfs refresh
+static int lc_value_get(lcontrol_app_t *lc_app, int id)
 {
-	FILE *fp;
-	char buf[64];
+	GVariant *v;
+	int val = -1;
 
-	fp=fopen(fname, "r");
+	if (lc_app->proxy == NULL)
+		return settings_int(id);
 
-	if (fp==NULL) {
-		perror(fname);
-		return -1;
+	v = g_dbus_proxy_get_cached_property(lc_app->proxy, settings[id].name);
+	if (v != NULL) {
+		if (g_variant_is_of_type(v, G_VARIANT_TYPE_INT32))
+			val = g_variant_get_int32(v);
+		g_variant_unref(v);
 	}
 
-	memset(buf, 0, 64);
-
-	if (fread(buf, 1, 63, fp) <= 0) {
-		fclose(fp);
-		return -1;
-	}
-	fclose(fp);
-	return atoi(buf);
+	return val;
 }
 
-static int set_value_to_text_file(char *fname, char *value)
+static void lc_set_done(GObject *source, GAsyncResult *result, gpointer user_data)
 {
-	int fd;
+	GError *err = NULL;
+	GVariant *ret;
 
-	// fprintf(stderr, "set_value_to_text_file('%s', '%s')\n", fname, value);
-	if (value == NULL)
-		return -EINVAL;
+	ret = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, &err);
+	if (ret == NULL) {
+		g_warning("set: %s", err->message);
+		g_error_free(err);
+		return;
+	}
+	g_variant_unref(ret);
+}
 
-	fd = open(fname, O_WRONLY);
-	if (fd < 0)
-		return fd;
-	write(fd, value, strlen(value));
-	close(fd);
+// one transaction, here or in the daemon, which reports back what stuck
+static void lc_values_set(lcontrol_app_t *lc_app, int n, const int *ids, GVariant **values)
+{
+	char bufs[SETTING_NUM][128];
+	const char *strs[SETTING_NUM];
+	GVariantBuilder b;
+	int i, res, failed;
+
+	if (lc_app->proxy != NULL) {
+		g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+		for (i = 0; i < n; i++)
+			g_variant_builder_add(&b, "{sv}", settings[ids[i]].name, values[i]);
+		g_dbus_proxy_call(lc_app->proxy, "Set", g_variant_new("(a{sv})", &b),
+			G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1, NULL, lc_set_done, lc_app);
+		return;
+	}
 
-	return 1;
+	for (i = 0; i < n && i < SETTING_NUM; i++) {
+		g_variant_ref_sink(values[i]);
+		if (g_variant_is_of_type(values[i], G_VARIANT_TYPE_INT32))
+			snprintf(bufs[i], sizeof(bufs[i]), "%d", g_variant_get_int32(values[i]));
+		else
+			snprintf(bufs[i], sizeof(bufs[i]), "%s", g_variant_get_string(values[i], NULL));
+		strs[i] = bufs[i];
+		g_variant_unref(values[i]);
+	}
+	res = settings_apply(i, ids, strs, &failed);
+	if (res < 0)
+		g_warning("%s: %s, nothing changed", (failed >= 0) ? settings[ids[failed]].key : "set",
+			g_strerror(-res));
 }
 
-static void update_values_get(lcontrol_app_t *lc_app)
+// write-behind flush, runs on a worker thread so the UI never waits for the
+// EC, direct writes go through its own handles and leave settings[] to the
+// main thread
+static int lc_write_behind(int n, const int *ids, const int *values, gpointer user_data)
 {
-	int val;
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	GVariantBuilder b;
+	GError *err = NULL;
+	GVariant *ret;
+	int i, res;
+
+	if (lc_app->proxy == NULL) {
+		for (i = 0; i < n; i++) {
+			res = settings_write_int(&lc_app->wb_attr[ids[i]], ids[i], values[i]);
+			if (res < 0) {
+				g_warning("%s: %s", settings[ids[i]].key, g_strerror(-res));
+				return res;
+			}
+		}
+		return 0;
+	}
+
+	// one call for the whole batch, e.g. all three notification LED colors
+	g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+	for (i = 0; i < n; i++)
+		g_variant_builder_add(&b, "{sv}", settings[ids[i]].name, g_variant_new_int32(values[i]));
+	ret = g_dbus_proxy_call_sync(lc_app->proxy, "Set", g_variant_new("(a{sv})", &b),
+		G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1, NULL, &err);
+	if (ret == NULL) {
+		g_warning("set: %s", err->message);
+		g_error_free(err);
+		return -EIO;
+	}
+	g_variant_unref(ret);
 
-	val = get_value_from_text_file(BAT_SOC);
-	if (val >= 0)
-		lc_app->bat_soc = (double)val;
-	val = get_value_from_text_file(BAT_START_THRESHOLD_PATH);
-	if (val >= 0)
-		lc_app->bat_start_thres = (double)val;
-	val = get_value_from_text_file(BAT_END_THRESHOLD_PATH);
-	if (val >= 0)
-		lc_app->bat_end_thres = (double)val;
-
-	val = get_value_from_text_file(CPU_PL1_PATH);
-	if (val >= 0)
-		lc_app->cpu_pl1 = (double)val / 1000000;
-	val = get_value_from_text_file(CPU_PL2_PATH);
-	if (val >= 0)
-		lc_app->cpu_pl2 = (double)val / 1000000;
-
-	val = get_value_from_text_file(LED_RED_PATH "/brightness");
-	if (val >= 0)
-		lc_app->red_val = val;
-	val = get_value_from_text_file(LED_GREEN_PATH "/brightness");
-	if (val >= 0)
-		lc_app->green_val = val;
-	val = get_value_from_text_file(LED_BLUE_PATH "/brightness");
-	if (val >= 0)
-		lc_app->blue_val = val;
-
-	val = get_value_from_text_file(LED_KBD_BACKLIGHT "/brightness");
-	if (val >= 0)
-		lc_app->kbd_backl = val;
-
-	val = get_value_from_text_file(LED_AIRPLANE_PATH "/brightness");
-	if (val >= 0)
-		lc_app->airplane = (val > 0) ? true : false;
+	return 0;
 }
 
+// move a slider without it taking this as user input
+static void lc_range_update(lcontrol_app_t *lc_app, GtkWidget *w, double val)
+{
+	g_signal_handlers_block_matched(w, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+	gtk_range_set_value(GTK_RANGE(w), val);
+	g_signal_handlers_unblock_matched(w, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+}
 
 static void bat_start_val_chg (GtkRange* self, gpointer user_data)
 {
@@ -227,7 +358,7 @@ static void bat_start_val_chg (GtkRange* self, gpointer user_data)
         gtk_range_set_value(GTK_RANGE(lc_app->bat_end_slider), bat_start_val);
     }
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
 		gtk_widget_set_sensitive(lc_app->bat_apply_btn, true);
 		gtk_widget_set_sensitive(lc_app->bat_undo_btn, true);
 	}
@@ -247,7 +378,7 @@ static void bat_end_val_chg (GtkRange* self, gpointer user_data)
 		gtk_range_set_value(GTK_RANGE(lc_app->bat_start_slider), bat_end_val);
     }
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
 		gtk_widget_set_sensitive(lc_app->bat_apply_btn, true);
 		gtk_widget_set_sensitive(lc_app->bat_undo_btn, true);
 	}
@@ -256,17 +387,16 @@ static void bat_end_val_chg (GtkRange* self, gpointer user_data)
 static void bat_thres_apply_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
+	int ids[2] = { SETTING_BAT_START, SETTING_BAT_END };
+	GVariant *values[2];
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
 		lc_app->bat_end_thres = gtk_range_get_value(GTK_RANGE(lc_app->bat_end_slider));
 		lc_app->bat_start_thres = gtk_range_get_value(GTK_RANGE(lc_app->bat_start_slider));
 
-		snprintf(buf, 31, "%d", (int)lc_app->bat_start_thres);
-		set_value_to_text_file(BAT_START_THRESHOLD_PATH, buf);
-
-		snprintf(buf, 31, "%d", (int)lc_app->bat_end_thres);
-		set_value_to_text_file(BAT_END_THRESHOLD_PATH, buf);
+		values[0] = g_variant_new_int32((int)lc_app->bat_start_thres);
+		values[1] = g_variant_new_int32((int)lc_app->bat_end_thres);
+		lc_values_set(lc_app, 2, ids, values);
 	}
 
 	gtk_widget_set_sensitive(lc_app->bat_apply_btn, false);
@@ -277,7 +407,7 @@ static void bat_thres_undo_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
     	gtk_range_set_value(GTK_RANGE(lc_app->bat_start_slider), lc_app->bat_start_thres);
     	gtk_range_set_value(GTK_RANGE(lc_app->bat_end_slider), lc_app->bat_end_thres);
 	}
@@ -286,11 +416,46 @@ static void bat_thres_undo_clicked (GtkWidget *widget, gpointer user_data)
 	gtk_widget_set_sensitive(lc_app->bat_undo_btn, false);
 }
 
+#define START_CHARGE_LABEL	"Start charge now!"
+#define STOP_CHARGE_LABEL	"Stop charge now!"
+
+static void charge_now_done(charge_ctl_result_t result, guint elapsed_ms, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	if (result == CHARGE_CTL_TIMEOUT)
+		g_warning("charger did not react within %u ms", elapsed_ms);
+	else if (result == CHARGE_CTL_FAILED)
+		g_warning("could not change charge threshold");
+
+	gtk_button_set_label(GTK_BUTTON(lc_app->start_charge_btn), START_CHARGE_LABEL);
+	gtk_button_set_label(GTK_BUTTON(lc_app->stop_charge_btn), STOP_CHARGE_LABEL);
+	gtk_widget_set_sensitive(lc_app->start_charge_btn, true);
+	gtk_widget_set_sensitive(lc_app->stop_charge_btn, true);
+}
+
+// the clicked button turns into a cancel button until the charger switched
+static void charge_now_running(lcontrol_app_t *lc_app, GtkWidget *button)
+{
+	if (!charge_ctl_busy(lc_app->cc))
+		return;
+
+	gtk_button_set_label(GTK_BUTTON(button), "Cancel");
+	if (button == lc_app->start_charge_btn)
+		gtk_widget_set_sensitive(lc_app->stop_charge_btn, false);
+	else
+		gtk_widget_set_sensitive(lc_app->start_charge_btn, false);
+}
+
 static void start_charge_now_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 	int tval;
-	char buf[32];
+
+	if (charge_ctl_busy(lc_app->cc)) {
+		charge_ctl_cancel(lc_app->cc);
+		return;
+	}
 
 	// only works if SOC < end threshold
 	if (lc_app->bat_end_thres < lc_app->bat_soc) {
@@ -298,30 +463,29 @@ static void start_charge_now_clicked (GtkWidget *widget, gpointer user_data)
 		return;
 	}
 	tval = 	(int)lc_app->bat_end_thres - 1;
-	snprintf(buf, 31, "%d", tval);
-	set_value_to_text_file(BAT_START_THRESHOLD_PATH, buf);
-	g_usleep(G_USEC_PER_SEC + (G_USEC_PER_SEC / 4));
-	snprintf(buf, 31, "%d", (int)lc_app->bat_start_thres);
-	set_value_to_text_file(BAT_START_THRESHOLD_PATH, buf);
+	charge_ctl_run(lc_app->cc, CHARGE_CTL_START, SETTING_BAT_START, tval, (int)lc_app->bat_start_thres,
+		charge_now_done, lc_app);
+	charge_now_running(lc_app, widget);
 }
 
 static void stop_charge_now_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 	int tval;
-	char buf[32];
+
+	if (charge_ctl_busy(lc_app->cc)) {
+		charge_ctl_cancel(lc_app->cc);
+		return;
+	}
 
 	// only works if start threshold < SOC
 	if (lc_app->bat_start_thres >= lc_app->bat_soc) {
 		return;
 	}
 	tval = 	(int)lc_app->bat_soc + 1;
-	snprintf(buf, 31, "%d", tval);
-	set_value_to_text_file(BAT_END_THRESHOLD_PATH, buf);
-	g_usleep(G_USEC_PER_SEC + (G_USEC_PER_SEC / 4));
-	snprintf(buf, 31, "%d", (int)lc_app->bat_end_thres);
-	set_value_to_text_file(BAT_END_THRESHOLD_PATH, buf);
-
+	charge_ctl_run(lc_app->cc, CHARGE_CTL_STOP, SETTING_BAT_END, tval, (int)lc_app->bat_end_thres,
+		charge_now_done, lc_app);
+	charge_now_running(lc_app, widget);
 }
 
 static void cpu_pl1_val_chg (GtkRange* self, gpointer user_data)
@@ -344,7 +508,7 @@ static void cpu_undo_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
     	gtk_range_set_value(GTK_RANGE(lc_app->cpu_pl1_slider), lc_app->cpu_pl1);
     	gtk_range_set_value(GTK_RANGE(lc_app->cpu_pl2_slider), lc_app->cpu_pl2);
 	}
@@ -356,30 +520,412 @@ static void cpu_undo_clicked (GtkWidget *widget, gpointer user_data)
 static void cpu_apply_clicked (GtkWidget *widget, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
+	int ids[2] = { SETTING_CPU_PL1, SETTING_CPU_PL2 };
+	GVariant *values[2];
 
-    if (lc_app->is_root) {
+    if (lc_app->can_write) {
     	lc_app->cpu_pl1 = gtk_range_get_value(GTK_RANGE(lc_app->cpu_pl1_slider));
     	lc_app->cpu_pl2 = gtk_range_get_value(GTK_RANGE(lc_app->cpu_pl2_slider));
 
-		snprintf(buf, 31, "%d", (int)lc_app->cpu_pl1 * 1000000);
-		set_value_to_text_file(CPU_PL1_PATH, buf);
-		snprintf(buf, 31, "%d", (int)lc_app->cpu_pl2 * 1000000);
-		set_value_to_text_file(CPU_PL2_PATH, buf);
+		values[0] = g_variant_new_int32((int)lc_app->cpu_pl1);
+		values[1] = g_variant_new_int32((int)lc_app->cpu_pl2);
+		lc_values_set(lc_app, 2, ids, values);
 	}
 
 	gtk_widget_set_sensitive(lc_app->cpu_apply_btn, false);
 	gtk_widget_set_sensitive(lc_app->cpu_undo_btn, false);
 }
 
+static void lc_value_changed(lcontrol_app_t *lc_app, int id, int val);
+
+// drop down order is the pl_gov_mode_t order
+static const char *cpu_gov_labels[] = { "Fixed limits", "Temperature", "Battery drain", "Fan speed", NULL };
+
+// reflect the governor state without it being taken as user input
+static void cpu_gov_show(lcontrol_app_t *lc_app)
+{
+	gboolean fixed = (lc_app->cpu_gov_mode == PL_GOV_OFF);
+	int min, max;
+
+	if (lc_app->cpu_gov_dropdown == NULL)
+		return;
+
+	pl_gov_target_range(lc_app->cpu_gov_mode, &min, &max);
+	g_signal_handlers_block_matched(lc_app->cpu_gov_dropdown, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+	g_signal_handlers_block_matched(lc_app->cpu_gov_target, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+	gtk_drop_down_set_selected(GTK_DROP_DOWN(lc_app->cpu_gov_dropdown), lc_app->cpu_gov_mode);
+	gtk_spin_button_set_range(GTK_SPIN_BUTTON(lc_app->cpu_gov_target), min, max);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(lc_app->cpu_gov_target), lc_app->cpu_gov_target_val);
+	g_signal_handlers_unblock_matched(lc_app->cpu_gov_target, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+	g_signal_handlers_unblock_matched(lc_app->cpu_gov_dropdown, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+
+	gtk_label_set_text(GTK_LABEL(lc_app->cpu_gov_unit), pl_gov_mode_unit(lc_app->cpu_gov_mode));
+	gtk_widget_set_sensitive(lc_app->cpu_gov_target, lc_app->can_write && !fixed);
+	// the governor owns the limits while it runs
+	gtk_widget_set_sensitive(lc_app->cpu_pl1_slider, lc_app->can_write && fixed);
+	gtk_widget_set_sensitive(lc_app->cpu_pl2_slider, lc_app->can_write && fixed);
+	if (!fixed) {
+		gtk_widget_set_sensitive(lc_app->cpu_apply_btn, false);
+		gtk_widget_set_sensitive(lc_app->cpu_undo_btn, false);
+	}
+}
+
+static gboolean cpu_gov_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	int pl1, pl2, res;
+
+	if (pl_gov_step(&lc_app->gov, g_get_monotonic_time(), &pl1, &pl2) <= 0)
+		return G_SOURCE_CONTINUE;
+
+	res = pl_gov_apply(pl1, pl2);
+	if (res < 0)
+		g_warning("governor: %s", g_strerror(-res));
+	lc_value_changed(lc_app, SETTING_CPU_PL1, settings_int(SETTING_CPU_PL1));
+	lc_value_changed(lc_app, SETTING_CPU_PL2, settings_int(SETTING_CPU_PL2));
+
+	return G_SOURCE_CONTINUE;
+}
+
+// without the daemon the governor runs in here, and only as long as we do
+static int cpu_gov_run_local(lcontrol_app_t *lc_app, int mode, int target)
+{
+	int res;
+
+	if (!lc_app->gov_inited) {
+		pl_gov_init(&lc_app->gov);
+		lc_app->gov_inited = true;
+	}
+
+	if (mode == PL_GOV_OFF) {
+		if (lc_app->gov_timer != 0)
+			g_source_remove(lc_app->gov_timer);
+		lc_app->gov_timer = 0;
+		if (lc_app->gov.mode == PL_GOV_OFF)
+			return 0;
+		pl_gov_start(&lc_app->gov, PL_GOV_OFF, 0, lc_app->gov.user_pl1, lc_app->gov.user_pl2);
+		res = pl_gov_apply(lc_app->gov.user_pl1, lc_app->gov.user_pl2);
+		lc_value_changed(lc_app, SETTING_CPU_PL1, settings_int(SETTING_CPU_PL1));
+		lc_value_changed(lc_app, SETTING_CPU_PL2, settings_int(SETTING_CPU_PL2));
+		return res;
+	}
+
+	if (lc_app->gov.mode != PL_GOV_OFF)
+		res = pl_gov_start(&lc_app->gov, mode, target, lc_app->gov.user_pl1, lc_app->gov.user_pl2);
+	else
+		res = pl_gov_start(&lc_app->gov, mode, target, (int)lc_app->cpu_pl1, (int)lc_app->cpu_pl2);
+	if (res < 0)
+		return res;
+	if (lc_app->gov_timer == 0)
+		lc_app->gov_timer = g_timeout_add(PL_GOV_INTERVAL_MS, cpu_gov_timeout, lc_app);
+
+	return 0;
+}
+
+static void cpu_gov_set(lcontrol_app_t *lc_app, int mode, int target)
+{
+	GVariantBuilder b;
+	int res;
+
+	// target first, so the daemon starts the mode with it
+	if (lc_app->proxy != NULL) {
+		g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+		g_variant_builder_add(&b, "{sv}", LCD_PROP_GOVERNOR_TARGET, g_variant_new_int32(target));
+		g_variant_builder_add(&b, "{sv}", LCD_PROP_GOVERNOR, g_variant_new_string(pl_gov_mode_name(mode)));
+		g_dbus_proxy_call(lc_app->proxy, "Set", g_variant_new("(a{sv})", &b),
+			G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1, NULL, lc_set_done, lc_app);
+		return;
+	}
+
+	res = cpu_gov_run_local(lc_app, mode, target);
+	if (res < 0) {
+		g_warning("governor %s: %s", pl_gov_mode_name(mode), g_strerror(-res));
+		mode = lc_app->gov.mode;
+	}
+	lc_app->cpu_gov_mode = mode;
+	lc_app->cpu_gov_target_val = target;
+	cpu_gov_show(lc_app);
+}
+
+static void cpu_gov_mode_chg(GObject *dropdown, GParamSpec *pspec, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	int mode, min, max, target;
+
+	mode = gtk_drop_down_get_selected(GTK_DROP_DOWN(dropdown));
+	target = pl_gov_target_range(mode, &min, &max);
+	cpu_gov_set(lc_app, mode, target);
+}
+
+static void cpu_gov_target_chg(GtkSpinButton *spin, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	cpu_gov_set(lc_app, lc_app->cpu_gov_mode, gtk_spin_button_get_value_as_int(spin));
+}
+
+// librem-controld samples once a second and pushes CpuPower
+static void cpu_power_show(lcontrol_app_t *lc_app, double w)
+{
+	char buf[64];
+
+	if (lc_app->cpu_power_label == NULL)
+		return;
+	if (w < 0)
+		snprintf(buf, sizeof(buf), "Package power not readable");
+	else
+		snprintf(buf, sizeof(buf), "Package %.1f W", w);
+	gtk_label_set_text(GTK_LABEL(lc_app->cpu_power_label), buf);
+}
+
+static void cpu_fan_show(lcontrol_app_t *lc_app)
+{
+	char buf[64];
+
+	if (lc_app->cpu_fan_label == NULL)
+		return;
+
+	if (lc_app->cpu_fan_duty < 0)
+		snprintf(buf, sizeof(buf), "Fan n/a");
+	else if (lc_app->cpu_fan_rpm < 0)
+		snprintf(buf, sizeof(buf), "Fan %d %%", lc_app->cpu_fan_duty);
+	else
+		snprintf(buf, sizeof(buf), "Fan %d %%, %d RPM", lc_app->cpu_fan_duty, lc_app->cpu_fan_rpm);
+	if (strcmp(gtk_label_get_text(GTK_LABEL(lc_app->cpu_fan_label)), buf) != 0)
+		gtk_label_set_text(GTK_LABEL(lc_app->cpu_fan_label), buf);
+}
+
+static void cpu_fan_curve_show(lcontrol_app_t *lc_app, const char *spec)
+{
+	if (lc_app->cpu_fan_entry == NULL)
+		return;
+
+	gtk_editable_set_text(GTK_EDITABLE(lc_app->cpu_fan_entry), spec);
+	gtk_widget_remove_css_class(lc_app->cpu_fan_entry, "error");
+}
+
+static int cpu_fan_job(int fd, gpointer data)
+{
+	return fan_curve_step((fan_curve_t *)data, fd);
+}
+
+static void cpu_fan_done(int result, gpointer data, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->fan_busy = false;
+	if (result < 0 && lc_app->fan.n > 0)
+		g_warning("fan: %s", g_strerror(-result));
+	lc_app->cpu_fan_duty = lc_app->fan.duty;
+	lc_app->cpu_fan_rpm = lc_app->fan.fan_rpm;
+	cpu_fan_show(lc_app);
+}
+
+// at most one step in flight, a new curve is handed over between steps
+static gboolean cpu_fan_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	if (lc_app->fan_busy)
+		return G_SOURCE_CONTINUE;
+	if (lc_app->fan_next_n >= 0) {
+		fan_curve_set(&lc_app->fan, lc_app->fan_next, lc_app->fan_next_n);
+		lc_app->fan_next_n = -1;
+	}
+	lc_app->fan_busy = true;
+	ec_worker_queue(cpu_fan_job, &lc_app->fan, NULL, cpu_fan_done, lc_app);
+
+	return G_SOURCE_CONTINUE;
+}
+
+// without the daemon: a curve runs as long as we do, the readout only
+// while the CPU page is visible
+static void cpu_fan_run(lcontrol_app_t *lc_app)
+{
+	gboolean curve = (lc_app->fan_next_n >= 0) ? (lc_app->fan_next_n > 0) : (lc_app->fan.n > 0);
+	guint interval = 0;
+
+	if (lc_app->proxy != NULL || !lc_app->fan_inited)
+		return;
+
+	if (curve)
+		interval = FAN_CURVE_INTERVAL_MS;
+	else if (lc_app->fan_visible)
+		interval = FAN_POLL_MS;
+	if (interval == lc_app->fan_interval)
+		return;
+
+	if (lc_app->fan_timer != 0)
+		g_source_remove(lc_app->fan_timer);
+	lc_app->fan_timer = 0;
+	lc_app->fan_interval = interval;
+	if (interval == 0)
+		return;
+	lc_app->fan_timer = g_timeout_add(interval, cpu_fan_timeout, lc_app);
+	cpu_fan_timeout(lc_app);
+}
+
+static void cpu_fan_apply_clicked(GtkWidget *widget, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	fan_curve_point_t p[FAN_CURVE_POINTS];
+	const char *spec;
+	GVariantBuilder b;
+	int n;
+
+	spec = gtk_editable_get_text(GTK_EDITABLE(lc_app->cpu_fan_entry));
+	n = fan_curve_parse(spec, p, FAN_CURVE_POINTS);
+	if (n < 0) {
+		gtk_widget_add_css_class(lc_app->cpu_fan_entry, "error");
+		return;
+	}
+	gtk_widget_remove_css_class(lc_app->cpu_fan_entry, "error");
+
+	if (lc_app->proxy != NULL) {
+		g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+		g_variant_builder_add(&b, "{sv}", LCD_PROP_FAN_CURVE, g_variant_new_string(spec));
+		g_dbus_proxy_call(lc_app->proxy, "Set", g_variant_new("(a{sv})", &b),
+			G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1, NULL, lc_set_done, lc_app);
+		return;
+	}
+
+	if (n > 0 && lc_app->fan.temp_path[0] == 0) {
+		g_warning("fan: no package temperature");
+		gtk_widget_add_css_class(lc_app->cpu_fan_entry, "error");
+		return;
+	}
+	memcpy(lc_app->fan_next, p, sizeof(p));
+	lc_app->fan_next_n = n;
+	cpu_fan_run(lc_app);
+}
+
+// widgets of one zone, the spin buttons are in constraint order
+typedef struct {
+	lcontrol_app_t *lc_app;
+	powercap_zone_t *zone;
+	GtkWidget *limit[POWERCAP_MAX_CONSTRAINTS];
+	GtkWidget *window[POWERCAP_MAX_CONSTRAINTS];
+} cpu_zone_t;
+
+static void cpu_zone_apply_clicked(GtkWidget *widget, gpointer user_data)
+{
+	cpu_zone_t *cz = (cpu_zone_t *)user_data;
+	powercap_change_t changes[2 * POWERCAP_MAX_CONSTRAINTS];
+	powercap_constraint_t *c;
+	long long val;
+	int i, n = 0, res;
+
+	// only what differs, in the zone's constraint order
+	for (i = 0; i < cz->zone->n_constraints; i++) {
+		c = &cz->zone->c[i];
+		val = (long long)(gtk_spin_button_get_value(GTK_SPIN_BUTTON(cz->limit[i])) * 1000000.);
+		if (val != powercap_value(c, POWERCAP_LIMIT))
+			changes[n++] = (powercap_change_t){ i, POWERCAP_LIMIT, val };
+		if (cz->window[i] == NULL)
+			continue;
+		val = (long long)(gtk_spin_button_get_value(GTK_SPIN_BUTTON(cz->window[i])) * 1000.);
+		if (val != powercap_value(c, POWERCAP_WINDOW))
+			changes[n++] = (powercap_change_t){ i, POWERCAP_WINDOW, val };
+	}
+	if (n == 0)
+		return;
+
+	res = powercap_zone_apply(cz->zone, n, changes);
+	if (res < 0)
+		g_warning("%s: %s, zone left unchanged", cz->zone->id, g_strerror(-res));
+
+	// show what the zone has now, the package limits also live in the sliders
+	for (i = 0; i < cz->zone->n_constraints; i++) {
+		c = &cz->zone->c[i];
+		gtk_spin_button_set_value(GTK_SPIN_BUTTON(cz->limit[i]), powercap_value(c, POWERCAP_LIMIT) / 1000000.);
+		if (cz->window[i] != NULL)
+			gtk_spin_button_set_value(GTK_SPIN_BUTTON(cz->window[i]), powercap_value(c, POWERCAP_WINDOW) / 1000.);
+	}
+	settings_refresh_ids((int[]){ SETTING_CPU_PL1, SETTING_CPU_PL2 }, 2);
+	lc_value_changed(cz->lc_app, SETTING_CPU_PL1, settings_int(SETTING_CPU_PL1));
+	lc_value_changed(cz->lc_app, SETTING_CPU_PL2, settings_int(SETTING_CPU_PL2));
+}
+
+static GtkWidget *cpu_zone_spin(double val, double min, double max, double step, gboolean can_write)
+{
+	GtkWidget *w;
+
+	w = gtk_spin_button_new_with_range(min, max, step);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(w), val);
+	gtk_widget_set_sensitive(w, can_write);
+
+	return w;
+}
+
+// one frame per zone: limit in W and time window in ms for each constraint
+static void create_cpu_zones(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	powercap_zone_t *zone;
+	powercap_constraint_t *c;
+	GtkWidget *w, *grid, *exp, *zbox;
+	cpu_zone_t *cz;
+	double max;
+	char buf[80];
+	int i, j;
+
+	lc_app->powercap = g_new0(powercap_t, 1);
+	if (powercap_scan(lc_app->powercap) <= 0)
+		return;
+
+	exp = gtk_expander_new("All power zones");
+	gtk_widget_set_margin_end(exp, 3);
+	gtk_box_append(GTK_BOX(box), exp);
+	zbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+	gtk_expander_set_child(GTK_EXPANDER(exp), zbox);
+
+	for (i = 0; i < lc_app->powercap->n_zones; i++) {
+		zone = &lc_app->powercap->zones[i];
+		if (zone->n_constraints == 0)
+			continue;
+		powercap_zone_refresh(zone);
+		cz = g_new0(cpu_zone_t, 1);
+		cz->lc_app = lc_app;
+		cz->zone = zone;
+
+		snprintf(buf, sizeof(buf), "%s (%s)", zone->name, zone->id);
+		w = gtk_frame_new(buf);
+		gtk_box_append(GTK_BOX(zbox), w);
+		grid = gtk_grid_new();
+		gtk_grid_set_column_spacing(GTK_GRID(grid), 4);
+		gtk_frame_set_child(GTK_FRAME(w), grid);
+		g_object_set_data_full(G_OBJECT(grid), "cpu-zone", cz, g_free);
+
+		for (j = 0; j < zone->n_constraints; j++) {
+			c = &zone->c[j];
+			gtk_grid_attach(GTK_GRID(grid), gtk_label_new(c->name), 0, j, 1, 1);
+			max = (c->max_power > 0) ? c->max_power / 1000000. : 200.;
+			cz->limit[j] = cpu_zone_spin(powercap_value(c, POWERCAP_LIMIT) / 1000000., 0., max, 1.,
+				lc_app->is_root);
+			gtk_grid_attach(GTK_GRID(grid), cz->limit[j], 1, j, 1, 1);
+			gtk_grid_attach(GTK_GRID(grid), gtk_label_new("W"), 2, j, 1, 1);
+			if (powercap_value(c, POWERCAP_WINDOW) < 0)
+				continue;
+			max = (c->max_window > 0) ? c->max_window / 1000. : 100000.;
+			cz->window[j] = cpu_zone_spin(powercap_value(c, POWERCAP_WINDOW) / 1000., 0., max, 1.,
+				lc_app->is_root);
+			gtk_spin_button_set_digits(GTK_SPIN_BUTTON(cz->window[j]), 1);
+			gtk_grid_attach(GTK_GRID(grid), cz->window[j], 3, j, 1, 1);
+			gtk_grid_attach(GTK_GRID(grid), gtk_label_new("ms"), 4, j, 1, 1);
+		}
+		w = gtk_button_new_from_icon_name("emblem-ok-symbolic");
+		gtk_widget_set_tooltip_text(w, "Apply all values of this zone, or none");
+		gtk_widget_set_sensitive(w, lc_app->is_root);
+		g_signal_connect(w, "clicked", G_CALLBACK(cpu_zone_apply_clicked), cz);
+		gtk_grid_attach(GTK_GRID(grid), w, 5, 0, 1, 1);
+	}
+}
+
 static void kbd_backl_val_chg (GtkRange* self, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
 
 	lc_app->kbd_backl = gtk_range_get_value(self);
-	snprintf(buf, 31, "%d", lc_app->kbd_backl);
-	set_value_to_text_file(LED_KBD_BACKLIGHT "/brightness", buf);
+	write_behind_set(lc_app->wb, SETTING_LED_KBD, lc_app->kbd_backl);
 }
 
 static void update_notif_cbtn(lcontrol_app_t *lc_app)
@@ -393,36 +939,84 @@ static void update_notif_cbtn(lcontrol_app_t *lc_app)
 	gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(lc_app->notif_cbtn), &rgba);
 }
 
+// a fixed color ends a running pattern, the daemon does the same on its side
+static void notif_pattern_cancel(lcontrol_app_t *lc_app)
+{
+	if (lc_app->anim_running)
+		led_anim_stop(&lc_app->anim);
+	lc_app->anim_running = false;
+	if (lc_app->notif_pattern_entry != NULL)
+		gtk_editable_set_text(GTK_EDITABLE(lc_app->notif_pattern_entry), "");
+}
+
+static void notif_pattern_apply(GtkWidget *widget, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	GVariantBuilder b;
+	led_pattern_t p;
+	const char *spec;
+	int res = 0;
+
+	spec = gtk_editable_get_text(GTK_EDITABLE(lc_app->notif_pattern_entry));
+	if (spec[0] != 0)
+		res = led_pattern_parse(spec, &p);
+	if (res < 0) {
+		gtk_widget_add_css_class(lc_app->notif_pattern_entry, "error");
+		return;
+	}
+	gtk_widget_remove_css_class(lc_app->notif_pattern_entry, "error");
+
+	if (lc_app->proxy != NULL) {
+		g_variant_builder_init(&b, G_VARIANT_TYPE_VARDICT);
+		g_variant_builder_add(&b, "{sv}", LCD_PROP_LED_PATTERN, g_variant_new_string(spec));
+		g_dbus_proxy_call(lc_app->proxy, "Set", g_variant_new("(a{sv})", &b),
+			G_DBUS_CALL_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION, -1, NULL, lc_set_done, lc_app);
+		return;
+	}
+
+	if (spec[0] == 0) {
+		notif_pattern_cancel(lc_app);
+		return;
+	}
+	if (!lc_app->anim_running) {
+		res = led_anim_start(&lc_app->anim, settings[SETTING_LED_RED].attr.path,
+			settings[SETTING_LED_GREEN].attr.path, settings[SETTING_LED_BLUE].attr.path);
+		if (res < 0) {
+			g_warning("notification LED: %s", g_strerror(-res));
+			return;
+		}
+		lc_app->anim_running = true;
+	}
+	led_anim_set(&lc_app->anim, &p);
+}
+
 static void notif_led_red_chg(GtkRange* self, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
 
 	lc_app->red_val = gtk_range_get_value(self);
-	snprintf(buf, 31, "%d", lc_app->red_val);
-	set_value_to_text_file(LED_RED_PATH "/brightness", buf);
+	notif_pattern_cancel(lc_app);
+	write_behind_set(lc_app->wb, SETTING_LED_RED, lc_app->red_val);
 	update_notif_cbtn(lc_app);
 }
 
 static void notif_led_green_chg(GtkRange* self, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
 
 	lc_app->green_val = gtk_range_get_value(self);
-	snprintf(buf, 31, "%d", lc_app->green_val);
-	set_value_to_text_file(LED_GREEN_PATH "/brightness", buf);
+	notif_pattern_cancel(lc_app);
+	write_behind_set(lc_app->wb, SETTING_LED_GREEN, lc_app->green_val);
 	update_notif_cbtn(lc_app);
 }
 
 static void notif_led_blue_chg(GtkRange* self, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
-	char buf[32];
 
 	lc_app->blue_val = gtk_range_get_value(self);
-	snprintf(buf, 31, "%d", lc_app->blue_val);
-	set_value_to_text_file(LED_BLUE_PATH "/brightness", buf);
+	notif_pattern_cancel(lc_app);
+	write_behind_set(lc_app->wb, SETTING_LED_BLUE, lc_app->blue_val);
 	update_notif_cbtn(lc_app);
 }
 
@@ -433,14 +1027,29 @@ static void notif_cbtn_set(GtkColorButton* self, gpointer user_data)
 
 	gtk_color_chooser_get_rgba (GTK_COLOR_CHOOSER(self), &rgba);
 	lc_app->red_val = (int)(rgba.red * 255.);
-	gtk_range_set_value(GTK_RANGE(lc_app->notif_red_slider), lc_app->red_val);
 	lc_app->green_val = (int)(rgba.green * 255.);
-	gtk_range_set_value(GTK_RANGE(lc_app->notif_green_slider), lc_app->green_val);
 	lc_app->blue_val = (int)(rgba.blue * 255.);
-	gtk_range_set_value(GTK_RANGE(lc_app->notif_blue_slider), lc_app->blue_val);
+	notif_pattern_cancel(lc_app);
+
+	// the button already shows the color, only move the sliders and
+	// queue all three channels so they go out in one flush
+	lc_range_update(lc_app, lc_app->notif_red_slider, lc_app->red_val);
+	lc_range_update(lc_app, lc_app->notif_green_slider, lc_app->green_val);
+	lc_range_update(lc_app, lc_app->notif_blue_slider, lc_app->blue_val);
+	write_behind_set(lc_app->wb, SETTING_LED_RED, lc_app->red_val);
+	write_behind_set(lc_app->wb, SETTING_LED_GREEN, lc_app->green_val);
+	write_behind_set(lc_app->wb, SETTING_LED_BLUE, lc_app->blue_val);
 }
 
 
+static void lc_trigger_set(lcontrol_app_t *lc_app, const char *trigger)
+{
+	int id = SETTING_LED_AIRPLANE_TRIGGER;
+	GVariant *v = g_variant_new_string(trigger);
+
+	lc_values_set(lc_app, 1, &id, &v);
+}
+
 static void led_rfkill_toggled (GtkCheckButton* self, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
@@ -449,68 +1058,240 @@ static void led_rfkill_toggled (GtkCheckButton* self, gpointer user_data)
 		return;
 	} else {
 		if (GTK_WIDGET(self) == lc_app->rfkill_tbtn1) {
-			set_value_to_text_file(LED_AIRPLANE_PATH "/trigger", "rfkill-none");
+			lc_trigger_set(lc_app, "rfkill-none");
 		};
 		if (GTK_WIDGET(self) == lc_app->rfkill_tbtn2) {
-			set_value_to_text_file(LED_AIRPLANE_PATH "/trigger", "phy0rx");
+			lc_trigger_set(lc_app, "phy0rx");
 		};
 		if (GTK_WIDGET(self) == lc_app->rfkill_tbtn3) {
-			set_value_to_text_file(LED_AIRPLANE_PATH "/trigger", "phy0tx");
+			lc_trigger_set(lc_app, "phy0tx");
 		};
 	}
 }
 
-gboolean update_values_timer(gpointer user_data)
+static void lc_value_store(lcontrol_app_t *lc_app, int id, int val)
+{
+	if (val < 0)
+		return;
+
+	switch (id) {
+		case SETTING_BAT_SOC:
+			lc_app->bat_soc = (double)val;
+			break;
+		case SETTING_BAT_START:
+			lc_app->bat_start_thres = (double)val;
+			break;
+		case SETTING_BAT_END:
+			lc_app->bat_end_thres = (double)val;
+			break;
+		case SETTING_CPU_PL1:
+			lc_app->cpu_pl1 = (double)val;
+			break;
+		case SETTING_CPU_PL2:
+			lc_app->cpu_pl2 = (double)val;
+			break;
+		case SETTING_LED_RED:
+			lc_app->red_val = val;
+			break;
+		case SETTING_LED_GREEN:
+			lc_app->green_val = val;
+			break;
+		case SETTING_LED_BLUE:
+			lc_app->blue_val = val;
+			break;
+		case SETTING_LED_KBD:
+			lc_app->kbd_backl = val;
+			break;
+		case SETTING_LED_AIRPLANE:
+			lc_app->airplane = (val > 0) ? true : false;
+			break;
+	}
+}
+
+// a value changed outside of our widgets, pending edits are left alone;
+// pages that were not built yet pick the value up when they are
+static void lc_value_changed(lcontrol_app_t *lc_app, int id, int val)
+{
+	if (val < 0)
+		return;
+
+	// our own writes echoing back while newer ones are queued
+	if (write_behind_busy(lc_app->wb, id))
+		return;
+	write_behind_seen(lc_app->wb, id, val);
+
+	lc_value_store(lc_app, id, val);
+
+	switch (id) {
+		case SETTING_BAT_SOC:
+			if (lc_app->bat_soc_pbar != NULL)
+				gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(lc_app->bat_soc_pbar), lc_app->bat_soc / 100.);
+			break;
+		case SETTING_BAT_START:
+		case SETTING_BAT_END:
+			if (lc_app->bat_apply_btn != NULL && !gtk_widget_get_sensitive(lc_app->bat_apply_btn)) {
+				lc_range_update(lc_app, lc_app->bat_start_slider, lc_app->bat_start_thres);
+				lc_range_update(lc_app, lc_app->bat_end_slider, lc_app->bat_end_thres);
+			}
+			break;
+		case SETTING_CPU_PL1:
+		case SETTING_CPU_PL2:
+			if (lc_app->cpu_apply_btn != NULL && !gtk_widget_get_sensitive(lc_app->cpu_apply_btn)) {
+				lc_range_update(lc_app, lc_app->cpu_pl1_slider, lc_app->cpu_pl1);
+				lc_range_update(lc_app, lc_app->cpu_pl2_slider, lc_app->cpu_pl2);
+			}
+			break;
+		case SETTING_LED_RED:
+		case SETTING_LED_GREEN:
+		case SETTING_LED_BLUE:
+			if (lc_app->notif_cbtn == NULL)
+				break;
+			if (id == SETTING_LED_RED)
+				lc_range_update(lc_app, lc_app->notif_red_slider, val);
+			else if (id == SETTING_LED_GREEN)
+				lc_range_update(lc_app, lc_app->notif_green_slider, val);
+			else
+				lc_range_update(lc_app, lc_app->notif_blue_slider, val);
+			update_notif_cbtn(lc_app);
+			break;
+		case SETTING_LED_KBD:
+			if (lc_app->kbd_backl_slider != NULL)
+				lc_range_update(lc_app, lc_app->kbd_backl_slider, val);
+			break;
+	}
+}
+
+static void bat_changed(const psu_event_t *ev, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 	int val;
 
-	val = get_value_from_text_file(BAT_SOC);
-	if (val >= 0) {
-		lc_app->bat_soc = (double)val;
-			gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(lc_app->bat_soc_pbar), lc_app->bat_soc / 100.);
+	// uevents carry the new capacity, no need to go to sysfs for it
+	if (ev->name != NULL) {
+		if (strcmp(ev->name, BAT_NAME) != 0)
+			return;
+		charge_ctl_status(lc_app->cc, ev->status);
+		val = ev->capacity;
+	} else
+		val = sysfs_attr_read_int(&settings[SETTING_BAT_SOC].attr);
+
+	if (val >= 0 && (double)val != lc_app->bat_soc)
+		lc_value_changed(lc_app, SETTING_BAT_SOC, val);
+}
+
+static void ec_label_update(GtkWidget *label, GVariant *v)
+{
+	const char *s = g_variant_get_string(v, NULL);
+
+	gtk_label_set_text(GTK_LABEL(label), (s[0] != 0) ? s : "\u2026");
+}
+
+// librem-controld pushes every change, no polling on our side
+static void lc_props_changed(GDBusProxy *proxy, GVariant *changed, GStrv invalidated, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	GVariantIter iter;
+	const char *name;
+	GVariant *v;
+	int id;
+
+	g_variant_iter_init(&iter, changed);
+	while (g_variant_iter_next(&iter, "{&sv}", &name, &v)) {
+		id = settings_find_name(name);
+		if (id >= 0 && g_variant_is_of_type(v, G_VARIANT_TYPE_INT32))
+			lc_value_changed(lc_app, id, g_variant_get_int32(v));
+		else if (id == SETTING_BAT_STATUS)
+			charge_ctl_status(lc_app->cc, g_variant_get_string(v, NULL));
+		else if (strcmp(name, LCD_PROP_GOVERNOR) == 0) {
+			lc_app->cpu_gov_mode = MAX(pl_gov_mode_parse(g_variant_get_string(v, NULL)), PL_GOV_OFF);
+			cpu_gov_show(lc_app);
+		} else if (strcmp(name, LCD_PROP_GOVERNOR_TARGET) == 0) {
+			lc_app->cpu_gov_target_val = g_variant_get_int32(v);
+			cpu_gov_show(lc_app);
+		} else if (strcmp(name, LCD_PROP_FAN_DUTY) == 0) {
+			lc_app->cpu_fan_duty = g_variant_get_int32(v);
+			cpu_fan_show(lc_app);
+		} else if (strcmp(name, LCD_PROP_FAN_RPM) == 0) {
+			lc_app->cpu_fan_rpm = g_variant_get_int32(v);
+			cpu_fan_show(lc_app);
+		} else if (strcmp(name, LCD_PROP_CPU_POWER) == 0)
+			cpu_power_show(lc_app, g_variant_get_double(v));
+		else if (strcmp(name, LCD_PROP_FAN_CURVE) == 0)
+			cpu_fan_curve_show(lc_app, g_variant_get_string(v, NULL));
+		else if (strcmp(name, LCD_PROP_LED_PATTERN) == 0 && lc_app->notif_pattern_entry != NULL)
+			gtk_editable_set_text(GTK_EDITABLE(lc_app->notif_pattern_entry), g_variant_get_string(v, NULL));
+		else if (strcmp(name, "EcVersion") == 0 && lc_app->ec_version_label != NULL)
+			ec_label_update(lc_app->ec_version_label, v);
+		else if (strcmp(name, "EcBoard") == 0 && lc_app->ec_board_label != NULL)
+			ec_label_update(lc_app->ec_board_label, v);
+		g_variant_unref(v);
 	}
-	return G_SOURCE_CONTINUE;
 }
 
-static void close_window (gpointer user_data)
+typedef struct {
+	char version[0x100];
+	char board[0x100];
+	GtkWidget *version_label;
+	GtkWidget *board_label;
+} ec_info_t;
+
+static int ec_info_job(int fd, gpointer data)
 {
-	//lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	ec_info_t *info = (ec_info_t *)data;
 
-    // clean up and quit
-	//gtk_application_remove_window(lc_app->gapp, GTK_WINDOW(lc_app->window));
+	if (get_ec_version(fd, info->version))
+		return -1;
+	if (get_ec_board(fd, info->board))
+		return -1;
+
+	return 0;
 }
 
+static void ec_info_done(int result, gpointer data, gpointer user_data)
+{
+	ec_info_t *info = (ec_info_t *)data;
 
-void create_main_window (lcontrol_app_t *lc_app)
+	if (result < 0) {
+		gtk_label_set_text(GTK_LABEL(info->version_label), "n/a");
+		gtk_label_set_text(GTK_LABEL(info->board_label), "n/a");
+		return;
+	}
+	gtk_label_set_text(GTK_LABEL(info->version_label), info->version);
+	gtk_label_set_text(GTK_LABEL(info->board_label), info->board);
+}
+
+static void ec_info_free(gpointer data)
 {
-    GtkWidget *box;
-    GtkWidget *w, *c;
-	GtkWidget *stack;
-	GtkWidget *stack_sb;
+	ec_info_t *info = (ec_info_t *)data;
 
-    gtk_window_set_title (GTK_WINDOW (lc_app->window), "Librem Control");
-	gtk_window_set_default_size(GTK_WINDOW(lc_app->window), 400, 300);
+	g_object_unref(info->version_label);
+	g_object_unref(info->board_label);
+	g_free(info);
+}
 
-    g_signal_connect (lc_app->window, "destroy",
-        G_CALLBACK (close_window), lc_app);
+static void close_window (GtkWidget *widget, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 
-    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
-    gtk_window_set_child (GTK_WINDOW (lc_app->window), box);
+	// the readout label is going away
+	if (lc_app->cpu_power_timer != 0)
+		g_source_remove(lc_app->cpu_power_timer);
+	lc_app->cpu_power_timer = 0;
+	lc_app->cpu_power_label = NULL;
+	lc_app->cpu_fan_label = NULL;
+	lc_app->cpu_fan_entry = NULL;
+	lc_app->kbd_scanning = false;
+	lc_app->kbd_grid = NULL;
+	lc_app->notif_pattern_entry = NULL;
 
-	stack_sb=gtk_stack_sidebar_new();
-	gtk_box_append(GTK_BOX(box), stack_sb);
+    // clean up and quit
+	//gtk_application_remove_window(lc_app->gapp, GTK_WINDOW(lc_app->window));
+}
 
-	stack=gtk_stack_new();
-	gtk_box_append(GTK_BOX(box), stack);
-	gtk_stack_set_transition_type(GTK_STACK(stack), GTK_STACK_TRANSITION_TYPE_CROSSFADE);
-	gtk_stack_sidebar_set_stack(GTK_STACK_SIDEBAR(stack_sb), GTK_STACK(stack));
 
-	//
-	// Battery page
-	//
-    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
-	gtk_stack_add_titled(GTK_STACK(stack), box, "Battery", "Battery");
+static void create_battery_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+    GtkWidget *w, *c;
 
 	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
 	gtk_box_append(GTK_BOX(box), c);
@@ -541,7 +1322,7 @@ void create_main_window (lcontrol_app_t *lc_app)
     gtk_range_set_value(GTK_RANGE(lc_app->bat_start_slider), lc_app->bat_start_thres);
     g_signal_connect (lc_app->bat_start_slider, "value-changed", G_CALLBACK (bat_start_val_chg), lc_app);
     gtk_widget_set_hexpand(lc_app->bat_start_slider, true);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(lc_app->bat_start_slider, false);
 	}
 	gtk_box_append(GTK_BOX(c), lc_app->bat_start_slider);
@@ -562,7 +1343,7 @@ void create_main_window (lcontrol_app_t *lc_app)
     gtk_range_set_value(GTK_RANGE(lc_app->bat_end_slider), lc_app->bat_end_thres);
     g_signal_connect (lc_app->bat_end_slider, "value-changed", G_CALLBACK (bat_end_val_chg), lc_app);
     gtk_widget_set_hexpand(lc_app->bat_end_slider, true);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(lc_app->bat_end_slider, false);
 	}
 	gtk_box_append(GTK_BOX(c), lc_app->bat_end_slider);
@@ -586,9 +1367,10 @@ void create_main_window (lcontrol_app_t *lc_app)
 
 	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
 	gtk_box_append(GTK_BOX(box), c);
-	w = gtk_button_new_with_label("Start charge now!");
+	w = gtk_button_new_with_label(START_CHARGE_LABEL);
 	gtk_widget_set_tooltip_text(w, "Will start charging immediately,\nup to End Charge Threshold");
-    if (!lc_app->is_root) {
+	lc_app->start_charge_btn = w;
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
 	}
     g_signal_connect (w, "clicked", G_CALLBACK (start_charge_now_clicked), lc_app);
@@ -599,10 +1381,11 @@ void create_main_window (lcontrol_app_t *lc_app)
 
 	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
 	gtk_box_append(GTK_BOX(box), c);
-	w = gtk_button_new_with_label("Stop charge now!");
+	w = gtk_button_new_with_label(STOP_CHARGE_LABEL);
 	gtk_widget_set_margin_bottom(w, 3);
+	lc_app->stop_charge_btn = w;
 	gtk_widget_set_tooltip_text(w, "Will stop charging immediately.");
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
 	}
     g_signal_connect (w, "clicked", G_CALLBACK (stop_charge_now_clicked), lc_app);
@@ -610,12 +1393,11 @@ void create_main_window (lcontrol_app_t *lc_app)
 	w = gtk_label_new("");
     gtk_widget_set_hexpand(w, true);
 	gtk_box_append(GTK_BOX(c), w);
+}
 
-	//
-	// CPU page
-	//
-    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
-	gtk_stack_add_titled(GTK_STACK(stack), box, "CPU", "CPU");
+static void create_cpu_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+    GtkWidget *w, *c;
 
 	w = gtk_frame_new("Long Term");
 	gtk_widget_set_margin_end(w, 3);
@@ -631,7 +1413,7 @@ void create_main_window (lcontrol_app_t *lc_app)
     gtk_range_set_value(GTK_RANGE(lc_app->cpu_pl1_slider), lc_app->cpu_pl1);
     g_signal_connect (lc_app->cpu_pl1_slider, "value-changed", G_CALLBACK (cpu_pl1_val_chg), lc_app);
     gtk_widget_set_hexpand(lc_app->cpu_pl1_slider, true);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(lc_app->cpu_pl1_slider, false);
 	}
 	gtk_box_append(GTK_BOX(c), lc_app->cpu_pl1_slider);
@@ -651,17 +1433,97 @@ void create_main_window (lcontrol_app_t *lc_app)
     gtk_range_set_value(GTK_RANGE(lc_app->cpu_pl2_slider), lc_app->cpu_pl2);
     g_signal_connect (lc_app->cpu_pl2_slider, "value-changed", G_CALLBACK (cpu_pl2_val_chg), lc_app);
     gtk_widget_set_hexpand(lc_app->cpu_pl2_slider, true);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(lc_app->cpu_pl2_slider, false);
 	}
 	gtk_box_append(GTK_BOX(c), lc_app->cpu_pl2_slider);
 	w = gtk_label_new("W");
 	gtk_box_append(GTK_BOX(c), w);
 
+	w = gtk_frame_new("Governor");
+	gtk_widget_set_margin_end(w, 3);
+	gtk_box_append(GTK_BOX(box), w);
+	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+	gtk_frame_set_child(GTK_FRAME(w), c);
+	w = gtk_drop_down_new_from_strings(cpu_gov_labels);
+	gtk_widget_set_tooltip_text(w, "Adjust PL1/PL2 continuously to hold a\ntemperature, battery drain or fan speed");
+	gtk_widget_set_hexpand(w, true);
+	gtk_widget_set_sensitive(w, lc_app->can_write);
+	lc_app->cpu_gov_dropdown = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_spin_button_new_with_range(0., 1., 1.);
+	lc_app->cpu_gov_target = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_label_new("");
+	lc_app->cpu_gov_unit = w;
+	gtk_box_append(GTK_BOX(c), w);
+	if (lc_app->proxy != NULL) {
+		GVariant *v;
+
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_GOVERNOR);
+		if (v != NULL) {
+			lc_app->cpu_gov_mode = MAX(pl_gov_mode_parse(g_variant_get_string(v, NULL)), PL_GOV_OFF);
+			g_variant_unref(v);
+		}
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_GOVERNOR_TARGET);
+		if (v != NULL) {
+			lc_app->cpu_gov_target_val = g_variant_get_int32(v);
+			g_variant_unref(v);
+		}
+	}
+
+	w = gtk_frame_new("Fan Curve");
+	gtk_widget_set_margin_end(w, 3);
+	gtk_box_append(GTK_BOX(box), w);
+	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+	gtk_frame_set_child(GTK_FRAME(w), c);
+	w = gtk_entry_new();
+	gtk_entry_set_placeholder_text(GTK_ENTRY(w), FAN_CURVE_DEFAULT);
+	gtk_widget_set_tooltip_text(w, "Package temperature in C to fan duty in %, e.g.\n"
+		FAN_CURVE_DEFAULT "\nEmpty leaves the fan to the EC");
+	gtk_widget_set_hexpand(w, true);
+	gtk_widget_set_sensitive(w, lc_app->can_write);
+	lc_app->cpu_fan_entry = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_label_new("");
+	lc_app->cpu_fan_label = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_button_new_from_icon_name("emblem-ok-symbolic");
+	gtk_widget_set_sensitive(w, lc_app->can_write);
+	g_signal_connect(w, "clicked", G_CALLBACK(cpu_fan_apply_clicked), lc_app);
+	g_signal_connect(lc_app->cpu_fan_entry, "activate", G_CALLBACK(cpu_fan_apply_clicked), lc_app);
+	gtk_box_append(GTK_BOX(c), w);
+	if (lc_app->proxy != NULL) {
+		GVariant *v;
+
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_FAN_CURVE);
+		if (v != NULL) {
+			cpu_fan_curve_show(lc_app, g_variant_get_string(v, NULL));
+			g_variant_unref(v);
+		}
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_FAN_DUTY);
+		if (v != NULL) {
+			lc_app->cpu_fan_duty = g_variant_get_int32(v);
+			g_variant_unref(v);
+		}
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_FAN_RPM);
+		if (v != NULL) {
+			lc_app->cpu_fan_rpm = g_variant_get_int32(v);
+			g_variant_unref(v);
+		}
+	} else if (!lc_app->fan_inited) {
+		fan_curve_init(&lc_app->fan);
+		lc_app->fan_inited = true;
+	}
+	cpu_fan_show(lc_app);
+
 	c = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
 	gtk_box_append(GTK_BOX(box), c);
 	w = gtk_label_new("");
     gtk_widget_set_hexpand(w, true);
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	gtk_widget_set_margin_start(w, 3);
+	lc_app->cpu_power_label = w;
 	gtk_box_append(GTK_BOX(c), w);
 	lc_app->cpu_undo_btn = gtk_button_new_from_icon_name("edit-undo-symbolic");
 	gtk_widget_set_sensitive(lc_app->cpu_undo_btn, false);
@@ -672,11 +1534,16 @@ void create_main_window (lcontrol_app_t *lc_app)
     g_signal_connect (lc_app->cpu_apply_btn, "clicked", G_CALLBACK (cpu_apply_clicked), lc_app);
 	gtk_box_append(GTK_BOX(c), lc_app->cpu_apply_btn);
 
-	//
-	// LEDs page
-	//
-    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
-	gtk_stack_add_titled(GTK_STACK(stack), box, "LEDs", "LEDs");
+	create_cpu_zones(lc_app, box);
+
+	cpu_gov_show(lc_app);
+	g_signal_connect(lc_app->cpu_gov_dropdown, "notify::selected", G_CALLBACK(cpu_gov_mode_chg), lc_app);
+	g_signal_connect(lc_app->cpu_gov_target, "value-changed", G_CALLBACK(cpu_gov_target_chg), lc_app);
+}
+
+static void create_leds_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+    GtkWidget *w, *c;
 
 	w = gtk_frame_new("Keyboard Backlight");
 	gtk_widget_set_margin_end(w, 3);
@@ -688,8 +1555,9 @@ void create_main_window (lcontrol_app_t *lc_app)
     gtk_scale_set_draw_value (GTK_SCALE(w), false);
     gtk_widget_set_hexpand(w, true);
     gtk_range_set_value(GTK_RANGE(w), lc_app->kbd_backl);
+    lc_app->kbd_backl_slider = w;
     g_signal_connect (w, "value-changed", G_CALLBACK (kbd_backl_val_chg), lc_app);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
     }
 	gtk_box_append(GTK_BOX(c), w);
@@ -725,7 +1593,7 @@ void create_main_window (lcontrol_app_t *lc_app)
 	w=gtk_label_new("R");
 	gtk_grid_attach(GTK_GRID(box), w, 1, 1, 1, 1);	
 	w = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0., 255., 1);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
 	}
     gtk_range_set_value(GTK_RANGE(w), lc_app->red_val);
@@ -736,7 +1604,7 @@ void create_main_window (lcontrol_app_t *lc_app)
 	w=gtk_label_new("G");
 	gtk_grid_attach(GTK_GRID(box), w, 1, 2, 1, 1);	
 	w = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0., 255., 1);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
 	}
     gtk_range_set_value(GTK_RANGE(w), lc_app->green_val);
@@ -746,7 +1614,7 @@ void create_main_window (lcontrol_app_t *lc_app)
 	w=gtk_label_new("B");
 	gtk_grid_attach(GTK_GRID(box), w, 1, 3, 1, 1);
 	w = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0., 255., 1);
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(w, false);
 	}
     gtk_range_set_value(GTK_RANGE(w), lc_app->blue_val);
@@ -763,17 +1631,253 @@ void create_main_window (lcontrol_app_t *lc_app)
 		rgba.alpha=1.;
 		gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(lc_app->notif_cbtn), &rgba);
 	}
-    if (!lc_app->is_root) {
+    if (!lc_app->can_write) {
         gtk_widget_set_sensitive(lc_app->notif_cbtn, false);
 	}
     g_signal_connect (lc_app->notif_cbtn, "color-set", G_CALLBACK (notif_cbtn_set), lc_app);
 	gtk_grid_attach(GTK_GRID(box), lc_app->notif_cbtn, 3, 1, 1, 3);	
 
-	//
-	// Info page
-	//
-    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
-	gtk_stack_add_titled(GTK_STACK(stack), box, "Info", "Info");
+	w = gtk_entry_new();
+	gtk_entry_set_placeholder_text(GTK_ENTRY(w), "breathe 00ff00 3000");
+	gtk_widget_set_tooltip_text(w, "solid RRGGBB, blink RRGGBB [ms], breathe RRGGBB [ms],\n"
+		"fade RRGGBB RRGGBB [ms] or keys ms:RRGGBB,ms:RRGGBB,... [loop]");
+	gtk_widget_set_sensitive(w, lc_app->can_write);
+	if (lc_app->proxy != NULL) {
+		GVariant *v;
+
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_LED_PATTERN);
+		if (v != NULL) {
+			gtk_editable_set_text(GTK_EDITABLE(w), g_variant_get_string(v, NULL));
+			g_variant_unref(v);
+		}
+	}
+	g_signal_connect(w, "activate", G_CALLBACK(notif_pattern_apply), lc_app);
+	lc_app->notif_pattern_entry = w;
+	gtk_grid_attach(GTK_GRID(box), w, 1, 4, 2, 1);
+	w = gtk_button_new_from_icon_name("emblem-ok-symbolic");
+	gtk_widget_set_sensitive(w, lc_app->can_write);
+	g_signal_connect(w, "clicked", G_CALLBACK(notif_pattern_apply), lc_app);
+	gtk_grid_attach(GTK_GRID(box), w, 3, 4, 1, 1);
+}
+
+typedef struct {
+	ec_console_t *ec;
+	char buf[EC_CONSOLE_RING];
+} ec_console_job_t;
+
+static int ec_console_job(int fd, gpointer data)
+{
+	ec_console_job_t *job = (ec_console_job_t *)data;
+
+	return ec_console_poll(job->ec, fd, job->buf, sizeof(job->buf));
+}
+
+static void ec_console_append(lcontrol_app_t *lc_app, const char *buf, int n)
+{
+	GtkTextBuffer *tb;
+	GtkTextIter start, end;
+	GtkTextMark *mark;
+	gchar *text;
+	int len;
+
+	tb = gtk_text_view_get_buffer(GTK_TEXT_VIEW(lc_app->ec_console_view));
+	text = g_utf8_make_valid(buf, n);
+	gtk_text_buffer_get_end_iter(tb, &end);
+	gtk_text_buffer_insert(tb, &end, text, -1);
+	g_free(text);
+
+	len = gtk_text_buffer_get_char_count(tb);
+	if (len > EC_CONSOLE_VIEW_MAX) {
+		gtk_text_buffer_get_start_iter(tb, &start);
+		gtk_text_buffer_get_iter_at_offset(tb, &end, len - EC_CONSOLE_VIEW_MAX);
+		gtk_text_buffer_delete(tb, &start, &end);
+	}
+
+	mark = gtk_text_buffer_get_insert(tb);
+	gtk_text_buffer_get_end_iter(tb, &end);
+	gtk_text_buffer_place_cursor(tb, &end);
+	gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(lc_app->ec_console_view), mark);
+}
+
+static void ec_console_run(lcontrol_app_t *lc_app);
+
+static gboolean ec_console_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->ec_console_timer = 0;
+	ec_console_run(lc_app);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void ec_console_done(int result, gpointer data, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	ec_console_job_t *job = (ec_console_job_t *)data;
+	ec_console_t *ec = lc_app->ec_console;
+	char buf[128];
+
+	lc_app->ec_console_busy = false;
+	if (result < 0) {
+		snprintf(buf, sizeof(buf), "EC console: %s", g_strerror(-result));
+		gtk_label_set_text(GTK_LABEL(lc_app->ec_console_label), buf);
+		return;
+	}
+	if (result > 0) {
+		ec_console_append(lc_app, job->buf, result);
+		snprintf(buf, sizeof(buf), "%lu bytes%s", ec->bytes,
+			ec->overruns ? ", some output may be missing" : "");
+		gtk_label_set_text(GTK_LABEL(lc_app->ec_console_label), buf);
+	}
+
+	// the next poll comes sooner while the EC is talking
+	if (lc_app->ec_console_on && lc_app->info_visible)
+		lc_app->ec_console_timer = g_timeout_add(ec->interval_ms, ec_console_timeout, lc_app);
+}
+
+// one poll in flight, the next is scheduled when it is back
+static void ec_console_run(lcontrol_app_t *lc_app)
+{
+	ec_console_job_t *job;
+
+	if (lc_app->ec_console_busy || lc_app->ec_console_timer != 0)
+		return;
+	if (!lc_app->ec_console_on || !lc_app->info_visible)
+		return;
+
+	if (lc_app->ec_console == NULL) {
+		lc_app->ec_console = g_new(ec_console_t, 1);
+		ec_console_init(lc_app->ec_console);
+	}
+	job = g_new(ec_console_job_t, 1);
+	job->ec = lc_app->ec_console;
+	lc_app->ec_console_busy = true;
+	ec_worker_queue(ec_console_job, job, g_free, ec_console_done, lc_app);
+}
+
+static void ec_console_toggled(GtkToggleButton *btn, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->ec_console_on = gtk_toggle_button_get_active(btn);
+	if (!lc_app->ec_console_on && lc_app->ec_console_timer != 0) {
+		g_source_remove(lc_app->ec_console_timer);
+		lc_app->ec_console_timer = 0;
+	}
+	ec_console_run(lc_app);
+}
+
+static void ec_stats_show(lcontrol_app_t *lc_app, const char *text)
+{
+	if (strcmp(gtk_label_get_text(GTK_LABEL(lc_app->ec_stats_label)), text) != 0)
+		gtk_label_set_text(GTK_LABEL(lc_app->ec_stats_label), text);
+}
+
+static int ec_stats_job(int fd, gpointer data)
+{
+	ec_stats_format((char *)data, EC_STATS_TEXT_LEN);
+
+	return 0;
+}
+
+static void ec_stats_done(int result, gpointer data, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->ec_stats_busy = false;
+	ec_stats_show(lc_app, (result < 0) ? g_strerror(-result) : (char *)data);
+}
+
+static void ec_stats_call_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	GError *err = NULL;
+	GVariant *ret;
+	const char *text;
+
+	lc_app->ec_stats_busy = false;
+	ret = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, &err);
+	if (ret == NULL) {
+		ec_stats_show(lc_app, err->message);
+		g_error_free(err);
+		return;
+	}
+	g_variant_get(ret, "(&s)", &text);
+	ec_stats_show(lc_app, text);
+	g_variant_unref(ret);
+}
+
+// the counters are those of whoever talks to the EC, librem-controld if it runs
+static gboolean ec_stats_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	if (lc_app->ec_stats_busy)
+		return G_SOURCE_CONTINUE;
+	lc_app->ec_stats_busy = true;
+	if (lc_app->proxy != NULL)
+		g_dbus_proxy_call(lc_app->proxy, LCD_METHOD_EC_STATS, NULL, G_DBUS_CALL_FLAGS_NONE,
+			-1, NULL, ec_stats_call_done, lc_app);
+	else
+		ec_worker_queue(ec_stats_job, g_malloc(EC_STATS_TEXT_LEN), g_free, ec_stats_done, lc_app);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void ec_stats_run(lcontrol_app_t *lc_app)
+{
+	gboolean on = lc_app->ec_stats_label != NULL && lc_app->info_visible;
+
+	if (on == (lc_app->ec_stats_timer != 0))
+		return;
+	if (!on) {
+		g_source_remove(lc_app->ec_stats_timer);
+		lc_app->ec_stats_timer = 0;
+		return;
+	}
+	lc_app->ec_stats_timer = g_timeout_add(EC_STATS_POLL_MS, ec_stats_timeout, lc_app);
+	ec_stats_timeout(lc_app);
+}
+
+// only without librem-controld, like the key matrix, the daemon owns the EC
+static void create_ec_console_frame(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	GtkWidget *w, *c, *h;
+
+	w = gtk_frame_new("EC Console");
+	gtk_widget_set_margin_end(w, 3);
+	gtk_widget_set_vexpand(w, true);
+	gtk_box_append(GTK_BOX(box), w);
+	c = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+	gtk_frame_set_child(GTK_FRAME(w), c);
+
+	h = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+	gtk_box_append(GTK_BOX(c), h);
+	w = gtk_toggle_button_new_with_label("Follow");
+	gtk_widget_set_tooltip_text(w, "Poll the EC debug output, faster while there is some");
+	g_signal_connect(w, "toggled", G_CALLBACK(ec_console_toggled), lc_app);
+	gtk_box_append(GTK_BOX(h), w);
+	w = gtk_label_new("");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	lc_app->ec_console_label = w;
+	gtk_box_append(GTK_BOX(h), w);
+
+	w = gtk_text_view_new();
+	gtk_text_view_set_editable(GTK_TEXT_VIEW(w), false);
+	gtk_text_view_set_monospace(GTK_TEXT_VIEW(w), true);
+	gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(w), GTK_WRAP_CHAR);
+	lc_app->ec_console_view = w;
+	h = gtk_scrolled_window_new();
+	gtk_widget_set_vexpand(h, true);
+	gtk_widget_set_size_request(h, -1, 120);
+	gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(h), w);
+	gtk_box_append(GTK_BOX(c), h);
+}
+
+static void create_info_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+    GtkWidget *w, *c;
 
 	w = gtk_frame_new("DMI");
 	gtk_widget_set_margin_end(w, 3);
@@ -820,71 +1924,833 @@ void create_main_window (lcontrol_app_t *lc_app)
 	    gtk_grid_attach (GTK_GRID(c), w, 2, 4, 1, 1);
 	}
 
-	if (lc_app->is_root) {
+	if (lc_app->is_root || lc_app->proxy != NULL) {
+		ec_info_t *info;
+
 		w = gtk_frame_new("EC");
 		gtk_widget_set_margin_end(w, 3);
 		gtk_box_append(GTK_BOX(box), w);
 	    c = gtk_grid_new();
 	    gtk_grid_set_row_spacing(GTK_GRID(c), 1);
 		gtk_frame_set_child(GTK_FRAME(w), c);
-		{
-			char buf[0x100];
-			int fd;
-
-			fd=port_open();
-			if (fd > 0) {
-				get_ec_version(fd, buf);
-				w = gtk_label_new("Version: ");
-				gtk_widget_set_halign(w, GTK_ALIGN_START);
-			    gtk_grid_attach (GTK_GRID(c), w, 1, 1, 1, 1);
-				w = gtk_label_new(buf);
-				gtk_widget_set_halign(w, GTK_ALIGN_START);
-			    gtk_grid_attach (GTK_GRID(c), w, 2, 1, 1, 1);
-
-				get_ec_board(fd, buf);
-				w = gtk_label_new("Board: ");
-				gtk_widget_set_halign(w, GTK_ALIGN_START);
-			    gtk_grid_attach (GTK_GRID(c), w, 1, 2, 1, 1);
-				w = gtk_label_new(buf);
-				gtk_widget_set_halign(w, GTK_ALIGN_START);
-			    gtk_grid_attach (GTK_GRID(c), w, 2, 2, 1, 1);
+
+		w = gtk_label_new("Version: ");
+		gtk_widget_set_halign(w, GTK_ALIGN_START);
+	    gtk_grid_attach (GTK_GRID(c), w, 1, 1, 1, 1);
+		w = gtk_label_new("\u2026");
+		gtk_widget_set_halign(w, GTK_ALIGN_START);
+	    gtk_grid_attach (GTK_GRID(c), w, 2, 1, 1, 1);
+		lc_app->ec_version_label = w;
+
+		w = gtk_label_new("Board: ");
+		gtk_widget_set_halign(w, GTK_ALIGN_START);
+	    gtk_grid_attach (GTK_GRID(c), w, 1, 2, 1, 1);
+		w = gtk_label_new("\u2026");
+		gtk_widget_set_halign(w, GTK_ALIGN_START);
+	    gtk_grid_attach (GTK_GRID(c), w, 2, 2, 1, 1);
+		lc_app->ec_board_label = w;
+
+		if (lc_app->proxy != NULL) {
+			GVariant *v;
+
+			// the daemon already asked the EC, updates arrive with the other properties
+			v = g_dbus_proxy_get_cached_property(lc_app->proxy, "EcVersion");
+			if (v != NULL) {
+				ec_label_update(lc_app->ec_version_label, v);
+				g_variant_unref(v);
+			}
+			v = g_dbus_proxy_get_cached_property(lc_app->proxy, "EcBoard");
+			if (v != NULL) {
+				ec_label_update(lc_app->ec_board_label, v);
+				g_variant_unref(v);
 			}
+		} else {
+			info = g_new0(ec_info_t, 1);
+			info->version_label = g_object_ref(lc_app->ec_version_label);
+			info->board_label = g_object_ref(lc_app->ec_board_label);
+
+			// filled in when the EC answers
+			ec_worker_queue(ec_info_job, info, ec_info_free, ec_info_done, NULL);
 		}
+
+		w = gtk_frame_new("EC Commands");
+		gtk_widget_set_margin_end(w, 3);
+		gtk_box_append(GTK_BOX(box), w);
+		c = gtk_label_new("");
+		gtk_label_set_xalign(GTK_LABEL(c), 0.);
+		gtk_widget_add_css_class(c, "monospace");
+		gtk_widget_set_tooltip_text(c, "Counters and latency percentiles of every EC command since start");
+		lc_app->ec_stats_label = c;
+		gtk_frame_set_child(GTK_FRAME(w), c);
 	}
+
+	if (lc_app->is_root && lc_app->proxy == NULL)
+		create_ec_console_frame(lc_app, box);
 }
 
+static void profile_apply_clicked(GtkWidget *widget, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	profile_t *p = g_object_get_data(G_OBJECT(widget), "lc-profile");
+	GVariant *values[SETTING_NUM];
+	int i;
+
+	for (i = 0; i < p->n; i++) {
+		if (settings[p->ids[i]].type == SETTING_INT)
+			values[i] = g_variant_new_int32(atoi(p->values[i]));
+		else
+			values[i] = g_variant_new_string(p->values[i]);
+	}
+	lc_values_set(lc_app, p->n, p->ids, values);
 
-void gtest_app_activate (GApplication *application, gpointer user_data)
+	// direct writes do not echo back, show what the hardware has now
+	if (lc_app->proxy == NULL) {
+		settings_refresh_ids(p->ids, p->n);
+		for (i = 0; i < p->n; i++)
+			lc_value_changed(lc_app, p->ids[i], settings_int(p->ids[i]));
+	}
+}
+
+static void create_profiles_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	GString *tip;
+	profile_t *p;
+	GtkWidget *w;
+	int i, j;
+
+	lc_app->profiles = g_new0(profile_list_t, 1);
+	profile_load_default(lc_app->profiles);
+	if (lc_app->profiles->n == 0) {
+		w = gtk_label_new("No profiles, see " PROFILE_SYSTEM_PATH);
+		gtk_widget_set_margin_top(w, 3);
+		gtk_box_append(GTK_BOX(box), w);
+		return;
+	}
+
+	for (i = 0; i < lc_app->profiles->n; i++) {
+		p = &lc_app->profiles->p[i];
+		tip = g_string_new(NULL);
+		for (j = 0; j < p->n; j++)
+			g_string_append_printf(tip, "%s%s = %s", j ? "\n" : "", settings[p->ids[j]].key, p->values[j]);
+
+		w = gtk_button_new_with_label(p->name);
+		gtk_widget_set_tooltip_text(w, tip->str);
+		gtk_widget_set_margin_end(w, 3);
+		if (i == 0)
+			gtk_widget_set_margin_top(w, 3);
+		gtk_widget_set_sensitive(w, lc_app->can_write);
+		g_object_set_data(G_OBJECT(w), "lc-profile", p);
+		g_signal_connect(w, "clicked", G_CALLBACK(profile_apply_clicked), lc_app);
+		gtk_box_append(GTK_BOX(box), w);
+		g_string_free(tip, TRUE);
+	}
+}
+
+typedef struct {
+	key_matrix_t *km;
+	key_event_t ev[KBD_SCAN_EVENTS];
+} kbd_scan_t;
+
+static void kbd_scan_run(lcontrol_app_t *lc_app);
+
+static int kbd_scan_job(int fd, gpointer data)
+{
+	kbd_scan_t *scan = (kbd_scan_t *)data;
+
+	return key_matrix_scan(scan->km, fd, scan->ev, KBD_SCAN_EVENTS,
+		key_matrix_now_us() + KEY_MATRIX_BATCH_MS * 1000);
+}
+
+// the grid is only built once the EC has told us its size
+static void kbd_grid_build(lcontrol_app_t *lc_app)
+{
+	key_matrix_t *km = lc_app->kbd_matrix;
+	char buf[16];
+	GtkWidget *w;
+	int r, c;
+
+	for (r = 0; r < km->rows; r++) {
+		for (c = 0; c < km->cols; c++) {
+			snprintf(buf, sizeof(buf), "%d/%d", r, c);
+			w = gtk_label_new(buf);
+			gtk_widget_set_size_request(w, 36, -1);
+			lc_app->kbd_cells[r][c] = w;
+			gtk_grid_attach(GTK_GRID(lc_app->kbd_grid), w, c, r, 1, 1);
+		}
+	}
+}
+
+static void kbd_scan_show(lcontrol_app_t *lc_app, int n, const key_event_t *ev)
+{
+	key_matrix_t *km = lc_app->kbd_matrix;
+	key_matrix_stats_t *st = &km->stats;
+	GtkWidget *cell;
+	char buf[256];
+	int i;
+
+	if (lc_app->kbd_cells[0][0] == NULL)
+		kbd_grid_build(lc_app);
+
+	for (i = 0; i < n; i++) {
+		cell = lc_app->kbd_cells[ev[i].row][ev[i].col];
+		if (ev[i].flags & KEY_EV_PRESS)
+			gtk_widget_add_css_class(cell, "accent");
+		else
+			gtk_widget_remove_css_class(cell, "accent");
+		// flaky keys stay marked
+		if (ev[i].flags & KEY_EV_CHATTER)
+			gtk_widget_add_css_class(cell, "warning");
+	}
+	if (n > 0) {
+		snprintf(buf, sizeof(buf), "%d/%d %s within %u \u00b5s%s%s", ev[n - 1].row, ev[n - 1].col,
+			(ev[n - 1].flags & KEY_EV_PRESS) ? "pressed" : "released", ev[n - 1].window_us,
+			(ev[n - 1].flags & KEY_EV_CHATTER) ? ", chatter" : "",
+			(ev[n - 1].flags & KEY_EV_GHOST) ? ", ghosting possible" : "");
+		gtk_label_set_text(GTK_LABEL(lc_app->kbd_event_label), buf);
+	}
+
+	snprintf(buf, sizeof(buf), "%.0f polls/s, poll %.0f \u00b5s avg %lld max, gap %lld \u00b5s max\n"
+		"%lu events, %lu chatter, %lu ghosting, %lu errors",
+		key_matrix_rate(km), st->polls ? (double)st->cost_sum_us / st->polls : 0.,
+		(long long)st->cost_max_us, (long long)st->window_max_us,
+		st->events, st->chatter, st->ghosts, st->errors);
+	if (strcmp(gtk_label_get_text(GTK_LABEL(lc_app->kbd_stats_label)), buf) != 0)
+		gtk_label_set_text(GTK_LABEL(lc_app->kbd_stats_label), buf);
+}
+
+static void kbd_scan_done(int result, gpointer data, gpointer user_data)
 {
 	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	kbd_scan_t *scan = (kbd_scan_t *)data;
 
-    if (getuid() == 0 || geteuid() == 0) {
-        lc_app->is_root=true;
+	lc_app->kbd_busy = false;
+	if (lc_app->kbd_grid == NULL)
+		return;
+	if (result < 0) {
+		gtk_label_set_text(GTK_LABEL(lc_app->kbd_stats_label), g_strerror(-result));
+		lc_app->kbd_scanning = false;
+		return;
+	}
+
+	kbd_scan_show(lc_app, result, scan->ev);
+	kbd_scan_run(lc_app);
+}
+
+// back to back jobs while the page is visible, other EC jobs get in between
+static void kbd_scan_run(lcontrol_app_t *lc_app)
+{
+	kbd_scan_t *scan;
+
+	if (lc_app->kbd_busy || !lc_app->kbd_scanning || !lc_app->kbd_visible)
+		return;
+
+	if (lc_app->kbd_matrix == NULL) {
+		lc_app->kbd_matrix = g_new(key_matrix_t, 1);
+		key_matrix_init(lc_app->kbd_matrix);
+	}
+	scan = g_new(kbd_scan_t, 1);
+	scan->km = lc_app->kbd_matrix;
+	lc_app->kbd_busy = true;
+	ec_worker_queue(kbd_scan_job, scan, g_free, kbd_scan_done, lc_app);
+}
+
+static void kbd_scan_toggled(GtkToggleButton *btn, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->kbd_scanning = gtk_toggle_button_get_active(btn);
+	kbd_scan_run(lc_app);
+}
+
+// the job works on its own copy of the wanted state, edits go on meanwhile
+typedef struct {
+	kbd_led_t *kl;
+	kbd_led_state_t want;
+	gboolean load;
+	gboolean save;
+} kbd_led_job_t;
+
+static int kbd_led_job(int fd, gpointer data)
+{
+	kbd_led_job_t *job = (kbd_led_job_t *)data;
+	int res;
+
+	if (job->load)
+		return kbd_led_load(job->kl, fd);
+
+	res = kbd_led_flush(job->kl, fd, &job->want);
+	if (res >= 0 && job->save) {
+		int err = ec_led_save(fd);
+
+		if (err < 0)
+			return err;
+	}
+
+	return res;
+}
+
+static void kbd_led_rgba(const unsigned char *rgb, GdkRGBA *rgba)
+{
+	rgba->red = rgb[0] / 255.;
+	rgba->green = rgb[1] / 255.;
+	rgba->blue = rgb[2] / 255.;
+	rgba->alpha = 1.;
+}
+
+static void kbd_led_key_show(lcontrol_app_t *lc_app)
+{
+	GdkRGBA rgba;
+	int i;
+
+	i = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(lc_app->kbd_led_key_spin));
+	kbd_led_rgba(lc_app->kbd_led_want.color[i], &rgba);
+	gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(lc_app->kbd_led_key_cbtn), &rgba);
+}
+
+static void kbd_led_spin_update(lcontrol_app_t *lc_app, GtkWidget *w, int val)
+{
+	g_signal_handlers_block_matched(w, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(w), val);
+	g_signal_handlers_unblock_matched(w, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, lc_app);
+}
+
+static void kbd_led_run(lcontrol_app_t *lc_app, gboolean load);
+
+static void kbd_led_done(int result, gpointer data, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	kbd_led_job_t *job = (kbd_led_job_t *)data;
+	kbd_led_t *kl = lc_app->kbd_leds;
+	char buf[128];
+	GdkRGBA rgba;
+
+	lc_app->kbd_led_busy = false;
+	if (result < 0) {
+		snprintf(buf, sizeof(buf), "Keyboard LEDs: %s", g_strerror(-result));
+		gtk_label_set_text(GTK_LABEL(lc_app->kbd_led_label), buf);
+		// the shadow knows what got through, the rest goes with the next change
+		lc_app->kbd_led_dirty = false;
+		return;
+	}
+
+	if (job->load) {
+		lc_app->kbd_led_want = kl->have;
+		gtk_spin_button_set_range(GTK_SPIN_BUTTON(lc_app->kbd_led_key_spin), 0, kl->n - 1);
+		kbd_led_rgba(kl->have.color[0], &rgba);
+		gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(lc_app->kbd_led_all_cbtn), &rgba);
+		kbd_led_key_show(lc_app);
+		kbd_led_spin_update(lc_app, lc_app->kbd_led_mode_spin, kl->have.mode[0][0]);
+		kbd_led_spin_update(lc_app, lc_app->kbd_led_speed_spin, kl->have.mode[0][1]);
+		gtk_widget_set_sensitive(lc_app->kbd_led_box, true);
+		gtk_widget_set_sensitive(lc_app->kbd_led_key_spin, !kl->zone);
+		gtk_widget_set_sensitive(lc_app->kbd_led_key_cbtn, !kl->zone);
+		if (kl->zone)
+			snprintf(buf, sizeof(buf), "One zone, %d layers", kl->layers);
+		else
+			snprintf(buf, sizeof(buf), "%d LEDs, %d layers", kl->n, kl->layers);
+	} else
+		snprintf(buf, sizeof(buf), "Last change %d commands in %.1f ms%s",
+			kl->cmds, kl->flush_us / 1000., job->save ? ", saved" : "");
+	gtk_label_set_text(GTK_LABEL(lc_app->kbd_led_label), buf);
+
+	if (lc_app->kbd_led_dirty || lc_app->kbd_led_save)
+		kbd_led_run(lc_app, false);
+}
+
+// at most one job in flight, changes made meanwhile go out with the next
+static void kbd_led_run(lcontrol_app_t *lc_app, gboolean load)
+{
+	kbd_led_job_t *job;
+
+	if (lc_app->kbd_led_busy) {
+		lc_app->kbd_led_dirty = true;
+		return;
+	}
+
+	if (lc_app->kbd_leds == NULL)
+		lc_app->kbd_leds = g_new0(kbd_led_t, 1);
+	job = g_new(kbd_led_job_t, 1);
+	job->kl = lc_app->kbd_leds;
+	job->want = lc_app->kbd_led_want;
+	job->load = load;
+	job->save = lc_app->kbd_led_save;
+	lc_app->kbd_led_dirty = false;
+	lc_app->kbd_led_save = false;
+	lc_app->kbd_led_busy = true;
+	ec_worker_queue(kbd_led_job, job, g_free, kbd_led_done, lc_app);
+}
+
+static void kbd_led_cbtn_rgb(GtkColorButton *btn, unsigned char *rgb)
+{
+	GdkRGBA rgba;
+
+	gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(btn), &rgba);
+	rgb[0] = (int)(rgba.red * 255.);
+	rgb[1] = (int)(rgba.green * 255.);
+	rgb[2] = (int)(rgba.blue * 255.);
+}
+
+static void kbd_led_all_set(GtkColorButton *self, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	unsigned char rgb[3];
+
+	kbd_led_cbtn_rgb(self, rgb);
+	kbd_led_set_color(lc_app->kbd_leds, &lc_app->kbd_led_want, EC_LED_ALL, rgb);
+	kbd_led_key_show(lc_app);
+	kbd_led_run(lc_app, false);
+}
+
+static void kbd_led_key_set(GtkColorButton *self, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	unsigned char rgb[3];
+	int i;
+
+	i = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(lc_app->kbd_led_key_spin));
+	kbd_led_cbtn_rgb(self, rgb);
+	kbd_led_set_color(lc_app->kbd_leds, &lc_app->kbd_led_want, i, rgb);
+	kbd_led_run(lc_app, false);
+}
+
+static void kbd_led_key_chg(GtkSpinButton *self, gpointer user_data)
+{
+	kbd_led_key_show((lcontrol_app_t *) user_data);
+}
+
+static void kbd_led_mode_chg(GtkSpinButton *self, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	kbd_led_set_mode(lc_app->kbd_leds, &lc_app->kbd_led_want, 0,
+		gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(lc_app->kbd_led_mode_spin)),
+		gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(lc_app->kbd_led_speed_spin)));
+	kbd_led_run(lc_app, false);
+}
+
+static void kbd_led_save_clicked(GtkButton *btn, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	lc_app->kbd_led_save = true;
+	kbd_led_run(lc_app, false);
+}
+
+static void create_kbd_led_frame(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	GtkWidget *w, *c, *g;
+
+	w = gtk_frame_new("Key Lighting");
+	gtk_widget_set_margin_end(w, 3);
+	gtk_box_append(GTK_BOX(box), w);
+	c = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+	gtk_frame_set_child(GTK_FRAME(w), c);
+
+	g = gtk_grid_new();
+	gtk_grid_set_column_spacing(GTK_GRID(g), 4);
+	gtk_grid_set_row_spacing(GTK_GRID(g), 2);
+	gtk_widget_set_sensitive(g, false);
+	lc_app->kbd_led_box = g;
+	gtk_box_append(GTK_BOX(c), g);
+
+	w = gtk_label_new("All keys");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	gtk_grid_attach(GTK_GRID(g), w, 0, 0, 1, 1);
+	w = gtk_color_button_new();
+	gtk_color_chooser_set_use_alpha(GTK_COLOR_CHOOSER(w), false);
+	g_signal_connect(w, "color-set", G_CALLBACK(kbd_led_all_set), lc_app);
+	lc_app->kbd_led_all_cbtn = w;
+	gtk_grid_attach(GTK_GRID(g), w, 1, 0, 1, 1);
+
+	w = gtk_label_new("Key");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	gtk_grid_attach(GTK_GRID(g), w, 0, 1, 1, 1);
+	w = gtk_spin_button_new_with_range(0., 0., 1.);
+	g_signal_connect(w, "value-changed", G_CALLBACK(kbd_led_key_chg), lc_app);
+	lc_app->kbd_led_key_spin = w;
+	gtk_grid_attach(GTK_GRID(g), w, 1, 1, 1, 1);
+	w = gtk_color_button_new();
+	gtk_color_chooser_set_use_alpha(GTK_COLOR_CHOOSER(w), false);
+	g_signal_connect(w, "color-set", G_CALLBACK(kbd_led_key_set), lc_app);
+	lc_app->kbd_led_key_cbtn = w;
+	gtk_grid_attach(GTK_GRID(g), w, 2, 1, 1, 1);
+
+	w = gtk_label_new("Mode / speed");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	gtk_grid_attach(GTK_GRID(g), w, 0, 2, 1, 1);
+	w = gtk_spin_button_new_with_range(0., 255., 1.);
+	g_signal_connect(w, "value-changed", G_CALLBACK(kbd_led_mode_chg), lc_app);
+	lc_app->kbd_led_mode_spin = w;
+	gtk_grid_attach(GTK_GRID(g), w, 1, 2, 1, 1);
+	w = gtk_spin_button_new_with_range(0., 255., 1.);
+	g_signal_connect(w, "value-changed", G_CALLBACK(kbd_led_mode_chg), lc_app);
+	lc_app->kbd_led_speed_spin = w;
+	gtk_grid_attach(GTK_GRID(g), w, 2, 2, 1, 1);
+
+	w = gtk_button_new_with_label("Save");
+	gtk_widget_set_tooltip_text(w, "Keep the key lighting across reboots, writes the EC flash");
+	g_signal_connect(w, "clicked", G_CALLBACK(kbd_led_save_clicked), lc_app);
+	gtk_grid_attach(GTK_GRID(g), w, 3, 2, 1, 1);
+
+	w = gtk_label_new("");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	lc_app->kbd_led_label = w;
+	gtk_box_append(GTK_BOX(c), w);
+
+	kbd_led_run(lc_app, true);
+}
+
+static void create_keyboard_page(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	GtkWidget *w, *c;
+
+	w = gtk_frame_new("Key Matrix");
+	gtk_widget_set_margin_end(w, 3);
+	gtk_widget_set_margin_top(w, 3);
+	gtk_box_append(GTK_BOX(box), w);
+	c = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+	gtk_frame_set_child(GTK_FRAME(w), c);
+
+	// the daemon owns the EC, the scanner would race with it
+	if (!lc_app->is_root || lc_app->proxy != NULL) {
+		w = gtk_label_new("Needs root and librem-controld not running,\nor use librem-control-cli --matrix and --kbd-*");
+		gtk_box_append(GTK_BOX(c), w);
+		return;
+	}
+
+	w = gtk_toggle_button_new_with_label("Scan");
+	gtk_widget_set_tooltip_text(w, "Poll the EC key matrix as fast as it answers");
+	gtk_widget_set_halign(w, GTK_ALIGN_START);
+	g_signal_connect(w, "toggled", G_CALLBACK(kbd_scan_toggled), lc_app);
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_grid_new();
+	gtk_grid_set_row_spacing(GTK_GRID(w), 1);
+	gtk_grid_set_column_spacing(GTK_GRID(w), 1);
+	lc_app->kbd_grid = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_label_new("");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	lc_app->kbd_event_label = w;
+	gtk_box_append(GTK_BOX(c), w);
+	w = gtk_label_new("");
+	gtk_label_set_xalign(GTK_LABEL(w), 0.);
+	lc_app->kbd_stats_label = w;
+	gtk_box_append(GTK_BOX(c), w);
+
+	create_kbd_led_frame(lc_app, box);
+}
+
+// pages are filled in when they are first shown, together with the
+// hardware reads they need
+typedef struct {
+	const char *name;
+	void (*create)(lcontrol_app_t *lc_app, GtkWidget *box);
+	int n_settings;
+	int settings[SETTING_NUM];
+} lc_page_t;
+
+static const lc_page_t lc_pages[] = {
+	{ "Battery", create_battery_page, 3, { SETTING_BAT_SOC, SETTING_BAT_START, SETTING_BAT_END } },
+	{ "CPU", create_cpu_page, 2, { SETTING_CPU_PL1, SETTING_CPU_PL2 } },
+	{ "LEDs", create_leds_page, 5, { SETTING_LED_RED, SETTING_LED_GREEN, SETTING_LED_BLUE,
+		SETTING_LED_KBD, SETTING_LED_AIRPLANE } },
+	{ "Profiles", create_profiles_page, 0, { 0 } },
+	{ "Keyboard", create_keyboard_page, 0, { 0 } },
+	{ "Info", create_info_page, 0, { 0 } },
+};
+
+static void lc_page_build(lcontrol_app_t *lc_app, GtkWidget *box)
+{
+	const lc_page_t *page;
+	gint64 t;
+	int i, syscalls = 0;
+
+	page = g_object_get_data(G_OBJECT(box), "lc-page");
+	if (page == NULL)
+		return;
+	g_object_set_data(G_OBJECT(box), "lc-page", NULL);
+
+	t = g_get_monotonic_time();
+	if (lc_app->proxy == NULL && page->n_settings > 0)
+		syscalls = settings_refresh_ids(page->settings, page->n_settings);
+	for (i = 0; i < page->n_settings; i++)
+		lc_value_store(lc_app, page->settings[i], lc_value_get(lc_app, page->settings[i]));
+	page->create(lc_app, box);
+	g_debug("page %s: %d syscalls, built in %.1f ms", page->name, syscalls,
+		(g_get_monotonic_time() - t) / 1000.);
+}
+
+static gboolean cpu_power_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	gint64 now = g_get_monotonic_time();
+	char buf[64];
+	int res;
+
+	res = rapl_sampler_sample(&lc_app->cpu_power, now);
+	if (res < 0) {
+		gtk_label_set_text(GTK_LABEL(lc_app->cpu_power_label), "Package power not readable");
+		lc_app->cpu_power_timer = 0;
+		return G_SOURCE_REMOVE;
+	}
+	if (res == 0 || now - lc_app->cpu_power_shown < CPU_POWER_DISPLAY_MS * 1000)
+		return G_SOURCE_CONTINUE;
+
+	lc_app->cpu_power_shown = now;
+	snprintf(buf, sizeof(buf), "Package %.1f W, %.1f W avg", lc_app->cpu_power.power, lc_app->cpu_power.avg);
+	if (strcmp(gtk_label_get_text(GTK_LABEL(lc_app->cpu_power_label)), buf) != 0)
+		gtk_label_set_text(GTK_LABEL(lc_app->cpu_power_label), buf);
+
+	return G_SOURCE_CONTINUE;
+}
+
+// the sampler only runs while somebody can see the result
+static void cpu_power_run(lcontrol_app_t *lc_app, gboolean visible)
+{
+	const char *env;
+	GVariant *v;
+	int rate = CPU_POWER_RATE;
+
+	if (!visible || lc_app->cpu_power_label == NULL) {
+		if (lc_app->cpu_power_timer != 0)
+			g_source_remove(lc_app->cpu_power_timer);
+		lc_app->cpu_power_timer = 0;
+		return;
 	}
+	if (lc_app->cpu_power_timer != 0)
+		return;
+
+	if (lc_app->proxy != NULL) {
+		v = g_dbus_proxy_get_cached_property(lc_app->proxy, LCD_PROP_CPU_POWER);
+		if (v != NULL) {
+			cpu_power_show(lc_app, g_variant_get_double(v));
+			g_variant_unref(v);
+		}
+		return;
+	}
+
+	if (lc_app->cpu_power_state == 0) {
+		lc_app->cpu_power_state = rapl_sampler_init(&lc_app->cpu_power, CPU_ENERGY_PATH,
+			CPU_ENERGY_RANGE_PATH, RAPL_SAMPLER_WINDOW_MS);
+		if (lc_app->cpu_power_state == 0)
+			lc_app->cpu_power_state = 1;
+	}
+	if (lc_app->cpu_power_state < 0) {
+		gtk_label_set_text(GTK_LABEL(lc_app->cpu_power_label),
+			(lc_app->cpu_power_state == -EACCES) ? "Package power needs root" : "");
+		return;
+	}
+
+	env = g_getenv("LIBREM_CONTROL_RAPL_RATE");
+	if (env != NULL)
+		rate = CLAMP(atoi(env), 1, 100);
+	lc_app->cpu_power_timer = g_timeout_add(1000 / rate, cpu_power_timeout, lc_app);
+}
+
+static void lc_page_shown(GObject *stack, GParamSpec *pspec, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+	GtkWidget *box;
+	const char *name;
+
+	box = gtk_stack_get_visible_child(GTK_STACK(stack));
+	if (box != NULL)
+		lc_page_build(lc_app, box);
+	name = gtk_stack_get_visible_child_name(GTK_STACK(stack));
+	cpu_power_run(lc_app, name != NULL && strcmp(name, "CPU") == 0);
+	lc_app->fan_visible = (name != NULL && strcmp(name, "CPU") == 0);
+	cpu_fan_run(lc_app);
+	lc_app->kbd_visible = (name != NULL && strcmp(name, "Keyboard") == 0);
+	kbd_scan_run(lc_app);
+	lc_app->info_visible = (name != NULL && strcmp(name, "Info") == 0);
+	ec_console_run(lc_app);
+	ec_stats_run(lc_app);
+}
+
+static void lc_first_frame(GdkFrameClock *clock, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	g_signal_handlers_disconnect_by_func(clock, lc_first_frame, user_data);
+	g_debug("first frame after %.1f ms", (g_get_monotonic_time() - lc_app->start_time) / 1000.);
+	if (lc_app->bench)
+		g_application_quit(G_APPLICATION(lc_app->gapp));
+}
+
+static void lc_window_realized(GtkWidget *window, gpointer user_data)
+{
+	g_signal_connect(gtk_widget_get_frame_clock(window), "after-paint", G_CALLBACK(lc_first_frame), user_data);
+}
+
+void create_main_window (lcontrol_app_t *lc_app)
+{
+    GtkWidget *box;
+	GtkWidget *pages[G_N_ELEMENTS(lc_pages)];
+	GtkWidget *stack;
+	GtkWidget *stack_sb;
+	guint i;
+
+    gtk_window_set_title (GTK_WINDOW (lc_app->window), "Librem Control");
+	gtk_window_set_default_size(GTK_WINDOW(lc_app->window), 400, 300);
+
+    g_signal_connect (lc_app->window, "destroy",
+        G_CALLBACK (close_window), lc_app);
+    g_signal_connect (lc_app->window, "realize",
+        G_CALLBACK (lc_window_realized), lc_app);
+
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    gtk_window_set_child (GTK_WINDOW (lc_app->window), box);
+
+	stack_sb=gtk_stack_sidebar_new();
+	gtk_box_append(GTK_BOX(box), stack_sb);
+
+	stack=gtk_stack_new();
+	gtk_box_append(GTK_BOX(box), stack);
+	gtk_stack_set_transition_type(GTK_STACK(stack), GTK_STACK_TRANSITION_TYPE_CROSSFADE);
+	gtk_stack_sidebar_set_stack(GTK_STACK_SIDEBAR(stack_sb), GTK_STACK(stack));
+
+	for (i = 0; i < G_N_ELEMENTS(lc_pages); i++) {
+	    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+		g_object_set_data(G_OBJECT(box), "lc-page", (gpointer)&lc_pages[i]);
+		gtk_stack_add_titled(GTK_STACK(stack), box, lc_pages[i].name, lc_pages[i].name);
+		pages[i] = box;
+	}
+	// every page up front as before lazy building, for comparing start times
+	if (g_getenv("LIBREM_CONTROL_EAGER_PAGES") != NULL) {
+		for (i = 0; i < G_N_ELEMENTS(lc_pages); i++)
+			lc_page_build(lc_app, pages[i]);
+	}
+	// only the page that is shown first is built right away
+	lc_page_shown(G_OBJECT(stack), NULL, lc_app);
+	g_signal_connect(stack, "notify::visible-child", G_CALLBACK(lc_page_shown), lc_app);
+}
+
+static gboolean lc_bat_log_timeout(gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
+
+	bat_log_sample(&lc_app->bat_log);
+
+	return G_SOURCE_CONTINUE;
+}
+
+// without librem-controld the history goes to the user's state dir while we run
+static void lc_bat_log_open(lcontrol_app_t *lc_app)
+{
+	char *path;
+	char *dir;
+
+	path = g_build_filename(g_get_user_state_dir(), BAT_LOG_USER_FILE, NULL);
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	if (bat_log_open(&lc_app->bat_log, path, 1) == 0)
+		g_timeout_add_seconds(BAT_LOG_INTERVAL, lc_bat_log_timeout, lc_app);
+	g_free(dir);
+	g_free(path);
+}
+
+void gtest_app_activate (GApplication *application, gpointer user_data)
+{
+	lcontrol_app_t *lc_app=(lcontrol_app_t *) user_data;
 
 	lc_app->window = gtk_application_window_new (GTK_APPLICATION (application));
     create_main_window(lc_app);
     gtk_window_present (GTK_WINDOW(lc_app->window));
-    g_timeout_add_seconds(5, update_values_timer, lc_app);
+
+	if (lc_app->proxy != NULL) {
+		g_signal_connect(lc_app->proxy, "g-properties-changed", G_CALLBACK(lc_props_changed), lc_app);
+		return;
+	}
+    {
+		const char *watch[] = { BAT_SOC, NULL };
+		const char *env;
+		guint poll_interval = BAT_POLL_INTERVAL;
+
+		// polling is only used if uevents are not available
+		env = g_getenv("LIBREM_CONTROL_POLL_INTERVAL");
+		if (env != NULL)
+			poll_interval = atoi(env);
+		psu_monitor_add(watch, poll_interval, bat_changed, lc_app);
+	}
+	lc_bat_log_open(lc_app);
 }
 
 int main (int argc, char **argv)
 {
 static lcontrol_app_t lcontrol_app;
+int i;
+
+	lcontrol_app.start_time = g_get_monotonic_time();
+
+	// headless --get/--set is handled by the GTK free CLI, hand over before any GTK call
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--get") == 0 || strcmp(argv[i], "--set") == 0 ||
+		    strncmp(argv[i], "--set=", 6) == 0) {
+			argv[0] = LC_CLI_NAME;
+			execvp(LC_CLI_NAME, argv);
+			perror(LC_CLI_NAME);
+			return 1;
+		}
+	}
 
 	lcontrol_app.is_root = false;
 	lcontrol_app.cpu_pl1 = 15.0;
 	lcontrol_app.cpu_pl1 = 20.0;
 	lcontrol_app.bat_soc = 0.;
+	lcontrol_app.bat_log.fd = -1;
 	lcontrol_app.bat_start_thres = 90;
 	lcontrol_app.bat_end_thres = 100;
+	lcontrol_app.cpu_fan_duty = -1;
+	lcontrol_app.cpu_fan_rpm = -1;
+	lcontrol_app.fan_next_n = -1;
 
-	update_values_get(&lcontrol_app);
+    if (getuid() == 0 || geteuid() == 0) {
+        lcontrol_app.is_root=true;
+	}
 
-    lcontrol_app.gapp=gtk_application_new("com.purism.librem-control", G_APPLICATION_FLAGS_NONE);
+	// prefer librem-controld, its snapshot saves us all the sysfs and EC reads
+	lcontrol_app.proxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL,
+		LCD_BUS_NAME, LCD_OBJECT_PATH, LCD_INTERFACE, NULL, NULL);
+	if (lcontrol_app.proxy != NULL && g_dbus_proxy_get_name_owner(lcontrol_app.proxy) == NULL)
+		g_clear_object(&lcontrol_app.proxy);
+	lcontrol_app.can_write = lcontrol_app.is_root || lcontrol_app.proxy != NULL;
+	for (i = 0; i < SETTING_NUM; i++)
+		lcontrol_app.wb_attr[i] = (sysfs_attr_t)SYSFS_ATTR_INIT(settings[i].attr.path, settings[i].attr.flags);
+	lcontrol_app.wb = write_behind_new(lc_write_behind, &lcontrol_app);
+	lcontrol_app.cc = charge_ctl_new(lcontrol_app.wb);
+
+    // a fresh instance for every cold start measurement, gone after its first frame
+    lcontrol_app.bench = (g_getenv("LIBREM_CONTROL_BENCH") != NULL);
+    lcontrol_app.gapp=gtk_application_new("com.purism.librem-control",
+        lcontrol_app.bench ? G_APPLICATION_NON_UNIQUE : G_APPLICATION_FLAGS_NONE);
     g_signal_connect(lcontrol_app.gapp, "activate", G_CALLBACK (gtest_app_activate), &lcontrol_app);
     g_application_run (G_APPLICATION (lcontrol_app.gapp), argc, argv);
+    charge_ctl_free(lcontrol_app.cc);
+    bat_log_close(&lcontrol_app.bat_log);
+    if (lcontrol_app.cpu_power_state > 0)
+        rapl_sampler_close(&lcontrol_app.cpu_power);
+    g_free(lcontrol_app.profiles);
+    if (lcontrol_app.powercap != NULL) {
+        powercap_close(lcontrol_app.powercap);
+        g_free(lcontrol_app.powercap);
+    }
+    if (lcontrol_app.gov_inited) {
+        cpu_gov_run_local(&lcontrol_app, PL_GOV_OFF, 0);
+        pl_gov_close(&lcontrol_app.gov);
+    }
+    write_behind_free(lcontrol_app.wb);
+    for (i = 0; i < SETTING_NUM; i++)
+        sysfs_attr_close(&lcontrol_app.wb_attr[i]);
+    ec_worker_shutdown();
+    if (lcontrol_app.fan_inited)
+        fan_curve_close(&lcontrol_app.fan);
+    g_free(lcontrol_app.kbd_matrix);
+    g_free(lcontrol_app.kbd_leds);
+    g_free(lcontrol_app.ec_console);
+    if (lcontrol_app.anim_running)
+        led_anim_stop(&lcontrol_app.anim);
     g_object_unref (lcontrol_app.gapp);
+    g_clear_object(&lcontrol_app.proxy);
 
 return 0;
 }
@@ -0,0 +1,1001 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * librem-controld, system daemon owning all sysfs and EC access.
+ *
+ * Keeps a cached snapshot of the settings table plus the EC identity and
+ * exports it as read-only D-Bus properties. Changes are made through one
+ * Set(a{sv}) call that is authorized by polkit and applied as one
+ * transaction, rolled back if any value is refused.
+ * The snapshot is refreshed on power_supply uevents, after every Set and
+ * on a slow timer, PropertiesChanged is only sent for values that differ.
+ * Battery history is sampled once a second into the bat-log ring.
+ * The optional PL1/PL2 governor runs here too, so it keeps going without
+ * a GUI; while it is on the CPU limits can not be set directly.
+ * So does the fan curve, one step per interval on the EC worker, which
+ * also reports fan duty and speed while the EC runs its own curve.
+ * Notification LED patterns are played by the led-anim thread.
+ * Package power is sampled from RAPL once a second, energy_uj is root only.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include "ec-tool.h"
+#include "settings.h"
+#include "psu-monitor.h"
+#include "ec-worker.h"
+#include "bat-log.h"
+#include "rapl-sampler.h"
+#include "pl-governor.h"
+#include "fan-curve.h"
+#include "led-anim.h"
+#include "ec-stats.h"
+#include "librem-controld.h"
+
+// seconds, fallback if there are no power_supply uevents
+#define LCD_BAT_POLL_INTERVAL	5
+// seconds, catches changes made behind our back (hotkeys etc.)
+#define LCD_REFRESH_INTERVAL	10
+// seconds, battery history sampling
+#define LCD_BAT_LOG_INTERVAL	1
+// ms between fan readouts while the EC runs its own curve
+#define LCD_FAN_POLL_MS			2000
+// ms between package power samples
+#define LCD_CPU_POWER_MS		1000
+
+#define POLKIT_CHECK_ALLOW_INTERACTION	1
+
+typedef struct {
+	GMainLoop *loop;
+	GDBusConnection *conn;
+	GDBusNodeInfo *introspection;
+	guint reg_id;
+	gboolean session;
+	GVariant *cache[SETTING_NUM];
+	GVariant *ec_version;
+	GVariant *ec_board;
+	bat_log_t bat_log;
+	pl_gov_t gov;
+	int gov_target;			// as last set, also while off
+	guint gov_timer;
+	rapl_sampler_t cpu_power;
+	guint cpu_power_timer;	// 0 if RAPL is not readable
+	double cpu_power_w;		// as last announced, -1 if unknown
+	fan_curve_t fan;		// only the worker touches it while fan_busy
+	gboolean fan_busy;
+	fan_curve_point_t fan_next[FAN_CURVE_POINTS];
+	int fan_next_n;			// -1 if no new curve is waiting
+	char fan_spec[128];
+	guint fan_timer;
+	int fan_duty;			// as last announced
+	int fan_rpm;
+	int fan_err;
+	led_anim_t anim;
+	gboolean anim_running;
+	char led_pattern[128];
+} lcd_state_t;
+
+typedef struct {
+	char version[0x100];
+	char board[0x100];
+} lcd_ec_info_t;
+
+
+static GDBusNodeInfo *lcd_introspection_new(void)
+{
+	GDBusNodeInfo *info;
+	GString *xml;
+	int i;
+
+	xml = g_string_new("<node><interface name='" LCD_INTERFACE "'>"
+		"<method name='Set'><arg type='a{sv}' name='values' direction='in'/></method>"
+		"<method name='" LCD_METHOD_EC_STATS "'><arg type='s' name='stats' direction='out'/></method>"
+		"<property name='EcVersion' type='s' access='read'/>"
+		"<property name='EcBoard' type='s' access='read'/>"
+		"<property name='" LCD_PROP_GOVERNOR "' type='s' access='read'/>"
+		"<property name='" LCD_PROP_GOVERNOR_TARGET "' type='i' access='read'/>"
+		"<property name='" LCD_PROP_FAN_CURVE "' type='s' access='read'/>"
+		"<property name='" LCD_PROP_FAN_DUTY "' type='i' access='read'/>"
+		"<property name='" LCD_PROP_FAN_RPM "' type='i' access='read'/>"
+		"<property name='" LCD_PROP_CPU_POWER "' type='d' access='read'/>"
+		"<property name='" LCD_PROP_LED_PATTERN "' type='s' access='read'/>");
+	for (i = 0; i < SETTING_NUM; i++)
+		g_string_append_printf(xml, "<property name='%s' type='%s' access='read'/>",
+			settings[i].name, (settings[i].type == SETTING_INT) ? "i" : "s");
+	g_string_append(xml, "</interface></node>");
+
+	info = g_dbus_node_info_new_for_xml(xml->str, NULL);
+	g_string_free(xml, TRUE);
+
+	return info;
+}
+
+static GVariant *lcd_setting_value(int id)
+{
+	char buf[128];
+
+	if (settings[id].type == SETTING_INT)
+		return g_variant_new_int32(settings_int(id));
+
+	if (settings_read_string(id, buf, sizeof(buf)) < 0)
+		buf[0] = 0;
+
+	return g_variant_new_string(buf);
+}
+
+static void lcd_emit_changed(lcd_state_t *lcd, GVariantBuilder *changed)
+{
+	GVariantBuilder invalidated;
+
+	g_variant_builder_init(&invalidated, G_VARIANT_TYPE_STRING_ARRAY);
+	if (lcd->conn == NULL) {
+		g_variant_builder_clear(changed);
+		g_variant_builder_clear(&invalidated);
+		return;
+	}
+	g_dbus_connection_emit_signal(lcd->conn, NULL, LCD_OBJECT_PATH,
+		"org.freedesktop.DBus.Properties", "PropertiesChanged",
+		g_variant_new("(sa{sv}as)", LCD_INTERFACE, changed, &invalidated), NULL);
+}
+
+// refresh the snapshot, tell clients about what differs
+static void lcd_update(lcd_state_t *lcd)
+{
+	GVariantBuilder changed;
+	GVariant *val;
+	int i, n = 0;
+
+	settings_refresh();
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	for (i = 0; i < SETTING_NUM; i++) {
+		val = g_variant_ref_sink(lcd_setting_value(i));
+		if (lcd->cache[i] != NULL && g_variant_equal(lcd->cache[i], val)) {
+			g_variant_unref(val);
+			continue;
+		}
+		if (lcd->cache[i] != NULL)
+			g_variant_unref(lcd->cache[i]);
+		lcd->cache[i] = val;
+		g_variant_builder_add(&changed, "{sv}", settings[i].name, val);
+		n++;
+	}
+
+	if (n > 0) {
+		g_debug("update: %d changed", n);
+		lcd_emit_changed(lcd, &changed);
+	} else
+		g_variant_builder_clear(&changed);
+}
+
+static void lcd_psu_changed(const psu_event_t *ev, gpointer user_data)
+{
+	lcd_update((lcd_state_t *)user_data);
+}
+
+static gboolean lcd_refresh_timeout(gpointer user_data)
+{
+	lcd_update((lcd_state_t *)user_data);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean lcd_bat_log_timeout(gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+
+	bat_log_sample(&lcd->bat_log);
+
+	return G_SOURCE_CONTINUE;
+}
+
+// systemd's StateDirectory= tells us where, fall back to the default
+static void lcd_bat_log_open(lcd_state_t *lcd)
+{
+	const char *dir = g_getenv("STATE_DIRECTORY");
+	char *path;
+	int res;
+
+	path = (dir != NULL) ? g_build_filename(dir, "battery.log", NULL) : g_strdup(BAT_LOG_SYSTEM_PATH);
+	res = bat_log_open(&lcd->bat_log, path, 1);
+	if (res < 0)
+		g_warning("battery log %s: %s", path, g_strerror(-res));
+	else
+		g_timeout_add_seconds(LCD_BAT_LOG_INTERVAL, lcd_bat_log_timeout, lcd);
+	g_free(path);
+}
+
+static int lcd_ec_info_job(int fd, gpointer data)
+{
+	lcd_ec_info_t *info = (lcd_ec_info_t *)data;
+
+	if (get_ec_version(fd, info->version))
+		return -1;
+	if (get_ec_board(fd, info->board))
+		return -1;
+
+	return 0;
+}
+
+static void lcd_ec_info_done(int result, gpointer data, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	lcd_ec_info_t *info = (lcd_ec_info_t *)data;
+	GVariantBuilder changed;
+
+	if (result < 0) {
+		g_message("no EC information available");
+		return;
+	}
+
+	g_variant_unref(lcd->ec_version);
+	lcd->ec_version = g_variant_ref_sink(g_variant_new_string(info->version));
+	g_variant_unref(lcd->ec_board);
+	lcd->ec_board = g_variant_ref_sink(g_variant_new_string(info->board));
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&changed, "{sv}", "EcVersion", lcd->ec_version);
+	g_variant_builder_add(&changed, "{sv}", "EcBoard", lcd->ec_board);
+	lcd_emit_changed(lcd, &changed);
+}
+
+static gboolean lcd_gov_timeout(gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	int pl1, pl2, res;
+
+	if (pl_gov_step(&lcd->gov, g_get_monotonic_time(), &pl1, &pl2) <= 0)
+		return G_SOURCE_CONTINUE;
+
+	g_debug("governor: %s %.1f C %.1f W pkg %.1f W drain %d RPM -> PL1 %d W PL2 %d W",
+		pl_gov_mode_name(lcd->gov.mode), lcd->gov.temp_c, lcd->gov.power, lcd->gov.drain,
+		lcd->gov.fan_rpm, pl1, pl2);
+	res = pl_gov_apply(pl1, pl2);
+	if (res < 0)
+		g_warning("governor: %s", g_strerror(-res));
+	lcd_update(lcd);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void lcd_gov_emit(lcd_state_t *lcd)
+{
+	GVariantBuilder changed;
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&changed, "{sv}", LCD_PROP_GOVERNOR,
+		g_variant_new_string(pl_gov_mode_name(lcd->gov.mode)));
+	g_variant_builder_add(&changed, "{sv}", LCD_PROP_GOVERNOR_TARGET, g_variant_new_int32(lcd->gov_target));
+	lcd_emit_changed(lcd, &changed);
+}
+
+// switching off puts back the fixed limits the governor started from
+static int lcd_gov_set(lcd_state_t *lcd, int mode, int target)
+{
+	int pl1, pl2, res;
+
+	if (mode == PL_GOV_OFF) {
+		if (lcd->gov.mode == PL_GOV_OFF)
+			return 0;
+		pl1 = lcd->gov.user_pl1;
+		pl2 = lcd->gov.user_pl2;
+		pl_gov_start(&lcd->gov, PL_GOV_OFF, 0, pl1, pl2);
+		if (lcd->gov_timer != 0)
+			g_source_remove(lcd->gov_timer);
+		lcd->gov_timer = 0;
+		return pl_gov_apply(pl1, pl2);
+	}
+
+	if (lcd->gov.mode != PL_GOV_OFF) {
+		pl1 = lcd->gov.user_pl1;
+		pl2 = lcd->gov.user_pl2;
+	} else {
+		pl1 = settings_int(SETTING_CPU_PL1);
+		pl2 = settings_int(SETTING_CPU_PL2);
+	}
+	res = pl_gov_start(&lcd->gov, mode, target, pl1, pl2);
+	if (res < 0)
+		return res;
+	if (lcd->gov_timer == 0)
+		lcd->gov_timer = g_timeout_add(PL_GOV_INTERVAL_MS, lcd_gov_timeout, lcd);
+
+	return 0;
+}
+
+static void lcd_cpu_power_emit(lcd_state_t *lcd, double w)
+{
+	GVariantBuilder changed;
+
+	lcd->cpu_power_w = w;
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&changed, "{sv}", LCD_PROP_CPU_POWER, g_variant_new_double(w));
+	lcd_emit_changed(lcd, &changed);
+}
+
+// only changes of at least 0.1 W are announced
+static gboolean lcd_cpu_power_timeout(gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	double w;
+	int res;
+
+	res = rapl_sampler_sample(&lcd->cpu_power, g_get_monotonic_time());
+	if (res < 0) {
+		g_warning("package power: %s", g_strerror(-res));
+		rapl_sampler_close(&lcd->cpu_power);
+		lcd->cpu_power_timer = 0;
+		lcd_cpu_power_emit(lcd, -1);
+		return G_SOURCE_REMOVE;
+	}
+	if (res == 0)
+		return G_SOURCE_CONTINUE;
+
+	w = (int)(lcd->cpu_power.avg * 10 + 0.5) / 10.;
+	if (w != lcd->cpu_power_w)
+		lcd_cpu_power_emit(lcd, w);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void lcd_cpu_power_open(lcd_state_t *lcd)
+{
+	int res;
+
+	lcd->cpu_power_w = -1;
+	res = rapl_sampler_init(&lcd->cpu_power, CPU_ENERGY_PATH, CPU_ENERGY_RANGE_PATH, RAPL_SAMPLER_WINDOW_MS);
+	if (res < 0) {
+		g_message("no package power: %s", g_strerror(-res));
+		return;
+	}
+	lcd->cpu_power_timer = g_timeout_add(LCD_CPU_POWER_MS, lcd_cpu_power_timeout, lcd);
+}
+
+static int lcd_fan_job(int fd, gpointer data)
+{
+	return fan_curve_step((fan_curve_t *)data, fd);
+}
+
+static void lcd_fan_done(int result, gpointer data, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	GVariantBuilder changed;
+	int n = 0;
+
+	lcd->fan_busy = FALSE;
+	if (result > 0)
+		g_debug("fan: %.1f C -> %d %%", lcd->fan.temp_c, lcd->fan.target);
+	// once per kind of failure, not every step
+	if (result < 0 && result != lcd->fan_err)
+		g_warning("fan: %s", g_strerror(-result));
+	lcd->fan_err = MIN(result, 0);
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	if (lcd->fan.duty != lcd->fan_duty) {
+		lcd->fan_duty = lcd->fan.duty;
+		g_variant_builder_add(&changed, "{sv}", LCD_PROP_FAN_DUTY, g_variant_new_int32(lcd->fan_duty));
+		n++;
+	}
+	if (lcd->fan.fan_rpm != lcd->fan_rpm) {
+		lcd->fan_rpm = lcd->fan.fan_rpm;
+		g_variant_builder_add(&changed, "{sv}", LCD_PROP_FAN_RPM, g_variant_new_int32(lcd->fan_rpm));
+		n++;
+	}
+	if (n > 0)
+		lcd_emit_changed(lcd, &changed);
+	else
+		g_variant_builder_clear(&changed);
+}
+
+// at most one step in flight, a new curve is handed over between steps
+static gboolean lcd_fan_timeout(gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+
+	if (lcd->fan_busy)
+		return G_SOURCE_CONTINUE;
+	if (lcd->fan_next_n >= 0) {
+		fan_curve_set(&lcd->fan, lcd->fan_next, lcd->fan_next_n);
+		lcd->fan_next_n = -1;
+	}
+	lcd->fan_busy = TRUE;
+	ec_worker_queue(lcd_fan_job, &lcd->fan, NULL, lcd_fan_done, lcd);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void lcd_fan_schedule(lcd_state_t *lcd, gboolean curve)
+{
+	if (lcd->fan_timer != 0)
+		g_source_remove(lcd->fan_timer);
+	lcd->fan_timer = g_timeout_add(curve ? FAN_CURVE_INTERVAL_MS : LCD_FAN_POLL_MS, lcd_fan_timeout, lcd);
+}
+
+// with an empty curve no duty is sent any more, the EC's own curve sets the
+// next one; there is no command to hand the fan over explicitly
+static int lcd_fan_set(lcd_state_t *lcd, const char *spec)
+{
+	fan_curve_point_t p[FAN_CURVE_POINTS];
+	int n;
+
+	n = fan_curve_parse(spec, p, FAN_CURVE_POINTS);
+	if (n < 0)
+		return n;
+	if (n > 0 && lcd->fan.temp_path[0] == 0)
+		return -ENODEV;
+
+	memcpy(lcd->fan_next, p, sizeof(p));
+	lcd->fan_next_n = n;
+	fan_curve_format(p, n, lcd->fan_spec, sizeof(lcd->fan_spec));
+	lcd_fan_schedule(lcd, n > 0);
+	lcd_fan_timeout(lcd);
+
+	return 0;
+}
+
+static void lcd_fan_emit(lcd_state_t *lcd)
+{
+	GVariantBuilder changed;
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&changed, "{sv}", LCD_PROP_FAN_CURVE, g_variant_new_string(lcd->fan_spec));
+	lcd_emit_changed(lcd, &changed);
+}
+
+// the thread is only started for the first pattern, an empty one stops it
+// and leaves the LED as it is
+static int lcd_led_pattern_set(lcd_state_t *lcd, const char *spec)
+{
+	led_pattern_t p;
+	int res;
+
+	if (spec[0] == 0) {
+		if (lcd->anim_running)
+			led_anim_stop(&lcd->anim);
+		lcd->anim_running = FALSE;
+		lcd->led_pattern[0] = 0;
+		return 0;
+	}
+
+	res = led_pattern_parse(spec, &p);
+	if (res < 0)
+		return res;
+	if (!lcd->anim_running) {
+		res = led_anim_start(&lcd->anim, settings[SETTING_LED_RED].attr.path,
+			settings[SETTING_LED_GREEN].attr.path, settings[SETTING_LED_BLUE].attr.path);
+		if (res < 0)
+			return res;
+		lcd->anim_running = TRUE;
+	}
+	led_anim_set(&lcd->anim, &p);
+	g_strlcpy(lcd->led_pattern, spec, sizeof(lcd->led_pattern));
+
+	return 0;
+}
+
+static void lcd_led_pattern_emit(lcd_state_t *lcd)
+{
+	GVariantBuilder changed;
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&changed, "{sv}", LCD_PROP_LED_PATTERN, g_variant_new_string(lcd->led_pattern));
+	lcd_emit_changed(lcd, &changed);
+}
+
+// one Set call, checked completely before anything is changed
+typedef struct {
+	int n;
+	int ids[SETTING_NUM];
+	char bufs[SETTING_NUM][128];
+	const char *strs[SETTING_NUM];
+	int gov_mode;			// -1 if not part of the call
+	int gov_target;
+	gboolean have_target;
+	const char *fan;		// NULL if not part of the call
+	const char *pattern;
+	gboolean colors;		// a fixed color ends the pattern
+} lcd_batch_t;
+
+// what the keys outside the settings table are put back to on failure
+typedef struct {
+	int gov_mode;
+	int gov_target;
+	char fan[sizeof(((lcd_state_t *)0)->fan_spec)];
+	char pattern[sizeof(((lcd_state_t *)0)->led_pattern)];
+} lcd_undo_t;
+
+// only checks and converts, strings stay owned by value
+static int lcd_batch_add(lcd_state_t *lcd, lcd_batch_t *b, const char *name, GVariant *value)
+{
+	fan_curve_point_t p[FAN_CURVE_POINTS];
+	led_pattern_t pattern;
+	const char *str = NULL;
+	int id, res;
+
+	if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+		str = g_variant_get_string(value, NULL);
+
+	if (g_strcmp0(name, LCD_PROP_GOVERNOR_TARGET) == 0) {
+		if (!g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+			return -EINVAL;
+		b->gov_target = g_variant_get_int32(value);
+		b->have_target = TRUE;
+		return 0;
+	}
+	if (g_strcmp0(name, LCD_PROP_GOVERNOR) == 0) {
+		if (str == NULL)
+			return -EINVAL;
+		b->gov_mode = pl_gov_mode_parse(str);
+		return (b->gov_mode < 0) ? b->gov_mode : 0;
+	}
+	if (g_strcmp0(name, LCD_PROP_FAN_CURVE) == 0) {
+		if (str == NULL)
+			return -EINVAL;
+		res = fan_curve_parse(str, p, FAN_CURVE_POINTS);
+		if (res < 0)
+			return res;
+		if (res > 0 && lcd->fan.temp_path[0] == 0)
+			return -ENODEV;
+		b->fan = str;
+		return 0;
+	}
+	if (g_strcmp0(name, LCD_PROP_LED_PATTERN) == 0) {
+		if (str == NULL || strlen(str) >= sizeof(lcd->led_pattern))
+			return -EINVAL;
+		if (str[0] != 0) {
+			res = led_pattern_parse(str, &pattern);
+			if (res < 0)
+				return res;
+		}
+		b->pattern = str;
+		return 0;
+	}
+
+	id = settings_find_name(name);
+	if (id < 0)
+		return -ENOENT;
+	if (b->n >= SETTING_NUM)
+		return -E2BIG;
+	if (settings[id].type == SETTING_INT && g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+		snprintf(b->bufs[b->n], sizeof(b->bufs[b->n]), "%d", g_variant_get_int32(value));
+	else if (settings[id].type == SETTING_STRING && str != NULL)
+		snprintf(b->bufs[b->n], sizeof(b->bufs[b->n]), "%s", str);
+	else
+		return -EINVAL;
+	res = settings_check(id, b->bufs[b->n]);
+	if (res < 0)
+		return res;
+	if (id == SETTING_LED_RED || id == SETTING_LED_GREEN || id == SETTING_LED_BLUE)
+		b->colors = TRUE;
+	b->ids[b->n] = id;
+	b->strs[b->n] = b->bufs[b->n];
+	b->n++;
+
+	return 0;
+}
+
+// checks that need the whole call, e.g. Governor=off with CpuPl1 in the same call
+static int lcd_batch_check(lcd_state_t *lcd, lcd_batch_t *b, const char **name)
+{
+	int mode, target, min, max, i;
+
+	mode = (b->gov_mode >= 0) ? b->gov_mode : lcd->gov.mode;
+	target = b->have_target ? b->gov_target : lcd->gov_target;
+	if (mode == PL_GOV_OFF)
+		return 0;
+
+	pl_gov_target_range(mode, &min, &max);
+	if (target < min || target > max) {
+		*name = LCD_PROP_GOVERNOR_TARGET;
+		return -ERANGE;
+	}
+	// the governor owns the CPU limits while it runs
+	for (i = 0; i < b->n; i++) {
+		if (b->ids[i] == SETTING_CPU_PL1 || b->ids[i] == SETTING_CPU_PL2) {
+			*name = settings[b->ids[i]].name;
+			return -EBUSY;
+		}
+	}
+
+	return 0;
+}
+
+static void lcd_undo_save(lcd_state_t *lcd, lcd_undo_t *u)
+{
+	u->gov_mode = lcd->gov.mode;
+	u->gov_target = lcd->gov_target;
+	g_strlcpy(u->fan, lcd->fan_spec, sizeof(u->fan));
+	g_strlcpy(u->pattern, lcd->led_pattern, sizeof(u->pattern));
+}
+
+static void lcd_undo_restore(lcd_state_t *lcd, const lcd_undo_t *u)
+{
+	if (strcmp(u->pattern, lcd->led_pattern) != 0)
+		lcd_led_pattern_set(lcd, u->pattern);
+	if (strcmp(u->fan, lcd->fan_spec) != 0)
+		lcd_fan_set(lcd, u->fan);
+	if (u->gov_mode != lcd->gov.mode || u->gov_target != lcd->gov_target) {
+		lcd->gov_target = u->gov_target;
+		lcd_gov_set(lcd, u->gov_mode, u->gov_target);
+	}
+}
+
+/*
+ * Keys outside the settings table first, then the settings_apply()
+ * transaction; if anything fails the former are put back, the latter
+ * rolls itself back.
+ */
+static int lcd_batch_apply(lcd_state_t *lcd, lcd_batch_t *b, const char **name)
+{
+	lcd_undo_t undo;
+	int mode, failed, res = 0;
+
+	lcd_undo_save(lcd, &undo);
+
+	if (b->gov_mode >= 0 || b->have_target) {
+		if (b->have_target)
+			lcd->gov_target = b->gov_target;
+		mode = (b->gov_mode >= 0) ? b->gov_mode : lcd->gov.mode;
+		// a new target for a governor that is off is only remembered
+		if (mode != PL_GOV_OFF || lcd->gov.mode != PL_GOV_OFF)
+			res = lcd_gov_set(lcd, mode, lcd->gov_target);
+		*name = LCD_PROP_GOVERNOR;
+	}
+	if (res == 0 && b->fan != NULL) {
+		res = lcd_fan_set(lcd, b->fan);
+		*name = LCD_PROP_FAN_CURVE;
+	}
+	if (res == 0 && (b->pattern != NULL || (b->colors && lcd->anim_running))) {
+		res = lcd_led_pattern_set(lcd, (b->pattern != NULL) ? b->pattern : "");
+		*name = LCD_PROP_LED_PATTERN;
+	}
+	if (res == 0 && b->n > 0) {
+		res = settings_apply(b->n, b->ids, b->strs, &failed);
+		if (res < 0 && failed >= 0)
+			*name = settings[b->ids[failed]].name;
+	}
+
+	if (res < 0)
+		lcd_undo_restore(lcd, &undo);
+
+	return res;
+}
+
+static GDBusError lcd_dbus_error(int err)
+{
+	switch (err) {
+		case ENOENT:
+			return G_DBUS_ERROR_UNKNOWN_PROPERTY;
+		case EPERM:
+			return G_DBUS_ERROR_PROPERTY_READ_ONLY;
+		case EACCES:
+			return G_DBUS_ERROR_ACCESS_DENIED;
+		case EINVAL:
+		case ERANGE:
+			return G_DBUS_ERROR_INVALID_ARGS;
+		case ENODEV:
+			return G_DBUS_ERROR_NOT_SUPPORTED;
+		default:
+			return G_DBUS_ERROR_FAILED;
+	}
+}
+
+// one call is one transaction: every key is checked before the first change,
+// settings are written in an order the hardware accepts, and nothing of it is
+// left behind if one of them fails
+static void lcd_apply(lcd_state_t *lcd, GDBusMethodInvocation *invocation)
+{
+	lcd_batch_t b;
+	lcd_undo_t before;
+	GVariant *values;
+	GVariant *value;
+	GVariantIter iter;
+	const char *name = NULL;
+	int res = 0;
+
+	memset(&b, 0, sizeof(b));
+	b.gov_mode = -1;
+	lcd_undo_save(lcd, &before);
+
+	// the strings in b point into values, it is kept until the end
+	g_variant_get(g_dbus_method_invocation_get_parameters(invocation), "(@a{sv})", &values);
+	g_variant_iter_init(&iter, values);
+	while (g_variant_iter_next(&iter, "{&sv}", &name, &value)) {
+		res = lcd_batch_add(lcd, &b, name, value);
+		g_variant_unref(value);
+		if (res < 0)
+			break;
+	}
+	if (res == 0)
+		res = lcd_batch_check(lcd, &b, &name);
+	if (res == 0)
+		res = lcd_batch_apply(lcd, &b, &name);
+
+	// a failed call may still have moved the hardware, e.g. a refused
+	// rollback, so the snapshot is refreshed either way
+	lcd_update(lcd);
+	if (before.gov_mode != lcd->gov.mode || before.gov_target != lcd->gov_target)
+		lcd_gov_emit(lcd);
+	if (strcmp(before.fan, lcd->fan_spec) != 0)
+		lcd_fan_emit(lcd);
+	if (strcmp(before.pattern, lcd->led_pattern) != 0)
+		lcd_led_pattern_emit(lcd);
+
+	if (res < 0)
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, lcd_dbus_error(-res),
+			"%s: %s", name, g_strerror(-res));
+	else
+		g_dbus_method_invocation_return_value(invocation, NULL);
+
+	g_variant_unref(values);
+}
+
+static void lcd_authorize_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GDBusMethodInvocation *invocation = (GDBusMethodInvocation *)user_data;
+	lcd_state_t *lcd = g_dbus_method_invocation_get_user_data(invocation);
+	GError *err = NULL;
+	GVariant *ret;
+	gboolean authorized = FALSE;
+	gboolean challenge = FALSE;
+
+	ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &err);
+	if (ret == NULL) {
+		g_warning("polkit: %s", err->message);
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+			"authorization failed: %s", err->message);
+		g_error_free(err);
+		return;
+	}
+	g_variant_get(ret, "((bb@a{ss}))", &authorized, &challenge, NULL);
+	g_variant_unref(ret);
+
+	if (!authorized) {
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_ACCESS_DENIED,
+			"not authorized for %s", LCD_POLKIT_ACTION);
+		return;
+	}
+
+	lcd_apply(lcd, invocation);
+}
+
+static void lcd_authorize(lcd_state_t *lcd, GDBusMethodInvocation *invocation)
+{
+	GVariantBuilder subject;
+	GVariantBuilder details;
+	guint32 flags = 0;
+
+	if (g_dbus_message_get_flags(g_dbus_method_invocation_get_message(invocation)) &
+	    G_DBUS_MESSAGE_FLAGS_ALLOW_INTERACTIVE_AUTHORIZATION)
+		flags |= POLKIT_CHECK_ALLOW_INTERACTION;
+
+	g_variant_builder_init(&subject, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add(&subject, "{sv}", "name",
+		g_variant_new_string(g_dbus_method_invocation_get_sender(invocation)));
+	g_variant_builder_init(&details, G_VARIANT_TYPE("a{ss}"));
+
+	// no timeout, the user may be typing a password
+	g_dbus_connection_call(lcd->conn, "org.freedesktop.PolicyKit1",
+		"/org/freedesktop/PolicyKit1/Authority", "org.freedesktop.PolicyKit1.Authority",
+		"CheckAuthorization",
+		g_variant_new("((sa{sv})sa{ss}us)", "system-bus-name", &subject,
+			LCD_POLKIT_ACTION, &details, flags, ""),
+		G_VARIANT_TYPE("((bba{ss}))"), G_DBUS_CALL_FLAGS_NONE, G_MAXINT, NULL,
+		lcd_authorize_done, invocation);
+}
+
+// the counters live on the EC worker, so they are formatted there
+static int lcd_ec_stats_job(int fd, gpointer data)
+{
+	ec_stats_format((char *)data, EC_STATS_TEXT_LEN);
+
+	return 0;
+}
+
+static void lcd_ec_stats_done(int result, gpointer data, gpointer user_data)
+{
+	GDBusMethodInvocation *invocation = (GDBusMethodInvocation *)user_data;
+
+	if (result < 0)
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, lcd_dbus_error(-result),
+			"EC: %s", g_strerror(-result));
+	else
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(s)", (char *)data));
+}
+
+static void lcd_method_call(GDBusConnection *conn, const gchar *sender, const gchar *path,
+                            const gchar *iface, const gchar *method, GVariant *params,
+                            GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+
+	// read-only, nothing to authorize
+	if (g_strcmp0(method, LCD_METHOD_EC_STATS) == 0) {
+		ec_worker_queue(lcd_ec_stats_job, g_malloc(EC_STATS_TEXT_LEN), g_free,
+			lcd_ec_stats_done, invocation);
+		return;
+	}
+
+	if (g_strcmp0(method, "Set") != 0) {
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+			"unknown method %s", method);
+		return;
+	}
+
+	// the session bus is only used for testing, nobody to ask there
+	if (lcd->session)
+		lcd_apply(lcd, invocation);
+	else
+		lcd_authorize(lcd, invocation);
+}
+
+static GVariant *lcd_get_property(GDBusConnection *conn, const gchar *sender, const gchar *path,
+                                  const gchar *iface, const gchar *name,
+                                  GError **error, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	int id;
+
+	if (g_strcmp0(name, "EcVersion") == 0)
+		return g_variant_ref(lcd->ec_version);
+	if (g_strcmp0(name, "EcBoard") == 0)
+		return g_variant_ref(lcd->ec_board);
+	if (g_strcmp0(name, LCD_PROP_GOVERNOR) == 0)
+		return g_variant_new_string(pl_gov_mode_name(lcd->gov.mode));
+	if (g_strcmp0(name, LCD_PROP_GOVERNOR_TARGET) == 0)
+		return g_variant_new_int32(lcd->gov_target);
+	if (g_strcmp0(name, LCD_PROP_FAN_CURVE) == 0)
+		return g_variant_new_string(lcd->fan_spec);
+	if (g_strcmp0(name, LCD_PROP_FAN_DUTY) == 0)
+		return g_variant_new_int32(lcd->fan_duty);
+	if (g_strcmp0(name, LCD_PROP_FAN_RPM) == 0)
+		return g_variant_new_int32(lcd->fan_rpm);
+	if (g_strcmp0(name, LCD_PROP_CPU_POWER) == 0)
+		return g_variant_new_double(lcd->cpu_power_w);
+	if (g_strcmp0(name, LCD_PROP_LED_PATTERN) == 0)
+		return g_variant_new_string(lcd->led_pattern);
+
+	id = settings_find_name(name);
+	if (id < 0 || lcd->cache[id] == NULL) {
+		g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "unknown property %s", name);
+		return NULL;
+	}
+
+	return g_variant_ref(lcd->cache[id]);
+}
+
+static const GDBusInterfaceVTable lcd_vtable = {
+	.method_call = lcd_method_call,
+	.get_property = lcd_get_property,
+};
+
+static void lcd_bus_acquired(GDBusConnection *conn, const gchar *name, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+	GError *err = NULL;
+
+	lcd->conn = conn;
+	lcd->reg_id = g_dbus_connection_register_object(conn, LCD_OBJECT_PATH,
+		lcd->introspection->interfaces[0], &lcd_vtable, lcd, NULL, &err);
+	if (lcd->reg_id == 0) {
+		g_warning("cannot export %s: %s", LCD_OBJECT_PATH, err->message);
+		g_error_free(err);
+		g_main_loop_quit(lcd->loop);
+	}
+}
+
+static void lcd_name_lost(GDBusConnection *conn, const gchar *name, gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+
+	g_warning("lost or could not acquire %s", name);
+	lcd->conn = NULL;
+	g_main_loop_quit(lcd->loop);
+}
+
+static gboolean lcd_quit(gpointer user_data)
+{
+	lcd_state_t *lcd = (lcd_state_t *)user_data;
+
+	g_main_loop_quit(lcd->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char **argv)
+{
+	static lcd_state_t lcd;
+	const char *watch[] = { BAT_SOC, BAT_START_THRESHOLD_PATH, BAT_END_THRESHOLD_PATH,
+		LED_KBD_BACKLIGHT "/brightness_hw_changed", NULL };
+	GOptionEntry entries[] = {
+		{ "session", 0, 0, G_OPTION_ARG_NONE, &lcd.session, "Use the session bus, no authorization (testing only)", NULL },
+		{ NULL }
+	};
+	GOptionContext *ctx;
+	GError *err = NULL;
+	guint owner_id;
+	int i;
+
+	ctx = g_option_context_new("- Librem control daemon");
+	g_option_context_add_main_entries(ctx, entries, NULL);
+	if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+		fprintf(stderr, "%s\n", err->message);
+		return 1;
+	}
+	g_option_context_free(ctx);
+
+	lcd.loop = g_main_loop_new(NULL, FALSE);
+	lcd.introspection = lcd_introspection_new();
+	lcd.ec_version = g_variant_ref_sink(g_variant_new_string(""));
+	lcd.ec_board = g_variant_ref_sink(g_variant_new_string(""));
+
+	// snapshot is ready before the first client can ask
+	lcd_update(&lcd);
+	ec_worker_queue(lcd_ec_info_job, g_new0(lcd_ec_info_t, 1), g_free, lcd_ec_info_done, &lcd);
+
+	psu_monitor_add(watch, LCD_BAT_POLL_INTERVAL, lcd_psu_changed, &lcd);
+	g_timeout_add_seconds(LCD_REFRESH_INTERVAL, lcd_refresh_timeout, &lcd);
+	lcd_bat_log_open(&lcd);
+	pl_gov_init(&lcd.gov);
+	lcd_cpu_power_open(&lcd);
+	fan_curve_init(&lcd.fan);
+	lcd.fan_next_n = -1;
+	lcd.fan_duty = -1;
+	lcd.fan_rpm = -1;
+	lcd_fan_schedule(&lcd, FALSE);
+	g_unix_signal_add(SIGTERM, lcd_quit, &lcd);
+	g_unix_signal_add(SIGINT, lcd_quit, &lcd);
+
+	owner_id = g_bus_own_name(lcd.session ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM, LCD_BUS_NAME,
+		G_BUS_NAME_OWNER_FLAGS_NONE, lcd_bus_acquired, NULL, lcd_name_lost, &lcd, NULL);
+
+	g_main_loop_run(lcd.loop);
+
+	// do not leave the machine with whatever the governor set last
+	lcd_gov_set(&lcd, PL_GOV_OFF, 0);
+	pl_gov_close(&lcd.gov);
+	if (lcd.cpu_power_timer != 0)
+		rapl_sampler_close(&lcd.cpu_power);
+	g_bus_unown_name(owner_id);
+	// a step may still be queued
+	ec_worker_shutdown();
+	fan_curve_close(&lcd.fan);
+	if (lcd.anim_running)
+		led_anim_stop(&lcd.anim);
+	bat_log_close(&lcd.bat_log);
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (lcd.cache[i] != NULL)
+			g_variant_unref(lcd.cache[i]);
+	}
+	g_variant_unref(lcd.ec_version);
+	g_variant_unref(lcd.ec_board);
+	g_dbus_node_info_unref(lcd.introspection);
+	g_main_loop_unref(lcd.loop);
+
+	return 0;
+}
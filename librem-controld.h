@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _LIBREM_CONTROLD_H
+#define _LIBREM_CONTROLD_H
+
+// D-Bus system API of librem-controld
+#define LCD_BUS_NAME			"sm.puri.LibremControl"
+#define LCD_OBJECT_PATH			"/sm/puri/LibremControl"
+#define LCD_INTERFACE			"sm.puri.LibremControl1"
+
+// polkit action checked for every change
+#define LCD_POLKIT_ACTION		"sm.puri.librem-control.set"
+
+// PL1/PL2 governor, not part of the settings table; "off", "temp", "drain" or "fan"
+#define LCD_PROP_GOVERNOR		"Governor"
+#define LCD_PROP_GOVERNOR_TARGET	"GovernorTarget"
+
+// fan curve as "temp:duty,...", empty while the EC runs its own; duty in
+// percent and RPM as last read, -1 if unknown
+#define LCD_PROP_FAN_CURVE		"FanCurve"
+#define LCD_PROP_FAN_DUTY		"FanDuty"
+#define LCD_PROP_FAN_RPM		"FanRpm"
+
+// package power in W from RAPL, averaged over about a second, -1 if unknown;
+// energy_uj is root only, so unprivileged clients get it from here
+#define LCD_PROP_CPU_POWER		"CpuPower"
+
+// notification LED pattern as for led_pattern_parse(), empty if none runs
+#define LCD_PROP_LED_PATTERN	"LedPattern"
+
+// per command EC counters and latencies as text, see ec_stats_format()
+#define LCD_METHOD_EC_STATS		"GetEcStats"
+
+#endif
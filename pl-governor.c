@@ -0,0 +1,295 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Closed loop PL1/PL2 governor. A PID controller in velocity form moves
+ * PL1 so that the chosen input (package temperature, battery drain or fan
+ * speed) settles at the target instead of running into the firmware's
+ * own throttling. Errors within the dead band count as zero, and PL1 is
+ * not raised while the package does not use what it has. Writes are rate
+ * limited and slew limited, PL2 keeps the user's PL2/PL1 ratio.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "sysfs-attr.h"
+#include "rapl-sampler.h"
+#include "settings.h"
+#include "pl-governor.h"
+
+typedef struct {
+	const char *name;
+	const char *unit;
+	int min, max;			// accepted targets
+	int def;
+	double kp;				// W per unit
+	double ki;				// W per unit and second
+	double kd;				// W seconds per unit
+	double hyst;			// dead band, units
+} pl_gov_tuning_t;
+
+static const pl_gov_tuning_t pl_gov_tuning[PL_GOV_NUM] = {
+	[PL_GOV_OFF] = { "off", "", 0, 0, 0, 0., 0., 0., 0. },
+	[PL_GOV_TEMP] = { "temp", "C", 50, 100, 85, 0.4, 0.08, 0.2, 2. },
+	[PL_GOV_DRAIN] = { "drain", "W", 3, 60, 10, 0.5, 0.2, 0., 0.5 },
+	[PL_GOV_FAN] = { "fan", "RPM", 1000, 6000, 3500, 0.002, 0.0005, 0., 150. },
+};
+
+
+const char *pl_gov_mode_name(int mode)
+{
+	if (mode < 0 || mode >= PL_GOV_NUM)
+		return NULL;
+
+	return pl_gov_tuning[mode].name;
+}
+
+int pl_gov_mode_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < PL_GOV_NUM; i++) {
+		if (strcmp(name, pl_gov_tuning[i].name) == 0)
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+const char *pl_gov_mode_unit(int mode)
+{
+	if (mode < 0 || mode >= PL_GOV_NUM)
+		return "";
+
+	return pl_gov_tuning[mode].unit;
+}
+
+// returns the default target
+int pl_gov_target_range(int mode, int *min, int *max)
+{
+	if (mode < 0 || mode >= PL_GOV_NUM)
+		mode = PL_GOV_OFF;
+	*min = pl_gov_tuning[mode].min;
+	*max = pl_gov_tuning[mode].max;
+
+	return pl_gov_tuning[mode].def;
+}
+
+// raise PL2 before PL1 and lower PL1 before PL2, so PL1 never exceeds PL2
+int pl_gov_apply(int pl1, int pl2)
+{
+	int res;
+
+	if (pl2 >= settings_int(SETTING_CPU_PL2)) {
+		res = settings_set_int(SETTING_CPU_PL2, pl2);
+		if (res == 0)
+			res = settings_set_int(SETTING_CPU_PL1, pl1);
+	} else {
+		res = settings_set_int(SETTING_CPU_PL1, pl1);
+		if (res == 0)
+			res = settings_set_int(SETTING_CPU_PL2, pl2);
+	}
+
+	return res;
+}
+
+// missing inputs are not an error here, only for the modes that need them
+int pl_gov_init(pl_gov_t *gov)
+{
+	memset(gov, 0, sizeof(*gov));
+
+	if (sysfs_class_find(THERMAL_CLASS_PATH, "type", "x86_pkg_temp", "temp",
+	    gov->temp_path, sizeof(gov->temp_path)) < 0)
+		gov->temp_path[0] = 0;
+	if (sysfs_class_find(HWMON_CLASS_PATH, "name", "librem_ec", "fan1_input",
+	    gov->fan_path, sizeof(gov->fan_path)) < 0)
+		gov->fan_path[0] = 0;
+
+	gov->temp = (sysfs_attr_t)SYSFS_ATTR_INIT(gov->temp_path, O_RDONLY);
+	gov->fan = (sysfs_attr_t)SYSFS_ATTR_INIT(gov->fan_path, O_RDONLY);
+	gov->bat_power = (sysfs_attr_t)SYSFS_ATTR_INIT(BAT_POWER_NOW, O_RDONLY);
+	gov->bat_status = (sysfs_attr_t)SYSFS_ATTR_INIT(BAT_STATUS, O_RDONLY);
+	gov->ac = (sysfs_attr_t)SYSFS_ATTR_INIT(AC_ONLINE, O_RDONLY);
+
+	gov->have_pkg = (rapl_sampler_init(&gov->pkg, CPU_ENERGY_PATH, CPU_ENERGY_RANGE_PATH,
+		PL_GOV_POWER_WINDOW_MS) == 0);
+
+	return 0;
+}
+
+void pl_gov_close(pl_gov_t *gov)
+{
+	if (gov->have_pkg)
+		rapl_sampler_close(&gov->pkg);
+	gov->have_pkg = 0;
+	sysfs_attr_close(&gov->temp);
+	sysfs_attr_close(&gov->fan);
+	sysfs_attr_close(&gov->bat_power);
+	sysfs_attr_close(&gov->bat_status);
+	sysfs_attr_close(&gov->ac);
+}
+
+static void pl_gov_read_inputs(pl_gov_t *gov, int64_t now_us)
+{
+	sysfs_attr_t *set[5];
+	int n = 0;
+
+	if (gov->temp_path[0])
+		set[n++] = &gov->temp;
+	if (gov->fan_path[0])
+		set[n++] = &gov->fan;
+	set[n++] = &gov->bat_power;
+	set[n++] = &gov->bat_status;
+	set[n++] = &gov->ac;
+	sysfs_attr_refresh(set, n);
+
+	if (gov->have_pkg && rapl_sampler_sample(&gov->pkg, now_us) > 0)
+		gov->power = gov->pkg.avg;
+	gov->temp_c = (gov->temp.len > 0) ? sysfs_attr_int(&gov->temp) / 1000. : -1.;
+	gov->fan_rpm = (gov->fan.len > 0) ? sysfs_attr_int(&gov->fan) : -1;
+	// no AC supply at all counts as being on battery
+	gov->on_ac = (sysfs_attr_int(&gov->ac) == 1);
+	if (!gov->on_ac && gov->bat_status.len > 0 && strncmp(gov->bat_status.buf, "Discharging", 11) == 0)
+		gov->drain = sysfs_attr_int(&gov->bat_power) / 1e6;
+	else
+		gov->drain = 0.;
+}
+
+// pl1/pl2 are the fixed limits now in place, they bound the governor and
+// are what the caller restores when switching back to PL_GOV_OFF
+int pl_gov_start(pl_gov_t *gov, int mode, int target, int pl1, int pl2)
+{
+	if (mode < 0 || mode >= PL_GOV_NUM)
+		return -EINVAL;
+	if (mode != PL_GOV_OFF && (target < pl_gov_tuning[mode].min || target > pl_gov_tuning[mode].max))
+		return -ERANGE;
+	if ((mode == PL_GOV_TEMP && !gov->temp_path[0]) || (mode == PL_GOV_FAN && !gov->fan_path[0]))
+		return -ENODEV;
+	if (pl1 <= 0 || pl2 < pl1)
+		return -EINVAL;
+
+	gov->have_err = 0;
+	gov->last_us = 0;
+	// a new target for a running governor continues from where it is
+	if (gov->mode == PL_GOV_OFF || mode == PL_GOV_OFF) {
+		gov->pl1 = pl1;
+		gov->written_pl1 = pl1;
+		gov->written_pl2 = pl2;
+		gov->last_write_us = 0;
+	}
+	gov->mode = mode;
+	gov->target = target;
+	gov->user_pl1 = pl1;
+	gov->user_pl2 = pl2;
+
+	return 0;
+}
+
+// one control step; returns 1 and the limits to write when a write is due
+int pl_gov_step(pl_gov_t *gov, int64_t now_us, int *pl1, int *pl2)
+{
+	const pl_gov_tuning_t *t;
+	double e, du, dt, measured;
+	int out1, out2, max1;
+
+	if (gov->mode == PL_GOV_OFF)
+		return 0;
+	t = &pl_gov_tuning[gov->mode];
+
+	pl_gov_read_inputs(gov, now_us);
+	dt = (gov->last_us > 0) ? (now_us - gov->last_us) / 1e6 : PL_GOV_INTERVAL_MS / 1000.;
+	gov->last_us = now_us;
+
+	max1 = gov->user_pl2;
+	switch (gov->mode) {
+		case PL_GOV_TEMP:
+			measured = gov->temp_c;
+			break;
+		case PL_GOV_FAN:
+			measured = gov->fan_rpm;
+			break;
+		default:
+			// no budget to keep on AC, go to the top
+			if (gov->on_ac) {
+				gov->pl1 = max1;
+				gov->have_err = 0;
+				goto write;
+			}
+			measured = gov->drain;
+			break;
+	}
+	if (measured < 0)
+		return 0;
+
+	e = gov->target - measured;
+	if (e > -t->hyst && e < t->hyst)
+		e = 0.;
+
+	du = t->ki * e * dt;
+	if (gov->have_err >= 1)
+		du += t->kp * (e - gov->err[0]);
+	if (gov->have_err >= 2)
+		du += t->kd * (e - 2 * gov->err[0] + gov->err[1]) / dt;
+	gov->err[1] = gov->err[0];
+	gov->err[0] = e;
+	if (gov->have_err < 2)
+		gov->have_err++;
+
+	// the package does not use what it has, raising PL1 would only wind up
+	if (du > 0 && gov->have_pkg && gov->power > 0 && gov->power < gov->pl1 - PL_GOV_MAX_STEP)
+		du = 0.;
+
+	gov->pl1 += du;
+	if (gov->pl1 < PL_GOV_MIN_PL1)
+		gov->pl1 = PL_GOV_MIN_PL1;
+	if (gov->pl1 > max1)
+		gov->pl1 = max1;
+
+write:
+	if (gov->last_write_us != 0 && now_us - gov->last_write_us < PL_GOV_WRITE_MS * 1000)
+		return 0;
+
+	out1 = (int)(gov->pl1 + 0.5);
+	if (out1 > gov->written_pl1 + PL_GOV_MAX_STEP)
+		out1 = gov->written_pl1 + PL_GOV_MAX_STEP;
+	if (out1 < gov->written_pl1 - PL_GOV_MAX_STEP)
+		out1 = gov->written_pl1 - PL_GOV_MAX_STEP;
+	if (abs(out1 - gov->written_pl1) < PL_GOV_MIN_STEP)
+		return 0;
+
+	out2 = out1 * gov->user_pl2 / gov->user_pl1;
+	if (out2 > gov->user_pl2)
+		out2 = gov->user_pl2;
+	if (out2 < out1)
+		out2 = out1;
+
+	gov->written_pl1 = out1;
+	gov->written_pl2 = out2;
+	gov->last_write_us = now_us;
+	*pl1 = out1;
+	*pl2 = out2;
+
+	return 1;
+}
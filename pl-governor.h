@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PL_GOVERNOR_H
+#define _PL_GOVERNOR_H
+
+#include <stdint.h>
+
+#include "sysfs-attr.h"
+#include "rapl-sampler.h"
+
+// ms between control steps
+#define PL_GOV_INTERVAL_MS		1000
+// ms, the powercap interface sees at most one PL1/PL2 write this often
+#define PL_GOV_WRITE_MS			2000
+// W, smaller corrections are not written at all
+#define PL_GOV_MIN_STEP			1
+// W, largest change per write
+#define PL_GOV_MAX_STEP			5
+// W, never go below this, the machine has to stay usable
+#define PL_GOV_MIN_PL1			5
+// ms, package power is averaged over this
+#define PL_GOV_POWER_WINDOW_MS	3000
+
+typedef enum {
+	PL_GOV_OFF = 0,		// fixed limits from the sliders
+	PL_GOV_TEMP,		// package temperature ceiling, degree C
+	PL_GOV_DRAIN,		// battery discharge budget, W
+	PL_GOV_FAN,			// fan speed cap, RPM
+	PL_GOV_NUM
+} pl_gov_mode_t;
+
+// inputs are read once per control step, all fds stay open
+typedef struct {
+	int mode;
+	int target;
+	int user_pl1;			// W, the fixed limits to go back to
+	int user_pl2;
+	double pl1;				// W, controller output
+	double err[2];			// last two errors, for the velocity form
+	int have_err;
+	int written_pl1;		// W, last written, 0 if nothing yet
+	int written_pl2;
+	int64_t last_write_us;
+	int64_t last_us;
+	rapl_sampler_t pkg;
+	int have_pkg;
+	char temp_path[128];
+	char fan_path[128];
+	sysfs_attr_t temp;		// x86_pkg_temp, m degree C
+	sysfs_attr_t fan;		// librem_ec hwmon fan1_input, RPM
+	sysfs_attr_t bat_power;
+	sysfs_attr_t bat_status;
+	sysfs_attr_t ac;
+	// last inputs, for display
+	double power;			// package W
+	double temp_c;
+	double drain;			// battery W, 0 on AC
+	int fan_rpm;
+	int on_ac;
+} pl_gov_t;
+
+const char *pl_gov_mode_name(int mode);
+
+int pl_gov_mode_parse(const char *name);
+
+const char *pl_gov_mode_unit(int mode);
+
+int pl_gov_target_range(int mode, int *min, int *max);
+
+int pl_gov_apply(int pl1, int pl2);
+
+int pl_gov_init(pl_gov_t *gov);
+
+void pl_gov_close(pl_gov_t *gov);
+
+int pl_gov_start(pl_gov_t *gov, int mode, int target, int pl1, int pl2);
+
+int pl_gov_step(pl_gov_t *gov, int64_t now_us, int *pl1, int *pl2);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Model of the powercap class: every zone (package, core, uncore, dram,
+ * psys, the MMIO interface) with its constraints, found with one walk of
+ * the class directory. Limits and time windows stay open as sysfs
+ * attributes; changes to a zone go in as a batch and are rolled back if
+ * any of them fails.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "sysfs-attr.h"
+#include "powercap.h"
+
+
+static int powercap_read_str(const char *path, char *buf, int len)
+{
+	sysfs_attr_t attr = SYSFS_ATTR_INIT(path, O_RDONLY);
+	int res;
+
+	res = sysfs_attr_read_string(&attr, buf, len);
+	sysfs_attr_close(&attr);
+
+	return res;
+}
+
+static long long powercap_read_ll(const char *path)
+{
+	char buf[SYSFS_ATTR_BUF_LEN];
+
+	if (powercap_read_str(path, buf, sizeof(buf)) <= 0)
+		return -1;
+
+	return strtoll(buf, NULL, 10);
+}
+
+static int powercap_id_cmp(const void *a, const void *b)
+{
+	return strcmp(((const powercap_zone_t *)a)->id, ((const powercap_zone_t *)b)->id);
+}
+
+static void powercap_zone_scan(powercap_zone_t *zone)
+{
+	powercap_constraint_t *c;
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < POWERCAP_MAX_CONSTRAINTS; i++) {
+		c = &zone->c[i];
+		snprintf(path, sizeof(path), POWERCAP_CLASS_PATH "/%s/constraint_%d_name", zone->id, i);
+		if (powercap_read_str(path, c->name, sizeof(c->name)) <= 0)
+			break;
+
+		snprintf(c->limit_path, sizeof(c->limit_path), POWERCAP_CLASS_PATH "/%s/constraint_%d_power_limit_uw",
+			zone->id, i);
+		snprintf(c->window_path, sizeof(c->window_path), POWERCAP_CLASS_PATH "/%s/constraint_%d_time_window_us",
+			zone->id, i);
+		c->limit = (sysfs_attr_t)SYSFS_ATTR_INIT(c->limit_path, O_RDWR);
+		c->window = (sysfs_attr_t)SYSFS_ATTR_INIT(c->window_path, O_RDWR);
+
+#define POWERCAP_READ_LL(field, attr) \
+		snprintf(path, sizeof(path), POWERCAP_CLASS_PATH "/%s/constraint_%d_" attr, zone->id, i); \
+		c->field = powercap_read_ll(path)
+		POWERCAP_READ_LL(max_power, "max_power_uw");
+		POWERCAP_READ_LL(min_power, "min_power_uw");
+		POWERCAP_READ_LL(max_window, "max_time_window_us");
+		POWERCAP_READ_LL(min_window, "min_time_window_us");
+#undef POWERCAP_READ_LL
+	}
+	zone->n_constraints = i;
+}
+
+// zones are sorted by id, so parents come before their sub-zones
+int powercap_scan(powercap_t *pc)
+{
+	char path[PATH_MAX];
+	powercap_zone_t *zone;
+	struct dirent *de;
+	DIR *dir;
+	int i;
+
+	memset(pc, 0, sizeof(*pc));
+	dir = opendir(sysfs_root_path(POWERCAP_CLASS_PATH, path, sizeof(path)));
+	if (dir == NULL)
+		return -errno;
+
+	while ((de = readdir(dir)) != NULL && pc->n_zones < POWERCAP_MAX_ZONES) {
+		if (de->d_name[0] == '.' || strlen(de->d_name) >= POWERCAP_NAME_LEN)
+			continue;
+		zone = &pc->zones[pc->n_zones];
+		// control types (intel-rapl) have no name, only zones do
+		snprintf(path, sizeof(path), POWERCAP_CLASS_PATH "/%s/name", de->d_name);
+		if (powercap_read_str(path, zone->name, sizeof(zone->name)) <= 0)
+			continue;
+		strcpy(zone->id, de->d_name);
+		pc->n_zones++;
+	}
+	closedir(dir);
+
+	// attributes point into the zones, only set them up once they stay put
+	qsort(pc->zones, pc->n_zones, sizeof(pc->zones[0]), powercap_id_cmp);
+	for (i = 0; i < pc->n_zones; i++)
+		powercap_zone_scan(&pc->zones[i]);
+
+	return pc->n_zones;
+}
+
+void powercap_close(powercap_t *pc)
+{
+	int i, j;
+
+	for (i = 0; i < pc->n_zones; i++) {
+		for (j = 0; j < pc->zones[i].n_constraints; j++) {
+			sysfs_attr_close(&pc->zones[i].c[j].limit);
+			sysfs_attr_close(&pc->zones[i].c[j].window);
+		}
+	}
+}
+
+powercap_zone_t *powercap_zone_find(powercap_t *pc, const char *id)
+{
+	int i;
+
+	for (i = 0; i < pc->n_zones; i++) {
+		if (strcmp(pc->zones[i].id, id) == 0)
+			return &pc->zones[i];
+	}
+
+	return NULL;
+}
+
+// by name or by number
+int powercap_constraint_find(const powercap_zone_t *zone, const char *name)
+{
+	char *end;
+	int i;
+
+	for (i = 0; i < zone->n_constraints; i++) {
+		if (strcmp(zone->c[i].name, name) == 0)
+			return i;
+	}
+	i = strtol(name, &end, 10);
+	if (*name != 0 && *end == 0 && i >= 0 && i < zone->n_constraints)
+		return i;
+
+	return -ENOENT;
+}
+
+// one batch for all limits and windows of the zone
+int powercap_zone_refresh(powercap_zone_t *zone)
+{
+	sysfs_attr_t *set[2 * POWERCAP_MAX_CONSTRAINTS];
+	int i, n = 0;
+
+	for (i = 0; i < zone->n_constraints; i++) {
+		set[n++] = &zone->c[i].limit;
+		set[n++] = &zone->c[i].window;
+	}
+
+	return sysfs_attr_refresh(set, n);
+}
+
+// cached value from the last refresh, -1 if there is none
+long long powercap_value(powercap_constraint_t *c, powercap_field_t field)
+{
+	sysfs_attr_t *attr = (field == POWERCAP_LIMIT) ? &c->limit : &c->window;
+
+	if (attr->len <= 0)
+		return -1;
+
+	return strtoll(attr->buf, NULL, 10);
+}
+
+static int powercap_write(powercap_constraint_t *c, powercap_field_t field, long long value)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%lld", value);
+
+	return sysfs_attr_write((field == POWERCAP_LIMIT) ? &c->limit : &c->window, buf);
+}
+
+static int powercap_check(const powercap_zone_t *zone, const powercap_change_t *ch)
+{
+	const powercap_constraint_t *c;
+	long long min, max;
+
+	if (ch->constraint < 0 || ch->constraint >= zone->n_constraints)
+		return -ENOENT;
+	c = &zone->c[ch->constraint];
+
+	if (ch->field == POWERCAP_LIMIT) {
+		min = c->min_power;
+		max = c->max_power;
+	} else {
+		min = c->min_window;
+		max = c->max_window;
+	}
+	if (ch->value <= 0 || (min > 0 && ch->value < min) || (max > 0 && ch->value > max))
+		return -ERANGE;
+
+	return 0;
+}
+
+// all or nothing: checked first, on a failed write the ones before it
+// are put back in reverse order
+int powercap_zone_apply(powercap_zone_t *zone, int n, const powercap_change_t *changes)
+{
+	long long old[2 * POWERCAP_MAX_CONSTRAINTS];
+	powercap_constraint_t *c;
+	int i, res = 0;
+
+	if (n > 2 * POWERCAP_MAX_CONSTRAINTS)
+		return -E2BIG;
+	for (i = 0; i < n; i++) {
+		res = powercap_check(zone, &changes[i]);
+		if (res < 0)
+			return res;
+	}
+
+	powercap_zone_refresh(zone);
+	for (i = 0; i < n; i++) {
+		old[i] = powercap_value(&zone->c[changes[i].constraint], changes[i].field);
+		if (old[i] < 0)
+			return -ENODEV;
+	}
+
+	for (i = 0; i < n; i++) {
+		c = &zone->c[changes[i].constraint];
+		res = powercap_write(c, changes[i].field, changes[i].value);
+		if (res < 0)
+			break;
+	}
+	if (i < n) {
+		while (--i >= 0)
+			powercap_write(&zone->c[changes[i].constraint], changes[i].field, old[i]);
+	}
+	powercap_zone_refresh(zone);
+
+	return (res < 0) ? res : 0;
+}
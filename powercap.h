@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _POWERCAP_H
+#define _POWERCAP_H
+
+#include "sysfs-attr.h"
+
+#define POWERCAP_CLASS_PATH		"/sys/class/powercap"
+
+#define POWERCAP_MAX_ZONES			16
+#define POWERCAP_MAX_CONSTRAINTS	4
+#define POWERCAP_PATH_LEN			128
+#define POWERCAP_NAME_LEN			32
+
+// one constraint_N_* group of a zone, values in uW / us, -1 if not reported
+typedef struct {
+	char name[POWERCAP_NAME_LEN];		// long_term, short_term, peak_power
+	char limit_path[POWERCAP_PATH_LEN];
+	char window_path[POWERCAP_PATH_LEN];
+	sysfs_attr_t limit;					// power_limit_uw
+	sysfs_attr_t window;				// time_window_us, len < 0 if there is none
+	long long max_power;
+	long long min_power;
+	long long max_window;
+	long long min_window;
+} powercap_constraint_t;
+
+// intel-rapl:0 package-0, intel-rapl:0:0 core, intel-rapl-mmio:0 ...
+typedef struct {
+	char id[POWERCAP_NAME_LEN];			// directory name
+	char name[POWERCAP_NAME_LEN];
+	int n_constraints;
+	powercap_constraint_t c[POWERCAP_MAX_CONSTRAINTS];
+} powercap_zone_t;
+
+typedef struct {
+	int n_zones;
+	powercap_zone_t zones[POWERCAP_MAX_ZONES];
+} powercap_t;
+
+// what powercap_zone_apply() writes
+typedef enum {
+	POWERCAP_LIMIT = 0,
+	POWERCAP_WINDOW,
+} powercap_field_t;
+
+typedef struct {
+	int constraint;
+	powercap_field_t field;
+	long long value;
+} powercap_change_t;
+
+int powercap_scan(powercap_t *pc);
+
+void powercap_close(powercap_t *pc);
+
+powercap_zone_t *powercap_zone_find(powercap_t *pc, const char *id);
+
+int powercap_constraint_find(const powercap_zone_t *zone, const char *name);
+
+int powercap_zone_refresh(powercap_zone_t *zone);
+
+long long powercap_value(powercap_constraint_t *c, powercap_field_t field);
+
+int powercap_zone_apply(powercap_zone_t *zone, int n, const powercap_change_t *changes);
+
+#endif
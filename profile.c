@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/*
+ * Named bundles of settings. The system wide file comes first, a user
+ * profile of the same name replaces it. Applying one is a single
+ * settings_apply() transaction.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "settings.h"
+#include "profile.h"
+
+
+static char *profile_trim(char *s)
+{
+	char *e;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char)e[-1]))
+		*--e = 0;
+
+	return s;
+}
+
+profile_t *profile_find(profile_list_t *list, const char *name)
+{
+	int i;
+
+	for (i = 0; i < list->n; i++) {
+		if (strcmp(list->p[i].name, name) == 0)
+			return &list->p[i];
+	}
+
+	return NULL;
+}
+
+static profile_t *profile_section(profile_list_t *list, const char *name)
+{
+	profile_t *p;
+
+	p = profile_find(list, name);
+	if (p == NULL) {
+		if (list->n >= PROFILE_MAX)
+			return NULL;
+		p = &list->p[list->n++];
+	}
+	memset(p, 0, sizeof(*p));
+	snprintf(p->name, sizeof(p->name), "%s", name);
+
+	return p;
+}
+
+// bad lines are reported and skipped, a missing file is not an error
+int profile_load(profile_list_t *list, const char *path)
+{
+	char line[256];
+	char *s, *key, *value;
+	profile_t *p = NULL;
+	FILE *fp;
+	int lineno = 0;
+	int i, id;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return (errno == ENOENT) ? 0 : -errno;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		s = profile_trim(line);
+		if (*s == 0 || *s == '#' || *s == ';')
+			continue;
+
+		if (*s == '[') {
+			value = strchr(s, ']');
+			if (value == NULL) {
+				fprintf(stderr, "%s:%d: missing ]\n", path, lineno);
+				p = NULL;
+				continue;
+			}
+			*value = 0;
+			p = profile_section(list, profile_trim(s + 1));
+			if (p == NULL)
+				fprintf(stderr, "%s:%d: too many profiles\n", path, lineno);
+			continue;
+		}
+
+		value = strchr(s, '=');
+		if (p == NULL || value == NULL) {
+			fprintf(stderr, "%s:%d: expected key = value in a [profile]\n", path, lineno);
+			continue;
+		}
+		*value++ = 0;
+		key = profile_trim(s);
+		value = profile_trim(value);
+		id = settings_find(key);
+		if (id < 0 || settings_check(id, value) < 0) {
+			fprintf(stderr, "%s:%d: %s = %s: not a valid setting\n", path, lineno, key, value);
+			continue;
+		}
+
+		// a key given twice keeps its place, with the later value
+		for (i = 0; i < p->n && p->ids[i] != id; i++)
+			;
+		if (i == p->n) {
+			if (p->n >= SETTING_NUM)
+				continue;
+			p->ids[p->n++] = id;
+		}
+		snprintf(p->values[i], sizeof(p->values[i]), "%s", value);
+	}
+	fclose(fp);
+
+	return list->n;
+}
+
+int profile_load_default(profile_list_t *list)
+{
+	char path[PATH_MAX];
+	const char *dir;
+
+	memset(list, 0, sizeof(*list));
+	profile_load(list, PROFILE_SYSTEM_PATH);
+
+	dir = getenv("XDG_CONFIG_HOME");
+	if (dir != NULL && dir[0] == '/')
+		snprintf(path, sizeof(path), "%s/%s", dir, PROFILE_USER_FILE);
+	else if (getenv("HOME") != NULL)
+		snprintf(path, sizeof(path), "%s/.config/%s", getenv("HOME"), PROFILE_USER_FILE);
+	else
+		return list->n;
+
+	return profile_load(list, path);
+}
+
+int profile_apply(const profile_t *p, int *failed)
+{
+	const char *values[SETTING_NUM];
+	int i;
+
+	for (i = 0; i < p->n; i++)
+		values[i] = p->values[i];
+
+	return settings_apply(p->n, p->ids, values, failed);
+}
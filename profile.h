@@ -0,0 +1,54 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "settings.h"
+
+// [name] sections of key = value, keys as in the settings table
+#define PROFILE_SYSTEM_PATH		"/etc/librem-control/profiles.conf"
+#define PROFILE_USER_FILE		"librem-control/profiles.conf"
+
+#define PROFILE_MAX				16
+#define PROFILE_NAME_LEN		64
+#define PROFILE_VALUE_LEN		64
+
+typedef struct {
+	char name[PROFILE_NAME_LEN];
+	int n;
+	int ids[SETTING_NUM];
+	char values[SETTING_NUM][PROFILE_VALUE_LEN];
+} profile_t;
+
+typedef struct {
+	int n;
+	profile_t p[PROFILE_MAX];
+} profile_list_t;
+
+int profile_load(profile_list_t *list, const char *path);
+
+int profile_load_default(profile_list_t *list);
+
+profile_t *profile_find(profile_list_t *list, const char *name);
+
+int profile_apply(const profile_t *p, int *failed);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Power supply change notification as a GSource.
+ *
+ * Primary source are the kernel uevents for the power_supply subsystem
+ * (NETLINK_KOBJECT_UEVENT, kernel multicast group). Additionally sysfs
+ * attributes can be watched with POLLPRI, which fires for drivers that
+ * call sysfs_notify(). Only if the netlink socket can not be set up the
+ * source falls back to plain polling every poll_interval seconds.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include <glib.h>
+
+#include "sysfs-attr.h"
+#include "psu-monitor.h"
+
+#define PSU_MONITOR_MSG_LEN		8192
+#define PSU_MONITOR_MAX_WATCH	8
+
+typedef struct {
+	GSource source;
+	int nl_fd;
+	gpointer nl_tag;
+	int n_watch;
+	sysfs_attr_t watch[PSU_MONITOR_MAX_WATCH];
+	gpointer watch_tag[PSU_MONITOR_MAX_WATCH];
+	guint poll_interval;
+} psu_monitor_source_t;
+
+
+static int psu_monitor_netlink_open(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		perror("uevent socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_pid = 0;
+	addr.nl_groups = 1;		// kernel events, not the udev re-broadcast
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("uevent bind");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// "ACTION@DEVPATH\0KEY=VALUE\0KEY=VALUE\0..."
+static gboolean psu_monitor_parse(char *msg, int len, psu_event_t *ev)
+{
+	gboolean is_psu = FALSE;
+	char *p, *end = msg + len;
+
+	ev->name = NULL;
+	ev->status = NULL;
+	ev->capacity = -1;
+	ev->online = -1;
+
+	// skip the header
+	p = msg + strnlen(msg, len) + 1;
+	for (; p < end; p += strnlen(p, end - p) + 1) {
+		if (strcmp(p, "SUBSYSTEM=power_supply") == 0)
+			is_psu = TRUE;
+		else if (strncmp(p, "POWER_SUPPLY_NAME=", 18) == 0)
+			ev->name = p + 18;
+		else if (strncmp(p, "POWER_SUPPLY_STATUS=", 20) == 0)
+			ev->status = p + 20;
+		else if (strncmp(p, "POWER_SUPPLY_CAPACITY=", 22) == 0)
+			ev->capacity = atoi(p + 22);
+		else if (strncmp(p, "POWER_SUPPLY_ONLINE=", 20) == 0)
+			ev->online = atoi(p + 20);
+	}
+
+	return is_psu && ev->name != NULL;
+}
+
+static void psu_monitor_netlink_read(psu_monitor_source_t *psu, psu_monitor_func func, gpointer user_data)
+{
+	char msg[PSU_MONITOR_MSG_LEN];
+	psu_event_t ev;
+	int len;
+
+	while ((len = recv(psu->nl_fd, msg, sizeof(msg) - 1, 0)) > 0) {
+		msg[len] = 0;
+		if (psu_monitor_parse(msg, len, &ev))
+			func(&ev, user_data);
+	}
+	if (len < 0 && errno == ENOBUFS)
+		g_warning("uevent socket overrun, events lost");
+}
+
+static gboolean psu_monitor_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+	psu_monitor_source_t *psu = (psu_monitor_source_t *)source;
+	psu_monitor_func func = (psu_monitor_func)callback;
+	psu_event_t ev = { NULL, NULL, -1, -1 };
+	gboolean changed = FALSE;
+	int i;
+
+	if (func == NULL)
+		return G_SOURCE_CONTINUE;
+
+	if (psu->nl_tag && (g_source_query_unix_fd(source, psu->nl_tag) & G_IO_IN))
+		psu_monitor_netlink_read(psu, func, user_data);
+
+	for (i = 0; i < psu->n_watch; i++) {
+		if (g_source_query_unix_fd(source, psu->watch_tag[i]) & (G_IO_PRI | G_IO_ERR)) {
+			// reading the attribute re-arms the notification
+			sysfs_attr_read(&psu->watch[i]);
+			changed = TRUE;
+		}
+	}
+
+	if (psu->poll_interval > 0 && g_source_get_ready_time(source) >= 0 &&
+	    g_source_get_time(source) >= g_source_get_ready_time(source)) {
+		g_source_set_ready_time(source, g_source_get_time(source) + psu->poll_interval * G_USEC_PER_SEC);
+		changed = TRUE;
+	}
+
+	if (changed)
+		func(&ev, user_data);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void psu_monitor_finalize(GSource *source)
+{
+	psu_monitor_source_t *psu = (psu_monitor_source_t *)source;
+	int i;
+
+	if (psu->nl_fd >= 0)
+		close(psu->nl_fd);
+	for (i = 0; i < psu->n_watch; i++)
+		sysfs_attr_close(&psu->watch[i]);
+}
+
+static GSourceFuncs psu_monitor_funcs = {
+	NULL,
+	NULL,
+	psu_monitor_dispatch,
+	psu_monitor_finalize,
+};
+
+GSource *psu_monitor_source_new(const char * const *watch, guint poll_interval)
+{
+	psu_monitor_source_t *psu;
+	GSource *source;
+	int i;
+
+	source = g_source_new(&psu_monitor_funcs, sizeof(psu_monitor_source_t));
+	psu = (psu_monitor_source_t *)source;
+	g_source_set_name(source, "psu-monitor");
+
+	psu->nl_fd = psu_monitor_netlink_open();
+	if (psu->nl_fd >= 0)
+		psu->nl_tag = g_source_add_unix_fd(source, psu->nl_fd, G_IO_IN);
+
+	for (i = 0; watch != NULL && watch[i] != NULL && psu->n_watch < PSU_MONITOR_MAX_WATCH; i++) {
+		sysfs_attr_t *attr = &psu->watch[psu->n_watch];
+
+		*attr = (sysfs_attr_t)SYSFS_ATTR_INIT(watch[i], O_RDONLY);
+		// a read is needed before POLLPRI can tell us about changes
+		if (sysfs_attr_read(attr) < 0)
+			continue;
+		psu->watch_tag[psu->n_watch++] = g_source_add_unix_fd(source, attr->fd, G_IO_PRI | G_IO_ERR);
+	}
+
+	// no uevents, fall back to polling
+	if (psu->nl_fd < 0 && poll_interval > 0) {
+		psu->poll_interval = poll_interval;
+		g_source_set_ready_time(source, g_get_monotonic_time() + poll_interval * G_USEC_PER_SEC);
+	}
+
+	return source;
+}
+
+guint psu_monitor_add(const char * const *watch, guint poll_interval, psu_monitor_func func, gpointer user_data)
+{
+	GSource *source;
+	guint id;
+
+	source = psu_monitor_source_new(watch, poll_interval);
+	g_source_set_callback(source, (GSourceFunc)func, user_data, NULL);
+	id = g_source_attach(source, NULL);
+	g_source_unref(source);
+
+	return id;
+}
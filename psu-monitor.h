@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSU_MONITOR_H
+#define _PSU_MONITOR_H
+
+#include <glib.h>
+
+// what the kernel told us, fields are NULL / -1 if not reported;
+// a NULL name means "something may have changed, re-read sysfs"
+typedef struct {
+	const char *name;		// POWER_SUPPLY_NAME
+	const char *status;		// POWER_SUPPLY_STATUS
+	int capacity;			// POWER_SUPPLY_CAPACITY
+	int online;				// POWER_SUPPLY_ONLINE
+} psu_event_t;
+
+typedef void (*psu_monitor_func)(const psu_event_t *ev, gpointer user_data);
+
+GSource *psu_monitor_source_new(const char * const *watch, guint poll_interval);
+
+guint psu_monitor_add(const char * const *watch, guint poll_interval, psu_monitor_func func, gpointer user_data);
+
+#endif
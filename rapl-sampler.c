@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "sysfs-attr.h"
+#include "rapl-sampler.h"
+
+
+// energy_uj does not fit into sysfs_attr_int()
+static int rapl_sampler_read(sysfs_attr_t *attr, uint64_t *val)
+{
+	if (sysfs_attr_read(attr) < 0)
+		return -attr->err;
+
+	*val = strtoull(attr->buf, NULL, 10);
+	return 0;
+}
+
+int rapl_sampler_init(rapl_sampler_t *rs, const char *energy_path, const char *range_path,
+                      unsigned int window_ms)
+{
+	sysfs_attr_t range = SYSFS_ATTR_INIT(range_path, O_RDONLY);
+	int res;
+
+	memset(rs, 0, sizeof(*rs));
+	rs->energy = (sysfs_attr_t)SYSFS_ATTR_INIT(energy_path, O_RDONLY);
+	rs->window_ms = window_ms;
+
+	// read once, it does not change
+	res = rapl_sampler_read(&range, &rs->max_range);
+	sysfs_attr_close(&range);
+	if (res < 0)
+		return res;
+
+	// energy_uj is root only on current kernels, fail early
+	res = rapl_sampler_read(&rs->energy, &rs->last_raw);
+	if (res < 0) {
+		sysfs_attr_close(&rs->energy);
+		return res;
+	}
+	rs->last_us = -1;
+
+	return 0;
+}
+
+void rapl_sampler_close(rapl_sampler_t *rs)
+{
+	sysfs_attr_close(&rs->energy);
+}
+
+// returns 1 once power values are available
+int rapl_sampler_sample(rapl_sampler_t *rs, int64_t now_us)
+{
+	unsigned int oldest;
+	uint64_t raw = 0, delta;
+	int res;
+
+	res = rapl_sampler_read(&rs->energy, &raw);
+	if (res < 0)
+		return res;
+
+	// the counter runs 0..max_energy_range_uj and wraps at most once between samples
+	if (raw >= rs->last_raw)
+		delta = raw - rs->last_raw;
+	else
+		delta = rs->max_range - rs->last_raw + raw + 1;
+	rs->last_raw = raw;
+	rs->total += delta;
+
+	if (rs->last_us >= 0 && now_us > rs->last_us) {
+		rs->power = delta / (double)(now_us - rs->last_us);
+	}
+	rs->last_us = now_us;
+
+	rs->hist_total[rs->head] = rs->total;
+	rs->hist_us[rs->head] = now_us;
+	rs->head = (rs->head + 1) % RAPL_SAMPLER_HISTORY;
+	if (rs->n < RAPL_SAMPLER_HISTORY)
+		rs->n++;
+
+	// drop what fell out of the window, the newest two always stay
+	oldest = (rs->head + RAPL_SAMPLER_HISTORY - rs->n) % RAPL_SAMPLER_HISTORY;
+	while (rs->n > 2 && now_us - rs->hist_us[oldest] > (int64_t)rs->window_ms * 1000) {
+		oldest = (oldest + 1) % RAPL_SAMPLER_HISTORY;
+		rs->n--;
+	}
+	if (rs->n < 2)
+		return 0;
+
+	// uJ per us is W
+	rs->avg = (rs->total - rs->hist_total[oldest]) / (double)(now_us - rs->hist_us[oldest]);
+
+	return 1;
+}
@@ -0,0 +1,55 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _RAPL_SAMPLER_H
+#define _RAPL_SAMPLER_H
+
+#include <stdint.h>
+
+#include "sysfs-attr.h"
+
+// samples kept for the windowed average, 1.28 s at 100 Hz
+#define RAPL_SAMPLER_HISTORY	128
+#define RAPL_SAMPLER_WINDOW_MS	1000
+
+// package power from a RAPL energy counter, one pread per sample
+typedef struct {
+	sysfs_attr_t energy;		// energy_uj, kept open
+	uint64_t max_range;			// uJ, the counter wraps after this
+	uint64_t last_raw;
+	uint64_t total;				// uJ since init, unwrapped
+	int64_t last_us;
+	unsigned int window_ms;
+	unsigned int head;
+	unsigned int n;				// valid history entries
+	uint64_t hist_total[RAPL_SAMPLER_HISTORY];
+	int64_t hist_us[RAPL_SAMPLER_HISTORY];
+	double power;				// W between the last two samples
+	double avg;					// W over the window
+} rapl_sampler_t;
+
+int rapl_sampler_init(rapl_sampler_t *rs, const char *energy_path, const char *range_path,
+                      unsigned int window_ms);
+
+void rapl_sampler_close(rapl_sampler_t *rs);
+
+int rapl_sampler_sample(rapl_sampler_t *rs, int64_t now_us);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Table of everything librem-control can read or change, shared by the
+ * GUI, the daemon and the command line tool so that all of them use the
+ * same names, ranges and units.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "settings.h"
+
+#define SETTING(k, n, t, f, s, lo, hi, p, o) \
+	{ .key = (k), .name = (n), .type = (t), .flags = (f), .scale = (s), \
+	  .min = (lo), .max = (hi), .attr = SYSFS_ATTR_INIT(p, o) }
+
+// every attribute is opened once and kept open for the lifetime of the process
+setting_t settings[SETTING_NUM] = {
+	[SETTING_BAT_SOC]		= SETTING("bat.soc", "BatSoc", SETTING_INT, SETTING_RO, 1, 0, 100,
+								BAT_SOC, O_RDONLY),
+	[SETTING_BAT_START]		= SETTING("bat.start", "BatStart", SETTING_INT, 0, 1, 0, 100,
+								BAT_START_THRESHOLD_PATH, O_RDWR),
+	[SETTING_BAT_END]		= SETTING("bat.end", "BatEnd", SETTING_INT, 0, 1, 0, 100,
+								BAT_END_THRESHOLD_PATH, O_RDWR),
+	[SETTING_BAT_STATUS]	= SETTING("bat.status", "BatStatus", SETTING_STRING, SETTING_RO, 1, 0, 0,
+								BAT_STATUS, O_RDONLY),
+	// Watt, sysfs has micro Watt
+	[SETTING_CPU_PL1]		= SETTING("cpu.pl1", "CpuPl1", SETTING_INT, 0, 1000000, 1, 100,
+								CPU_PL1_PATH, O_RDWR),
+	[SETTING_CPU_PL2]		= SETTING("cpu.pl2", "CpuPl2", SETTING_INT, 0, 1000000, 1, 100,
+								CPU_PL2_PATH, O_RDWR),
+	[SETTING_LED_RED]		= SETTING("led.red", "LedRed", SETTING_INT, 0, 1, 0, 255,
+								LED_RED_PATH "/brightness", O_RDWR),
+	[SETTING_LED_GREEN]		= SETTING("led.green", "LedGreen", SETTING_INT, 0, 1, 0, 255,
+								LED_GREEN_PATH "/brightness", O_RDWR),
+	[SETTING_LED_BLUE]		= SETTING("led.blue", "LedBlue", SETTING_INT, 0, 1, 0, 255,
+								LED_BLUE_PATH "/brightness", O_RDWR),
+	[SETTING_LED_KBD]		= SETTING("led.kbd", "LedKbd", SETTING_INT, 0, 1, 0, 255,
+								LED_KBD_BACKLIGHT "/brightness", O_RDWR),
+	[SETTING_LED_AIRPLANE]	= SETTING("led.airplane", "LedAirplane", SETTING_INT, SETTING_RO, 1, 0, 255,
+								LED_AIRPLANE_PATH "/brightness", O_RDONLY),
+	[SETTING_LED_AIRPLANE_TRIGGER] = SETTING("led.airplane.trigger", "LedAirplaneTrigger", SETTING_STRING, 0, 1, 0, 0,
+								LED_AIRPLANE_PATH "/trigger", O_RDWR),
+};
+
+
+int settings_find(const char *key)
+{
+	int i;
+
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (strcmp(settings[i].key, key) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+int settings_find_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (strcmp(settings[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+// re-read some numeric settings in one batch, returns the syscalls it took
+int settings_refresh_ids(const int *ids, int n)
+{
+	sysfs_attr_t *set[SETTING_NUM];
+	int i, k = 0;
+
+	for (i = 0; i < n && k < SETTING_NUM; i++) {
+		if (settings[ids[i]].type == SETTING_INT)
+			set[k++] = &settings[ids[i]].attr;
+	}
+
+	return sysfs_attr_refresh(set, k);
+}
+
+int settings_refresh(void)
+{
+	int ids[SETTING_NUM];
+	int i;
+
+	for (i = 0; i < SETTING_NUM; i++)
+		ids[i] = i;
+
+	return settings_refresh_ids(ids, SETTING_NUM);
+}
+
+// value of the last refresh, -1 if unknown
+int settings_int(int id)
+{
+	int val;
+
+	val = sysfs_attr_int(&settings[id].attr);
+	if (val < 0)
+		return -1;
+
+	return val / settings[id].scale;
+}
+
+// current value as text, for LED triggers only the selected one
+int settings_read_string(int id, char *buf, int len)
+{
+	char tmp[1024];
+	char *s, *e;
+	int val;
+
+	if (settings[id].type == SETTING_INT) {
+		val = settings_int(id);
+		if (val < 0)
+			return -EIO;
+		snprintf(buf, len, "%d", val);
+		return 0;
+	}
+
+	if (sysfs_attr_read_string(&settings[id].attr, tmp, sizeof(tmp)) < 0)
+		return -settings[id].attr.err;
+
+	// "none [rfkill-none] phy0rx ..."
+	s = strchr(tmp, '[');
+	e = (s != NULL) ? strchr(s, ']') : NULL;
+	if (s != NULL && e != NULL) {
+		*e = 0;
+		s++;
+	} else
+		s = tmp;
+	snprintf(buf, len, "%s", s);
+
+	return 0;
+}
+
+// write through attr, a handle of the same file that another thread owns,
+// settings[] itself is left alone
+int settings_write_int(sysfs_attr_t *attr, int id, int val)
+{
+	setting_t *set = &settings[id];
+	char buf[32];
+
+	if (set->flags & SETTING_RO)
+		return -EPERM;
+	if (set->type != SETTING_INT)
+		return -EINVAL;
+	if (val < set->min || val > set->max)
+		return -ERANGE;
+
+	snprintf(buf, sizeof(buf), "%d", val * set->scale);
+
+	return sysfs_attr_write(attr, buf);
+}
+
+int settings_set_int(int id, int val)
+{
+	setting_t *set = &settings[id];
+	int res;
+
+	res = settings_write_int(&set->attr, id, val);
+	if (res < 0)
+		return res;
+
+	// keep the cached value honest, the driver may have adjusted it
+	sysfs_attr_read(&set->attr);
+
+	return 0;
+}
+
+// would settings_set() accept this, without touching the hardware
+int settings_check(int id, const char *value)
+{
+	char *end;
+	long val;
+
+	if (settings[id].flags & SETTING_RO)
+		return -EPERM;
+
+	if (settings[id].type == SETTING_STRING)
+		return (value[0] == 0) ? -EINVAL : 0;
+
+	errno = 0;
+	val = strtol(value, &end, 10);
+	if (errno || end == value || *end != 0)
+		return -EINVAL;
+	if (val < settings[id].min || val > settings[id].max)
+		return -ERANGE;
+
+	return 0;
+}
+
+int settings_set(int id, const char *value)
+{
+	int res;
+
+	res = settings_check(id, value);
+	if (res < 0)
+		return res;
+
+	if (settings[id].type == SETTING_STRING)
+		return sysfs_attr_write(&settings[id].attr, value);
+
+	return settings_set_int(id, atoi(value));
+}
+
+// position of id in ids, -1 if the batch does not touch it
+static int settings_batch_find(int n, const int *ids, int id)
+{
+	int i;
+
+	for (i = n - 1; i >= 0; i--) {
+		if (ids[i] == id)
+			return i;
+	}
+
+	return -1;
+}
+
+// put a before b in the write order
+static void settings_order_before(int n, int *order, int a, int b)
+{
+	int i, ia = -1, ib = -1;
+
+	for (i = 0; i < n; i++) {
+		if (order[i] == a)
+			ia = i;
+		if (order[i] == b)
+			ib = i;
+	}
+	if (ia > ib) {
+		order[ib] = a;
+		order[ia] = b;
+	}
+}
+
+/*
+ * Write a batch as one transaction: everything is checked first, pairs
+ * that constrain each other are written in an order the hardware accepts
+ * (the EC refuses a start threshold at or above the end threshold, PL1
+ * must not exceed PL2), and if a write fails the ones before it are put
+ * back to a snapshot taken before the first write. *failed is the index
+ * of the value that was refused.
+ */
+int settings_apply(int n, const int *ids, const char * const *values, int *failed)
+{
+	char snap[SETTING_NUM][64];
+	int order[SETTING_NUM];
+	int i, j, res = 0, a, b;
+
+	*failed = -1;
+	if (n < 0)
+		return -EINVAL;
+	if (n > SETTING_NUM)
+		return -E2BIG;
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = 0; i < n; i++) {
+		res = settings_check(ids[i], values[i]);
+		if (res < 0) {
+			*failed = i;
+			return res;
+		}
+	}
+
+	settings_refresh_ids(ids, n);
+	for (i = 0; i < n; i++) {
+		if (settings_read_string(ids[i], snap[i], sizeof(snap[i])) < 0) {
+			*failed = i;
+			return -EIO;
+		}
+	}
+
+	// raising the window writes the end first, lowering it the start
+	a = settings_batch_find(n, ids, SETTING_BAT_START);
+	b = settings_batch_find(n, ids, SETTING_BAT_END);
+	if (a >= 0 && b >= 0) {
+		if (atoi(values[a]) >= atoi(values[b])) {
+			*failed = a;
+			return -ERANGE;
+		}
+		if (atoi(values[a]) >= settings_int(SETTING_BAT_END))
+			settings_order_before(n, order, b, a);
+		else
+			settings_order_before(n, order, a, b);
+	}
+	// same for PL1 below PL2
+	a = settings_batch_find(n, ids, SETTING_CPU_PL1);
+	b = settings_batch_find(n, ids, SETTING_CPU_PL2);
+	if (a >= 0 && b >= 0) {
+		if (atoi(values[b]) >= settings_int(SETTING_CPU_PL2))
+			settings_order_before(n, order, b, a);
+		else
+			settings_order_before(n, order, a, b);
+	}
+
+	for (i = 0; i < n; i++) {
+		res = settings_set(ids[order[i]], values[order[i]]);
+		if (res < 0)
+			break;
+	}
+	if (i == n)
+		return 0;
+
+	*failed = order[i];
+	for (j = i - 1; j >= 0; j--)
+		settings_set(ids[order[j]], snap[order[j]]);
+
+	return res;
+}
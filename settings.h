@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SETTINGS_H
+#define _SETTINGS_H
+
+#include "sysfs-attr.h"
+
+#define LED_RED_PATH			"/sys/class/leds/red:status"
+#define LED_GREEN_PATH			"/sys/class/leds/green:status"
+#define LED_BLUE_PATH			"/sys/class/leds/blue:status"
+#define LED_AIRPLANE_PATH		"/sys/class/leds/librem_ec:airplane"
+#define LED_KBD_BACKLIGHT		"/sys/class/leds/librem_ec:kbd_backlight"
+
+#define BAT_NAME				"BAT0"
+#define BAT_SOC					"/sys/class/power_supply/BAT0/capacity"
+#define BAT_STATUS				"/sys/class/power_supply/BAT0/status"
+#define BAT_ENERGY_NOW			"/sys/class/power_supply/BAT0/energy_now"
+#define BAT_POWER_NOW			"/sys/class/power_supply/BAT0/power_now"
+#define BAT_VOLTAGE_NOW			"/sys/class/power_supply/BAT0/voltage_now"
+#define BAT_START_THRESHOLD_PATH	"/sys/class/power_supply/BAT0/charge_control_start_threshold"
+#define BAT_END_THRESHOLD_PATH		"/sys/class/power_supply/BAT0/charge_control_end_threshold"
+#define AC_ONLINE				"/sys/class/power_supply/AC/online"
+
+#define CPU_PL1_PATH			"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/constraint_0_power_limit_uw"
+#define CPU_PL2_PATH			"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/constraint_1_power_limit_uw"
+#define CPU_ENERGY_PATH			"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/energy_uj"
+#define CPU_ENERGY_RANGE_PATH	"/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/max_energy_range_uj"
+
+#define THERMAL_CLASS_PATH		"/sys/class/thermal"
+#define HWMON_CLASS_PATH		"/sys/class/hwmon"
+
+enum {
+	SETTING_BAT_SOC = 0,
+	SETTING_BAT_START,
+	SETTING_BAT_END,
+	SETTING_BAT_STATUS,
+	SETTING_CPU_PL1,
+	SETTING_CPU_PL2,
+	SETTING_LED_RED,
+	SETTING_LED_GREEN,
+	SETTING_LED_BLUE,
+	SETTING_LED_KBD,
+	SETTING_LED_AIRPLANE,
+	SETTING_LED_AIRPLANE_TRIGGER,
+	SETTING_NUM
+};
+
+#define SETTING_INT			0
+#define SETTING_STRING		1
+
+#define SETTING_RO			(1 << 0)
+
+// one user visible setting backed by a sysfs attribute
+typedef struct {
+	const char *key;		// command line / profile name, e.g. "bat.start"
+	const char *name;		// D-Bus property name, e.g. "BatStart"
+	int type;
+	int flags;
+	int scale;				// sysfs value = value * scale
+	int min;
+	int max;
+	sysfs_attr_t attr;
+} setting_t;
+
+extern setting_t settings[SETTING_NUM];
+
+int settings_find(const char *key);
+
+int settings_find_name(const char *name);
+
+int settings_refresh_ids(const int *ids, int n);
+
+int settings_refresh(void);
+
+int settings_int(int id);
+
+int settings_read_string(int id, char *buf, int len);
+
+int settings_write_int(sysfs_attr_t *attr, int id, int val);
+
+int settings_set_int(int id, int val);
+
+int settings_check(int id, const char *value);
+
+int settings_set(int id, const char *value);
+
+int settings_apply(int n, const int *ids, const char * const *values, int *failed);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include <pthread.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "sysfs-attr.h"
+
+// number of reads submitted per io_uring batch
+#define SYSFS_ATTR_RING_SIZE	16
+
+// bumped from worker threads too, e.g. the write-behind and LED animation
+sysfs_attr_stats_t sysfs_attr_stats;
+
+#define SYSFS_ATTR_COUNT(f)		__atomic_fetch_add(&sysfs_attr_stats.f, 1, __ATOMIC_RELAXED)
+#define SYSFS_ATTR_LOAD(f)		__atomic_load_n(&sysfs_attr_stats.f, __ATOMIC_RELAXED)
+
+static const char *sysfs_attr_root;
+static int sysfs_attr_root_set;
+
+
+unsigned long sysfs_attr_syscalls(void)
+{
+	return SYSFS_ATTR_LOAD(opens) + SYSFS_ATTR_LOAD(reads) +
+		SYSFS_ATTR_LOAD(writes) + SYSFS_ATTR_LOAD(closes) +
+		SYSFS_ATTR_LOAD(submits);
+}
+
+// prefix for every attribute path, NULL for the real sysfs
+void sysfs_attr_set_root(const char *root)
+{
+	sysfs_attr_root = root;
+	sysfs_attr_root_set = 1;
+}
+
+// LIBREM_SYSFS_ROOT=DIR reads and writes a fake tree below DIR instead,
+// for directories walked by hand as well
+const char *sysfs_root_path(const char *path, char *buf, int len)
+{
+	if (!sysfs_attr_root_set)
+		sysfs_attr_set_root(getenv("LIBREM_SYSFS_ROOT"));
+	if (sysfs_attr_root == NULL || sysfs_attr_root[0] == 0)
+		return path;
+
+	snprintf(buf, len, "%s%s", sysfs_attr_root, path);
+	return buf;
+}
+
+int sysfs_attr_open(sysfs_attr_t *attr)
+{
+	char buf[PATH_MAX];
+	const char *path;
+
+	if (attr->fd >= 0)
+		return 0;
+
+	path = sysfs_root_path(attr->path, buf, sizeof(buf));
+	SYSFS_ATTR_COUNT(opens);
+	attr->fd = open(path, attr->flags | O_CLOEXEC);
+	// not root, we can still read
+	if (attr->fd < 0 && errno == EACCES && (attr->flags & O_ACCMODE) == O_RDWR) {
+		SYSFS_ATTR_COUNT(opens);
+		attr->fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	if (attr->fd < 0) {
+		attr->err = errno;
+		attr->len = -1;
+		return -attr->err;
+	}
+
+	return 0;
+}
+
+void sysfs_attr_close(sysfs_attr_t *attr)
+{
+	if (attr->fd < 0)
+		return;
+
+	SYSFS_ATTR_COUNT(closes);
+	close(attr->fd);
+	attr->fd = -1;
+}
+
+// the attribute went away (driver unload etc.), drop it and try again
+static int sysfs_attr_gone(int err)
+{
+	return (err == ENODEV || err == ENOENT || err == ESTALE || err == EBADF);
+}
+
+static int sysfs_attr_reopen(sysfs_attr_t *attr)
+{
+	sysfs_attr_close(attr);
+	return sysfs_attr_open(attr);
+}
+
+int sysfs_attr_read(sysfs_attr_t *attr)
+{
+	int res;
+	int retry = 1;
+
+	if (sysfs_attr_open(attr) < 0)
+		return -1;
+
+	do {
+		SYSFS_ATTR_COUNT(reads);
+		res = pread(attr->fd, attr->buf, SYSFS_ATTR_BUF_LEN - 1, 0);
+		if (res > 0)
+			break;
+		attr->err = (res < 0) ? errno : EIO;
+		if (!retry-- || !sysfs_attr_gone(attr->err) || sysfs_attr_reopen(attr) < 0) {
+			attr->len = -1;
+			return -1;
+		}
+	} while (1);
+
+	attr->buf[res] = 0;
+	attr->len = res;
+
+	return res;
+}
+
+// value of the last read, -1 if it failed
+int sysfs_attr_int(sysfs_attr_t *attr)
+{
+	if (attr->len <= 0)
+		return -1;
+
+	return atoi(attr->buf);
+}
+
+int sysfs_attr_read_int(sysfs_attr_t *attr)
+{
+	if (sysfs_attr_read(attr) < 0)
+		return -1;
+
+	return sysfs_attr_int(attr);
+}
+
+// for attributes that do not fit into the cached buffer, e.g. LED triggers
+int sysfs_attr_read_string(sysfs_attr_t *attr, char *string, int len)
+{
+	int res;
+
+	if (len < 2)
+		return -1;
+
+	if (sysfs_attr_open(attr) < 0)
+		return -1;
+
+	memset(string, 0, len);
+	SYSFS_ATTR_COUNT(reads);
+	res = pread(attr->fd, string, len-1, 0);
+	if (res < 0 && sysfs_attr_gone(errno) && sysfs_attr_reopen(attr) == 0) {
+		SYSFS_ATTR_COUNT(reads);
+		res = pread(attr->fd, string, len-1, 0);
+	}
+	if (res <= 0) {
+		attr->err = (res < 0) ? errno : EIO;
+		return -1;
+	}
+
+	if (string[res-1] == '\n')
+		string[res-1] = 0;
+
+	return res;
+}
+
+int sysfs_attr_write(sysfs_attr_t *attr, const char *value)
+{
+	int res;
+	int len;
+
+	if (value == NULL)
+		return -EINVAL;
+
+	if (sysfs_attr_open(attr) < 0)
+		return -attr->err;
+
+	len = strlen(value);
+	SYSFS_ATTR_COUNT(writes);
+	res = pwrite(attr->fd, value, len, 0);
+	if (res < 0 && sysfs_attr_gone(errno) && sysfs_attr_reopen(attr) == 0) {
+		SYSFS_ATTR_COUNT(writes);
+		res = pwrite(attr->fd, value, len, 0);
+	}
+	if (res < 0) {
+		attr->err = errno;
+		return -attr->err;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_LIBURING
+static struct io_uring sysfs_ring;
+static int sysfs_ring_state;	// 0 = not tried, 1 = usable, -1 = unavailable
+// refreshes also run on workers, e.g. the fan curve on the EC worker
+static pthread_mutex_t sysfs_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Submit one read per open attribute in a single io_uring_enter(). Every
+ * attribute the ring did not read keeps len -1 and is left to pread().
+ */
+static void sysfs_attr_refresh_uring(sysfs_attr_t *set[], int n)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	sysfs_attr_t *attr;
+	int i, queued;
+	int res;
+
+	if (sysfs_ring_state == 0) {
+		SYSFS_ATTR_COUNT(submits);
+		sysfs_ring_state = (io_uring_queue_init(SYSFS_ATTR_RING_SIZE, &sysfs_ring, 0) == 0) ? 1 : -1;
+	}
+	if (sysfs_ring_state < 0)
+		return;
+
+	i = 0;
+	while (i < n) {
+		queued = 0;
+		for (; i < n && queued < SYSFS_ATTR_RING_SIZE; i++) {
+			attr = set[i];
+			if (attr->fd < 0)
+				continue;
+			sqe = io_uring_get_sqe(&sysfs_ring);
+			if (sqe == NULL)
+				break;
+			io_uring_prep_read(sqe, attr->fd, attr->buf, SYSFS_ATTR_BUF_LEN - 1, 0);
+			io_uring_sqe_set_data(sqe, attr);
+			queued++;
+		}
+		if (queued == 0)
+			break;
+
+		SYSFS_ATTR_COUNT(submits);
+		res = io_uring_submit_and_wait(&sysfs_ring, queued);
+		while (res >= 0 && queued > 0) {
+			res = io_uring_wait_cqe(&sysfs_ring, &cqe);
+			if (res < 0)
+				break;
+			attr = io_uring_cqe_get_data(cqe);
+			if (cqe->res > 0) {
+				attr->buf[cqe->res] = 0;
+				attr->len = cqe->res;
+			} else
+				attr->err = cqe->res < 0 ? -cqe->res : EIO;
+			io_uring_cqe_seen(&sysfs_ring, cqe);
+			queued--;
+		}
+		if (res < 0) {
+			// unsubmitted reads and late completions must not show up in the next batch
+			io_uring_queue_exit(&sysfs_ring);
+			sysfs_ring_state = 0;
+			return;
+		}
+	}
+}
+#endif
+
+// re-read a whole set of attributes, returns the number of syscalls it took
+int sysfs_attr_refresh(sysfs_attr_t *set[], int n)
+{
+	unsigned long start = sysfs_attr_syscalls();
+	int i;
+
+	for (i = 0; i < n; i++)
+		set[i]->len = -1;
+#ifdef HAVE_LIBURING
+	pthread_mutex_lock(&sysfs_ring_lock);
+	sysfs_attr_refresh_uring(set, n);
+	pthread_mutex_unlock(&sysfs_ring_lock);
+#endif
+
+	// whatever the batch did not get, closed or vanished attributes included
+	for (i = 0; i < n; i++) {
+		if (set[i]->len < 0)
+			sysfs_attr_read(set[i]);
+	}
+
+	return (int)(sysfs_attr_syscalls() - start);
+}
+
+// first entry of a class directory whose file "attr" starts with "match",
+// path is left without the LIBREM_SYSFS_ROOT prefix like every attribute path
+int sysfs_class_find(const char *class, const char *attr, const char *match,
+                     const char *file, char *path, int len)
+{
+	char root[PATH_MAX];
+	char buf[64];
+	sysfs_attr_t a;
+	struct dirent *de;
+	DIR *dir;
+	int res = -ENODEV;
+
+	dir = opendir(sysfs_root_path(class, root, sizeof(root)));
+	if (dir == NULL)
+		return -errno;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, len, "%s/%s/%s", class, de->d_name, attr);
+		a = (sysfs_attr_t)SYSFS_ATTR_INIT(path, O_RDONLY);
+		if (sysfs_attr_read_string(&a, buf, sizeof(buf)) > 0 && strncmp(buf, match, strlen(match)) == 0) {
+			snprintf(path, len, "%s/%s/%s", class, de->d_name, file);
+			res = 0;
+		}
+		sysfs_attr_close(&a);
+		if (res == 0)
+			break;
+	}
+	closedir(dir);
+
+	return res;
+}
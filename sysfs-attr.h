@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SYSFS_ATTR_H
+#define _SYSFS_ATTR_H
+
+#include <fcntl.h>
+
+#define SYSFS_ATTR_BUF_LEN		64
+
+// a sysfs attribute that is opened once and re-read with pread(fd, 0)
+typedef struct {
+	const char *path;
+	int flags;			// O_RDONLY or O_RDWR
+	int fd;				// -1 if not (yet) open
+	int len;			// length of last read, -1 on error
+	int err;			// errno of last failed operation
+	char buf[SYSFS_ATTR_BUF_LEN];
+} sysfs_attr_t;
+
+#define SYSFS_ATTR_INIT(p, f)	{ .path = (p), .flags = (f), .fd = -1, .len = -1 }
+
+// syscalls issued on sysfs attributes, for measuring refresh cost
+typedef struct {
+	unsigned long opens;
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long closes;
+	unsigned long submits;		// io_uring batches
+} sysfs_attr_stats_t;
+
+extern sysfs_attr_stats_t sysfs_attr_stats;
+
+unsigned long sysfs_attr_syscalls(void);
+
+void sysfs_attr_set_root(const char *root);
+
+const char *sysfs_root_path(const char *path, char *buf, int len);
+
+int sysfs_attr_open(sysfs_attr_t *attr);
+
+void sysfs_attr_close(sysfs_attr_t *attr);
+
+int sysfs_attr_read(sysfs_attr_t *attr);
+
+int sysfs_attr_int(sysfs_attr_t *attr);
+
+int sysfs_attr_read_int(sysfs_attr_t *attr);
+
+int sysfs_attr_read_string(sysfs_attr_t *attr, char *string, int len);
+
+int sysfs_attr_write(sysfs_attr_t *attr, const char *value);
+
+int sysfs_attr_refresh(sysfs_attr_t *set[], int n);
+
+int sysfs_class_find(const char *class, const char *attr, const char *match,
+                     const char *file, char *path, int len);
+
+#endif
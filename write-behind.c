@@ -0,0 +1,297 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Write-behind for values that change faster than the hardware takes
+ * them, like slider drags on EC backed LEDs.
+ *
+ * Values are collected per setting, last one wins, and flushed at most
+ * once per frame as one batch on a worker thread. Values equal to what
+ * was last written are dropped. Only one batch is in flight at a time,
+ * whatever arrives meanwhile is merged into the next one, so a slow EC
+ * never builds up a queue of stale writes.
+ *
+ * Single writes that must not be coalesced, like the charge threshold
+ * steps of charge-ctl, are queued with write_behind_write() and go out
+ * one at a time, in order, ahead of the coalesced values. Everything
+ * that is written goes through the same queue, so two writes never run
+ * at the same time.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <gio/gio.h>
+
+#include "write-behind.h"
+
+struct _write_behind {
+	write_behind_func func;
+	gpointer user_data;
+	int pending[SETTING_NUM];	// -1 if nothing to write
+	int written[SETTING_NUM];	// -1 if unknown
+	gboolean flying[SETTING_NUM];	// part of the batch in flight
+	GQueue writes;				// write_behind_write(), oldest first
+	guint timer;
+	gboolean in_flight;			// until write_behind_done() ran
+	gboolean dead;				// freed while a batch was in flight
+	GMutex lock;
+	GCond cond;
+	gboolean running;			// func still running on the worker, under lock
+};
+
+typedef struct {
+	write_behind_t *wb;
+	write_behind_func func;
+	gpointer user_data;
+	int n;
+	int ids[SETTING_NUM];
+	int values[SETTING_NUM];
+	write_behind_done_func done;	// single writes only
+	gpointer done_data;
+} write_behind_batch_t;
+
+static void write_behind_schedule(write_behind_t *wb);
+
+
+static void write_behind_thread(GTask *task, gpointer source, gpointer data, GCancellable *cancel)
+{
+	write_behind_batch_t *batch = (write_behind_batch_t *)data;
+	write_behind_t *wb = batch->wb;
+	int res;
+
+	res = batch->func(batch->n, batch->ids, batch->values, batch->user_data);
+
+	g_mutex_lock(&wb->lock);
+	wb->running = FALSE;
+	g_cond_signal(&wb->cond);
+	g_mutex_unlock(&wb->lock);
+
+	g_task_return_int(task, res);
+}
+
+static void write_behind_finish(write_behind_t *wb, write_behind_batch_t *batch, int res)
+{
+	int i;
+
+	wb->in_flight = FALSE;
+	memset(wb->flying, 0, sizeof(wb->flying));
+
+	// do not trust what we think is written, the next set goes out again
+	if (res < 0) {
+		for (i = 0; i < batch->n; i++)
+			wb->written[batch->ids[i]] = -1;
+	}
+	if (batch->done != NULL)
+		batch->done(res, batch->done_data);
+
+	write_behind_schedule(wb);
+}
+
+static void write_behind_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	write_behind_t *wb = (write_behind_t *)user_data;
+	write_behind_batch_t *batch = g_task_get_task_data(G_TASK(result));
+	int res;
+
+	res = (int)g_task_propagate_int(G_TASK(result), NULL);
+	if (wb->dead) {
+		// everything else was written by write_behind_free()
+		if (batch->done != NULL)
+			batch->done(res, batch->done_data);
+		g_mutex_clear(&wb->lock);
+		g_cond_clear(&wb->cond);
+		g_free(wb);
+		return;
+	}
+	write_behind_finish(wb, batch, res);
+}
+
+// next single write or pending values as a batch, NULL if there is nothing new
+static write_behind_batch_t *write_behind_take(write_behind_t *wb)
+{
+	write_behind_batch_t *batch;
+	int i;
+
+	batch = g_queue_pop_head(&wb->writes);
+	if (batch != NULL) {
+		wb->written[batch->ids[0]] = batch->values[0];
+		return batch;
+	}
+
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (wb->pending[i] < 0)
+			continue;
+		if (wb->pending[i] != wb->written[i]) {
+			if (batch == NULL) {
+				batch = g_new0(write_behind_batch_t, 1);
+				batch->func = wb->func;
+				batch->user_data = wb->user_data;
+			}
+			batch->ids[batch->n] = i;
+			batch->values[batch->n] = wb->pending[i];
+			batch->n++;
+			wb->written[i] = wb->pending[i];
+		}
+		wb->pending[i] = -1;
+	}
+
+	return batch;
+}
+
+static gboolean write_behind_flush(gpointer user_data)
+{
+	write_behind_t *wb = (write_behind_t *)user_data;
+	write_behind_batch_t *batch;
+	GTask *task;
+	int i;
+
+	wb->timer = 0;
+	batch = write_behind_take(wb);
+	if (batch == NULL)
+		return G_SOURCE_REMOVE;
+
+	wb->in_flight = TRUE;
+	wb->running = TRUE;
+	for (i = 0; i < batch->n; i++)
+		wb->flying[batch->ids[i]] = TRUE;
+	batch->wb = wb;
+	task = g_task_new(NULL, NULL, write_behind_done, wb);
+	g_task_set_task_data(task, batch, g_free);
+	g_task_run_in_thread(task, write_behind_thread);
+	g_object_unref(task);
+
+	return G_SOURCE_REMOVE;
+}
+
+// write everything still queued or pending synchronously
+static void write_behind_drain(write_behind_t *wb)
+{
+	write_behind_batch_t *batch;
+	int res;
+
+	while ((batch = write_behind_take(wb)) != NULL) {
+		res = batch->func(batch->n, batch->ids, batch->values, batch->user_data);
+		if (batch->done != NULL)
+			batch->done(res, batch->done_data);
+		g_free(batch);
+	}
+}
+
+static void write_behind_schedule(write_behind_t *wb)
+{
+	int i;
+
+	if (wb->timer != 0 || wb->in_flight)
+		return;
+
+	if (!g_queue_is_empty(&wb->writes)) {
+		wb->timer = g_idle_add(write_behind_flush, wb);
+		return;
+	}
+
+	for (i = 0; i < SETTING_NUM; i++) {
+		if (wb->pending[i] >= 0) {
+			wb->timer = g_timeout_add(WRITE_BEHIND_FRAME_MS, write_behind_flush, wb);
+			return;
+		}
+	}
+}
+
+write_behind_t *write_behind_new(write_behind_func func, gpointer user_data)
+{
+	write_behind_t *wb;
+
+	wb = g_new0(write_behind_t, 1);
+	wb->func = func;
+	wb->user_data = user_data;
+	memset(wb->pending, 0xff, sizeof(wb->pending));
+	memset(wb->written, 0xff, sizeof(wb->written));
+	g_queue_init(&wb->writes);
+	g_mutex_init(&wb->lock);
+	g_cond_init(&wb->cond);
+
+	return wb;
+}
+
+void write_behind_set(write_behind_t *wb, int id, int value)
+{
+	wb->pending[id] = value;
+	write_behind_schedule(wb);
+}
+
+// queue one write of exactly this value, done is called with its result
+void write_behind_write(write_behind_t *wb, int id, int value, write_behind_done_func done, gpointer user_data)
+{
+	write_behind_batch_t *batch;
+
+	batch = g_new0(write_behind_batch_t, 1);
+	batch->func = wb->func;
+	batch->user_data = wb->user_data;
+	batch->n = 1;
+	batch->ids[0] = id;
+	batch->values[0] = value;
+	batch->done = done;
+	batch->done_data = user_data;
+	g_queue_push_tail(&wb->writes, batch);
+
+	write_behind_schedule(wb);
+}
+
+// a write for this setting is pending or in flight, reports of the
+// hardware value may be stale until it is done
+gboolean write_behind_busy(write_behind_t *wb, int id)
+{
+	return wb->pending[id] >= 0 || wb->flying[id];
+}
+
+// the hardware reported this value, e.g. after a hotkey changed it
+void write_behind_seen(write_behind_t *wb, int id, int value)
+{
+	wb->written[id] = value;
+}
+
+/*
+ * Whatever is still queued or pending is written synchronously, after the
+ * batch in flight, so an older value never lands after a newer one. The
+ * done callback of that batch still runs if the main context does.
+ */
+void write_behind_free(write_behind_t *wb)
+{
+	if (wb->timer != 0)
+		g_source_remove(wb->timer);
+
+	g_mutex_lock(&wb->lock);
+	while (wb->running)
+		g_cond_wait(&wb->cond, &wb->lock);
+	g_mutex_unlock(&wb->lock);
+
+	// written[] may be wrong if it failed, write everything still pending
+	if (wb->in_flight)
+		memset(wb->written, 0xff, sizeof(wb->written));
+	write_behind_drain(wb);
+
+	if (wb->in_flight) {
+		wb->dead = TRUE;
+		return;
+	}
+	g_mutex_clear(&wb->lock);
+	g_cond_clear(&wb->cond);
+	g_free(wb);
+}
@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (C) 2022 Nicole Faerber <nicole.faerber@puri.sm>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether expressed or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License version 2 for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _WRITE_BEHIND_H
+#define _WRITE_BEHIND_H
+
+#include <glib.h>
+
+#include "settings.h"
+
+// one flush per frame at most
+#define WRITE_BEHIND_FRAME_MS	16
+
+// returns 0 or -errno, runs on a worker thread and must not touch what
+// the main thread uses
+typedef int (*write_behind_func)(int n, const int *ids, const int *values, gpointer user_data);
+
+// result of a single write, on the main context
+typedef void (*write_behind_done_func)(int res, gpointer user_data);
+
+typedef struct _write_behind write_behind_t;
+
+write_behind_t *write_behind_new(write_behind_func func, gpointer user_data);
+
+void write_behind_set(write_behind_t *wb, int id, int value);
+
+void write_behind_write(write_behind_t *wb, int id, int value, write_behind_done_func done, gpointer user_data);
+
+gboolean write_behind_busy(write_behind_t *wb, int id);
+
+void write_behind_seen(write_behind_t *wb, int id, int value);
+
+void write_behind_free(write_behind_t *wb);
+
+#endif